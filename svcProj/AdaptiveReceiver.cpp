@@ -0,0 +1,182 @@
+//
+//  AdaptiveReceiver.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <algorithm>
+#include "AdaptiveReceiver.hpp"
+#include "Logger.hpp"
+#include "SVCEncoder.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+static const AdaptiveSettings kDefaultAdaptiveSettings = {
+    0.9,        // the decoder thread is 90% busy
+    0.6,        // room for decode time jitter after a step up
+    8,          // a third of a second at 25fps
+    2000,
+    100,
+};
+
+AdaptiveReceiver::AdaptiveReceiver(const std::string &tag, int temporalId, int spatialId, int temporalNum, const std::vector<int> &spatialAreas,
+                                   const std::vector<float> &spatialFrameRates, double sourceFps, const AdaptiveSettings &settings): tag_(tag),
+    maxTemporalId_(temporalId), maxSpatialId_(spatialId), temporalNum_(std::max(temporalNum, 1)), spatialAreas_(spatialAreas),
+    spatialFrameRates_(spatialFrameRates), sourceFps_(sourceFps > 0 ? sourceFps : 25), settings_(settings),
+    temporalId_(temporalId), spatialId_(spatialId), pendingTemporalId_(temporalId), pendingSpatialId_(spatialId), waitIdr_(false),
+    lastSwitch_(std::chrono::steady_clock::now()), lastEvaluate_(lastSwitch_) {
+    settings_.evaluateMs = std::max(settings_.evaluateMs, 1);
+    settings_.downQueueDepth = std::max(settings_.downQueueDepth, 1);
+    memset(&stats_, 0, sizeof(AdaptiveStats));
+}
+
+AdaptiveReceiver::~AdaptiveReceiver() {}
+
+const AdaptiveSettings &AdaptiveReceiver::defaultSettings() {
+    return kDefaultAdaptiveSettings;
+}
+
+double AdaptiveReceiver::fpsAt(int temporalId, int spatialId) {
+    // every temporal layer doubles the frame rate of the one below, a capped spatial layer lacks the top ones
+    auto fps = sourceFps_ / (1 << std::max(temporalNum_ - 1 - temporalId, 0));
+    auto cap = spatialId >= 0 && static_cast<size_t>(spatialId) < spatialFrameRates_.size() ? spatialFrameRates_[spatialId] : 0;
+    return std::min(fps, static_cast<double>(SVCEncoder::layerFrameRate(cap, static_cast<float>(sourceFps_), temporalNum_)));
+}
+
+void AdaptiveReceiver::onLayer(int temporalId, int spatialId, bool idr) {
+    if (idr && spatialId == pendingSpatialId_ && pendingSpatialId_ != spatialId_) {
+        logSwitch("spatial", temporalId_, spatialId_, pendingTemporalId_, pendingSpatialId_, -1, 0);
+        spatialId_ = pendingSpatialId_;
+        temporalId_ = pendingTemporalId_;   // an IDR is T0 as well
+        waitIdr_ = false;
+        return;
+    }
+
+    if (spatialId != spatialId_) {
+        return;
+    }
+
+    if (idr) {
+        waitIdr_ = false;
+    }
+
+    if (temporalId == 0 && pendingTemporalId_ > temporalId_) {
+        logSwitch("temporal", temporalId_, spatialId_, pendingTemporalId_, spatialId_, -1, 0);
+        temporalId_ = pendingTemporalId_;
+    }
+}
+
+bool AdaptiveReceiver::wants(int temporalId, int spatialId) {
+    if (spatialId != spatialId_) {
+        return false;
+    }
+
+    if (waitIdr_ || temporalId > temporalId_) {
+        stats_.skipped++;
+        return false;
+    }
+
+    return true;
+}
+
+void AdaptiveReceiver::onDelivered() {
+    stats_.delivered++;
+}
+
+void AdaptiveReceiver::onDropped(int temporalId) {
+    stats_.dropped++;
+    if (waitIdr_ || (temporalId == temporalId_ && temporalId > 0)) {
+        return; // the top layer of the operating point is not referenced within it
+    }
+
+    waitIdr_ = true;
+    SVC_LOG(AV_LOG_WARNING, "AdaptiveReceiver[%s]: queue full, lost a T%d access unit, wait for the next IDR\n", tag_, temporalId);
+}
+
+void AdaptiveReceiver::evaluate(double decodeMs, size_t queueDepth) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastEvaluate_ < std::chrono::milliseconds(settings_.evaluateMs)) {
+        return;
+    }
+    lastEvaluate_ = now;
+
+    auto sinceSwitch = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSwitch_).count();
+    auto load = decodeMs * fpsAt(temporalId_, spatialId_) / 1000;
+    auto pending = pendingTemporalId_ != temporalId_ || pendingSpatialId_ != spatialId_;
+    if (load > settings_.downLoad || queueDepth >= (size_t)settings_.downQueueDepth) {
+        // a step down needs a while to show up in the average and the queue
+        if (sinceSwitch < settings_.holdMs / 4 || pendingSpatialId_ < spatialId_) {
+            return;
+        }
+
+        pendingSpatialId_ = spatialId_;     // a step up still waiting for its IDR / T0 is off
+        pendingTemporalId_ = temporalId_;
+        if (temporalId_ > 0) {
+            logSwitch("temporal", temporalId_, spatialId_, temporalId_ - 1, spatialId_, load, queueDepth);
+            temporalId_--;
+            pendingTemporalId_ = temporalId_;
+        } else if (spatialId_ > 0) {
+            logSwitch("spatial (at the next IDR)", temporalId_, spatialId_, temporalId_, spatialId_ - 1, load, queueDepth);
+            pendingSpatialId_ = spatialId_ - 1;
+        } else {
+            return; // lowest operating point already, the queue drops what it can not take
+        }
+
+        lastSwitch_ = now;
+        return;
+    }
+
+    if (pending || sinceSwitch < settings_.holdMs || queueDepth > 1) {
+        return;
+    }
+
+    // back up in the reverse order: resolution first, then frame rate
+    if (spatialId_ < maxSpatialId_ && static_cast<size_t>(spatialId_ + 1) < spatialAreas_.size() && spatialAreas_[spatialId_] > 0) {
+        auto projected = load * spatialAreas_[spatialId_ + 1] / spatialAreas_[spatialId_]
+                       * fpsAt(temporalId_, spatialId_ + 1) / fpsAt(temporalId_, spatialId_);
+        if (projected < settings_.upLoad) {
+            pendingSpatialId_ = spatialId_ + 1;
+            pendingTemporalId_ = temporalId_;
+            lastSwitch_ = now;
+        }
+    } else if (temporalId_ < maxTemporalId_) {
+        if (load * fpsAt(temporalId_ + 1, spatialId_) / fpsAt(temporalId_, spatialId_) < settings_.upLoad) {
+            pendingTemporalId_ = temporalId_ + 1;
+            lastSwitch_ = now;
+        }
+    }
+}
+
+void AdaptiveReceiver::logSwitch(const char *what, int fromT, int fromS, int toT, int toS, double load, size_t queueDepth) {
+    stats_.switches++;
+    if (load < 0) {
+        av_log(NULL, AV_LOG_INFO, "AdaptiveReceiver[%s]: %s switch T%d S%d -> T%d S%d\n", tag_.c_str(), what, fromT, fromS, toT, toS);
+        return;
+    }
+
+    av_log(NULL, AV_LOG_INFO, "AdaptiveReceiver[%s]: %s switch T%d S%d -> T%d S%d, load = %.2f, queued = %zu\n",
+           tag_.c_str(), what, fromT, fromS, toT, toS, load, queueDepth);
+}
+
+int AdaptiveReceiver::temporalId() {
+    return temporalId_;
+}
+
+int AdaptiveReceiver::spatialId() {
+    return spatialId_;
+}
+
+const AdaptiveStats &AdaptiveReceiver::stats() {
+    return stats_;
+}
+
+void AdaptiveReceiver::report() {
+    av_log(NULL, AV_LOG_INFO, "AdaptiveReceiver[%s]: at T%d S%d (of T%d S%d), delivered = %llu, dropped = %llu, skipped = %llu, switches = %llu\n",
+           tag_.c_str(), temporalId_, spatialId_, maxTemporalId_, maxSpatialId_, (unsigned long long)stats_.delivered,
+           (unsigned long long)stats_.dropped, (unsigned long long)stats_.skipped, (unsigned long long)stats_.switches);
+}
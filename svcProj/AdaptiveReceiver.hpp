@@ -0,0 +1,108 @@
+//
+//  AdaptiveReceiver.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef AdaptiveReceiver_hpp
+#define AdaptiveReceiver_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+
+struct AdaptiveSettings {
+    double downLoad;        // step down once decode time * frame rate exceeds this share of the decoder thread
+    double upLoad;          // step up only if the projected load of the next operating point stays below this
+    int downQueueDepth;     // step down once this many access units wait in the decoder queue
+    int holdMs;             // no step up within this long after any switch
+    int evaluateMs;         // how often the load is looked at
+};
+
+struct AdaptiveStats {
+    uint64_t delivered;     // access units handed to the decoder
+    uint64_t dropped;       // access units the full queue refused
+    uint64_t skipped;       // access units above the current operating point or while waiting for an IDR
+    uint64_t switches;      // operating point changes
+};
+
+using AdaptiveSettings = struct AdaptiveSettings;
+using AdaptiveStats = struct AdaptiveStats;
+
+/* Picks the operating point a decoder is fed, at most its own (T, S), from the decoder's
+ * moving average decode time and queue depth. Down: temporal right away (lower T never
+ * references higher T), spatial at the next IDR of the lower layer once T0 is reached.
+ * Up: temporal at a T0 access unit, spatial at an IDR, after holdMs of headroom.
+ * An access unit the queue refuses is dropped instead of blocking the encoder, unless only
+ * the top temporal layer (never referenced) was lost the decoder waits for the next IDR.
+ * Not thread safe, the owner serializes the calls.
+ */
+class AdaptiveReceiver {
+public:
+    /* tag: names the receiver in the switch events
+     * temporalId, spatialId: operating point it subscribed to, never exceeded
+     * temporalNum: temporal layers of the stream
+     * spatialAreas: width * height of every spatial layer, to project the load of a spatial step up
+     * spatialFrameRates: SpatialData::frameRate of every spatial layer, 0 if uncapped
+     * sourceFps: frame rate of the full stream (top T)
+     */
+    AdaptiveReceiver(const std::string &tag, int temporalId, int spatialId, int temporalNum, const std::vector<int> &spatialAreas,
+                     const std::vector<float> &spatialFrameRates, double sourceFps, const AdaptiveSettings &settings);
+
+    ~AdaptiveReceiver();
+
+    // a picture layer of an access unit arrives (never its parameter sets), switches that wait for it take place here
+    void onLayer(int temporalId, int spatialId, bool idr);
+
+    // RETURN: true if that layer is the one to feed the decoder
+    bool wants(int temporalId, int spatialId);
+
+    void onDelivered();
+
+    void onDropped(int temporalId);
+
+    // decodeMs: moving average decode time, queueDepth: access units waiting
+    void evaluate(double decodeMs, size_t queueDepth);
+
+    int temporalId();
+
+    int spatialId();
+
+    const AdaptiveStats &stats();
+
+    void report();
+
+    static const AdaptiveSettings &defaultSettings();
+
+private:
+    // frames per second decoded at (temporalId, spatialId), the frame rate cap of the spatial layer included
+    double fpsAt(int temporalId, int spatialId);
+
+    void logSwitch(const char *what, int fromT, int fromS, int toT, int toS, double load, size_t queueDepth);
+
+private:
+    std::string tag_;
+    int maxTemporalId_;
+    int maxSpatialId_;
+    int temporalNum_;
+    std::vector<int> spatialAreas_;
+    std::vector<float> spatialFrameRates_;
+    double sourceFps_;
+    AdaptiveSettings settings_;
+    AdaptiveStats stats_;
+    int temporalId_;                // current operating point
+    int spatialId_;
+    int pendingTemporalId_;         // waits for a T0 access unit, == temporalId_ if nothing pending
+    int pendingSpatialId_;          // waits for an IDR of that layer, == spatialId_ if nothing pending
+    bool waitIdr_;                  // references were lost, feed nothing until the next IDR
+    std::chrono::steady_clock::time_point lastSwitch_;
+    std::chrono::steady_clock::time_point lastEvaluate_;
+};
+
+using AdaptiveReceiverShr = std::shared_ptr<AdaptiveReceiver>;
+
+#endif /* AdaptiveReceiver_hpp */
@@ -0,0 +1,148 @@
+//
+//  Autotuner.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "Autotuner.hpp"
+#include "SVCProj.hpp"
+#include "CodecPool.hpp"
+
+#define AUTOTUNE_MIN_GAIN       0.03    // a candidate has to be 3% better to count
+#define AUTOTUNE_DRAIN_MS       60000
+
+// one knob of SVCTuning and the values it is swept over
+struct AutotuneKnob {
+    const char *name;
+    int SVCTuning::*field;
+    std::vector<int> values;
+};
+
+Autotuner::Autotuner(const AutotuneOptions &options): options_(options), passes_(0) {
+    options_.frames = std::max(options_.frames, 1);
+    options_.rounds = std::max(options_.rounds, 1);
+}
+
+Autotuner::~Autotuner() {}
+
+Autotuner::PassResult Autotuner::measure(const SVCTuning &tuning) {
+    PassResult result = {false, 0, 0, 0};
+    auto proj = std::make_shared<SVCProj>(options_.temporalNum, static_cast<int>(options_.spatials.size()), options_.spatials);
+    proj->setTuning(tuning)->setFrameLimit(options_.frames);
+
+    // the previous candidate left codecs of its own settings idle, every pass starts from an empty pool
+    CodecPool::shared().clear();
+
+    std::string url = options_.url, noDump;
+    proj->start(url, noDump, 0, AV_LOG_ERROR);
+    proj->stop(SVC_SHUTDOWN_DRAIN, AUTOTUNE_DRAIN_MS);   // the read thread ends by itself after the frame limit
+    passes_++;
+
+    // first decoded to last encoded frame: opening and probing the input, codec setup and the drain do not count
+    auto timings = proj->stageTimings();
+    auto seconds = timings ? timings->busySeconds() : 0;
+    if (!timings || !timings->count(SVC_STAGE_TOTAL) || seconds <= 0) {
+        return result;
+    }
+
+    result.ok = true;
+    result.frames = timings->count(SVC_STAGE_TOTAL);
+    result.fps = result.frames / seconds;
+    result.p99Ms = timings->percentile(SVC_STAGE_TOTAL, 0.99);
+    return result;
+}
+
+bool Autotuner::better(const PassResult &candidate, const PassResult &best) {
+    if (!candidate.ok || !best.ok) {
+        return candidate.ok;
+    }
+
+    if (options_.p99BoundMs > 0) {
+        auto candidateMeets = candidate.p99Ms <= options_.p99BoundMs;
+        auto bestMeets = best.p99Ms <= options_.p99BoundMs;
+        if (candidateMeets != bestMeets) {
+            return candidateMeets;
+        }
+
+        if (!candidateMeets) {  // nothing meets the bound yet, get closer to it
+            return candidate.p99Ms < best.p99Ms * (1 - AUTOTUNE_MIN_GAIN);
+        }
+    }
+
+    return candidate.fps > best.fps * (1 + AUTOTUNE_MIN_GAIN);
+}
+
+void Autotuner::printPass(FILE *out, const SVCTuning &tuning, const PassResult &result, bool best) {
+    fprintf(out, "%3d  queue %3d  dec %2d  enc %2d  cplx %d  slices %d  %-6s  ", passes_, tuning.queueMaxSize, tuning.decoderThreads,
+            tuning.encoderThreads, tuning.encoderComplexity, tuning.encoderSlices, tuning.fused ? "fused" : "queued");
+    if (!result.ok) {
+        fprintf(out, "failed\n");
+    } else {
+        fprintf(out, "%6llu frames  %8.1f fps  p99 %8.2f ms%s\n", (unsigned long long)result.frames, result.fps, result.p99Ms, best ? "  *" : "");
+    }
+    fflush(out);
+}
+
+int Autotuner::run(SVCTuning &best, FILE *out) {
+    auto cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    std::vector<AutotuneKnob> knobs = {
+        {"queue_max_size", &SVCTuning::queueMaxSize, {4, 8, 16, 32, 50}},
+        {"h264_decoder_threads", &SVCTuning::decoderThreads, {1, 2, 4, cores}},
+        {"encoder_threads", &SVCTuning::encoderThreads, {1, 2, 4, cores}},
+        {"encoder_complexity", &SVCTuning::encoderComplexity, {0, 1, 2}},
+        {"encoder_slices", &SVCTuning::encoderSlices, {1, 2, 4}},
+        {"pipeline", &SVCTuning::fused, {0, 1}},
+    };
+    for (auto it = knobs.begin(); it != knobs.end(); it++) {
+        std::sort(it->values.begin(), it->values.end());
+        it->values.erase(std::unique(it->values.begin(), it->values.end()), it->values.end());
+    }
+
+    // start near the built-in settings: 50 items per queue, 4 h264 decoder threads, single threaded encoder
+    best = {50, 4, 1, 1, 1, 0};
+    fprintf(out, "== autotune: %s, %d frames per pass, target %s\n", options_.url.c_str(), options_.frames,
+            options_.p99BoundMs > 0 ? ("max fps with p99 <= " + std::to_string(options_.p99BoundMs) + " ms").c_str() : "max fps");
+    measure(best);      // discarded: the input is in the page cache and the libraries are loaded for every pass after it
+    passes_ = 0;
+    auto bestResult = measure(best);
+    printPass(out, best, bestResult, true);
+    if (!bestResult.ok) {
+        return -1;
+    }
+
+    for (auto round = 0; round < options_.rounds; round++) {
+        auto improved = false;
+        for (auto knob = knobs.begin(); knob != knobs.end(); knob++) {
+            auto current = best.*(knob->field);
+            for (auto value = knob->values.begin(); value != knob->values.end(); value++) {
+                if (*value == current) {
+                    continue;
+                }
+
+                auto candidate = best;
+                candidate.*(knob->field) = *value;
+                auto result = measure(candidate);
+                auto wins = better(result, bestResult);
+                printPass(out, candidate, result, wins);
+                if (wins) {
+                    best = candidate;
+                    bestResult = result;
+                    improved = true;
+                }
+            }
+        }
+
+        if (!improved) {
+            break;
+        }
+    }
+
+    fprintf(out, "== best after %d passes: %.1f fps, p99 %.2f ms%s\n", passes_, bestResult.fps, bestResult.p99Ms,
+            options_.p99BoundMs > 0 && bestResult.p99Ms > options_.p99BoundMs ? " (bound not met)" : "");
+    SVCTuningFile::print(out, best);
+    return 0;
+}
@@ -0,0 +1,62 @@
+//
+//  Autotuner.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef Autotuner_hpp
+#define Autotuner_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "SVCTuning.hpp"
+#include "SVCEncoder.hpp"
+
+struct AutotuneOptions {
+    std::string url;                    // input to calibrate on, only the first frames of it are used
+    int frames;                         // video frames per calibration pass
+    double p99BoundMs;                  // > 0: fastest tuning whose p99 decoded -> dispatched latency stays below, <= 0: fastest
+    int rounds;                         // passes over all knobs, a round without improvement ends the search early
+    int temporalNum;
+    std::vector<SpatialData> spatials;  // the layer layout to tune for
+};
+
+using AutotuneOptions = struct AutotuneOptions;
+
+/* Coordinate descent over queue capacity, h264 decoder threads, encoder threads, encoder
+ * complexity, slices and pipeline mode: one knob at a time is swept with the others fixed,
+ * every candidate runs a full SVCProj session (no dumps) over the first frames of the input.
+ * A candidate has to beat the best one by a few percent to replace it, runs are noisy.
+ * Quality is not measured, only speed: complexity goes as low as the target lets it.
+ */
+class Autotuner {
+public:
+    Autotuner(const AutotuneOptions &options);
+
+    ~Autotuner();
+
+    // RETURN: 0 if at least one pass succeeded, best holds the winner then
+    int run(SVCTuning &best, FILE *out);
+
+private:
+    struct PassResult {
+        bool ok;
+        uint64_t frames;        // dispatched
+        double fps;
+        double p99Ms;
+    };
+
+    PassResult measure(const SVCTuning &tuning);
+
+    bool better(const PassResult &candidate, const PassResult &best);
+
+    void printPass(FILE *out, const SVCTuning &tuning, const PassResult &result, bool best);
+
+private:
+    AutotuneOptions options_;
+    int passes_;
+};
+
+#endif /* Autotuner_hpp */
@@ -0,0 +1,238 @@
+//
+//  BufferPool.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <stdlib.h>
+#include <algorithm>
+#include "BufferPool.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+#define BUFFER_POOL_ALIGNMENT   64          // cache line, also enough for any SIMD load
+#define BUFFER_POOL_SMALL_STEP  256         // granularity of NAL sized blocks
+#define BUFFER_POOL_LARGE_STEP  4096        // granularity of picture sized blocks
+#define BUFFER_POOL_MAP_MIN     (64 << 10)  // placement only applies to blocks from here up
+#define BUFFER_POOL_HUGE_PAGE   (2 << 20)   // huge pages only back blocks from here up, a smaller one would waste the rest
+#define BUFFER_POOL_MPOL_PREFERRED  1       // numaif.h, not every toolchain ships it
+
+MediaBuffer::MediaBuffer(unsigned char *data, size_t capacity, BufferPoolShr pool): size_(capacity), capacity_(capacity), data_(data), pool_(pool) {}
+
+MediaBuffer::~MediaBuffer() {
+    pool_->recycle(data_, capacity_);
+    data_ = NULL;
+}
+
+unsigned char *MediaBuffer::data() {
+    return data_;
+}
+
+size_t MediaBuffer::size() {
+    return size_;
+}
+
+size_t MediaBuffer::capacity() {
+    return capacity_;
+}
+
+void MediaBuffer::setSize(size_t size) {
+    size_ = std::min(size, capacity_);
+}
+
+BufferPoolShr BufferPool::create(size_t maxIdleBytes) {
+    return BufferPoolShr(new BufferPool(maxIdleBytes));
+}
+
+BufferPool::BufferPool(size_t maxIdleBytes): numaNode_(-1), hugePages_(HUGE_PAGE_NONE), mappedBytes_(0), idleBytes_(0), maxIdleBytes_(maxIdleBytes), outstandingBytes_(0) {}
+
+BufferPool::~BufferPool() {
+    trim();
+}
+
+MediaBufferShr BufferPool::acquire(size_t size) {
+    unsigned char *data = NULL;
+    auto capacity = roundCapacity(size);
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        auto it = idle_.lower_bound(capacity);
+        if (it != idle_.end() && it->first <= capacity * 2) {   // do not burn a frame sized block on a tiny NAL
+            capacity = it->first;
+            data = it->second.back();
+            it->second.pop_back();
+            if (it->second.empty()) {
+                idle_.erase(it);
+            }
+
+            idleBytes_ -= capacity;
+        }
+
+        outstandingBytes_ += capacity;
+    }
+
+    if (!data) {
+        auto asked = capacity;
+        data = allocate(capacity);
+        std::unique_lock<std::mutex> locker(mutex_);
+        outstandingBytes_ -= asked;
+        if (!data) {
+            return nullptr;
+        }
+        outstandingBytes_ += capacity;  // the whole mapping is charged, the budgets see the capacity too
+    }
+
+    auto buffer = std::make_shared<MediaBuffer>(data, capacity, shared_from_this());
+    buffer->setSize(size);
+    return buffer;
+}
+
+void BufferPool::recycle(unsigned char *data, size_t capacity) {
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        outstandingBytes_ -= capacity;
+        if (idleBytes_ + capacity <= maxIdleBytes_) {
+            idle_[capacity].push_back(data);
+            idleBytes_ += capacity;
+            return;
+        }
+    }
+
+    release(data, capacity);
+}
+
+void BufferPool::trim() {
+    std::map<size_t, std::vector<unsigned char *>> idle;
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        idle.swap(idle_);
+        idleBytes_ = 0;
+    }
+
+    for (auto it = idle.begin(); it != idle.end(); it++) {
+        for (auto data : it->second) {
+            release(data, it->first);
+        }
+    }
+}
+
+size_t BufferPool::idleBytes() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return idleBytes_;
+}
+
+size_t BufferPool::outstandingBytes() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return outstandingBytes_;
+}
+
+size_t BufferPool::roundCapacity(size_t size) {
+    auto step = size < BUFFER_POOL_LARGE_STEP * 16 ? BUFFER_POOL_SMALL_STEP : BUFFER_POOL_LARGE_STEP;
+    return std::max((size + step - 1) / step * step, (size_t)BUFFER_POOL_SMALL_STEP);
+}
+
+void BufferPool::setPlacement(int numaNode, HugePageMode hugePages) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    numaNode_ = numaNode;
+    hugePages_ = hugePages;
+}
+
+void BufferPool::report(const std::string &tag) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    av_log(NULL, AV_LOG_INFO, "BufferPool[%s]: numa node = %d, huge pages = %d, outstanding = %zu, idle = %zu, mapped = %zu bytes\n",
+           tag.c_str(), numaNode_, hugePages_, outstandingBytes_, idleBytes_, mappedBytes_);
+}
+
+unsigned char *BufferPool::allocate(size_t &capacity) {
+#if defined(__linux__)
+    int numaNode;
+    HugePageMode hugePages;
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        numaNode = numaNode_;
+        hugePages = hugePages_;
+    }
+
+    if (capacity >= BUFFER_POOL_MAP_MIN && (numaNode >= 0 || hugePages != HUGE_PAGE_NONE)) {
+        auto length = capacity;
+        void *data = MAP_FAILED;
+        if (capacity < BUFFER_POOL_HUGE_PAGE) {     // NAL sized: numa binding only, 4KB pages
+            hugePages = HUGE_PAGE_NONE;
+        } else if (hugePages != HUGE_PAGE_NONE) {
+            length = (capacity + BUFFER_POOL_HUGE_PAGE - 1) / BUFFER_POOL_HUGE_PAGE * BUFFER_POOL_HUGE_PAGE;
+        }
+
+        if (numaNode < 0 && hugePages == HUGE_PAGE_NONE) {
+            void *block = NULL;
+            return posix_memalign(&block, BUFFER_POOL_ALIGNMENT, capacity) ? NULL : static_cast<unsigned char *>(block);
+        }
+
+#if defined(MAP_HUGETLB)
+        if (hugePages == HUGE_PAGE_EXPLICIT) {
+            data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+        if (data == MAP_FAILED) {   // no explicit huge pages asked for, or the reserved pool ran dry
+            data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+            if (data != MAP_FAILED && hugePages != HUGE_PAGE_NONE) {
+                madvise(data, length, MADV_HUGEPAGE);
+            }
+#endif
+        }
+
+        if (data == MAP_FAILED) {
+            return NULL;
+        }
+
+#if defined(SYS_mbind)
+        if (numaNode >= 0 && numaNode < 64) {  // before the first touch, so pages are faulted in on that node
+            unsigned long nodeMask = 1UL << numaNode;
+            syscall(SYS_mbind, data, length, BUFFER_POOL_MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8, 0);
+        }
+#endif
+
+        std::unique_lock<std::mutex> locker(mutex_);
+        mapped_.insert(static_cast<unsigned char *>(data));
+        mappedBytes_ += length;
+        capacity = length;  // idle, outstanding and queue budgets count what is mapped
+        return static_cast<unsigned char *>(data);
+    }
+#endif
+
+    void *data = NULL;
+    if (posix_memalign(&data, BUFFER_POOL_ALIGNMENT, capacity)) {
+        return NULL;
+    }
+
+    return static_cast<unsigned char *>(data);
+}
+
+void BufferPool::release(unsigned char *data, size_t capacity) {
+#if defined(__linux__)
+    bool mapped = false;
+    {
+        std::unique_lock<std::mutex> locker(mutex_);
+        if (mapped_.erase(data)) {
+            mappedBytes_ -= capacity;
+            mapped = true;
+        }
+    }
+
+    if (mapped) {
+        munmap(data, capacity);
+        return;
+    }
+#endif
+
+    free(data);
+}
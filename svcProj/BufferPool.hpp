@@ -0,0 +1,106 @@
+//
+//  BufferPool.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef BufferPool_hpp
+#define BufferPool_hpp
+
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include "ThreadPlacement.hpp"
+
+class BufferPool;
+using BufferPoolShr = std::shared_ptr<BufferPool>;
+
+/* An owning byte buffer handed out by a BufferPool.
+ * The storage goes back to the pool when the last reference is dropped,
+ * the pool itself stays alive until its last buffer is gone.
+ */
+class MediaBuffer {
+public:
+    MediaBuffer(unsigned char *data, size_t capacity, BufferPoolShr pool);
+
+    ~MediaBuffer();
+
+    unsigned char *data();
+
+    size_t size();
+
+    size_t capacity();
+
+    void setSize(size_t size);
+
+private:
+    MediaBuffer(const MediaBuffer &) = delete;
+
+    MediaBuffer &operator=(const MediaBuffer &) = delete;
+
+private:
+    size_t size_;
+    size_t capacity_;
+    unsigned char *data_;
+    BufferPoolShr pool_;
+};
+
+using MediaBufferShr = std::shared_ptr<MediaBuffer>;
+
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+public:
+    /* maxIdleBytes: how many bytes of released buffers may be kept for reuse,
+     * anything above that is returned to the system right away.
+     */
+    static BufferPoolShr create(size_t maxIdleBytes);
+
+    ~BufferPool();
+
+    // RETURN: a buffer with at least size bytes whose size() is size, NULL if out of memory
+    MediaBufferShr acquire(size_t size);
+
+    void trim();        // free every idle block
+
+    size_t idleBytes();
+
+    size_t outstandingBytes();
+
+    /* numaNode: node the large blocks are bound to (preferred), -1 for no binding
+     * hugePages: page kind of the large blocks
+     * only takes effect for blocks allocated afterwards, call it before the pool is used
+     */
+    void setPlacement(int numaNode, HugePageMode hugePages);
+
+    void report(const std::string &tag);
+
+private:
+    BufferPool(size_t maxIdleBytes);
+
+    friend class MediaBuffer;
+
+    void recycle(unsigned char *data, size_t capacity);
+
+    static size_t roundCapacity(size_t size);
+
+    // capacity: in what was asked for, out what the block really spans (a huge page mapping is rounded up)
+    unsigned char *allocate(size_t &capacity);
+
+    void release(unsigned char *data, size_t capacity);
+
+private:
+    std::mutex mutex_;
+    int numaNode_;
+    HugePageMode hugePages_;
+    size_t mappedBytes_;                                    // large blocks that went through mmap
+    std::unordered_set<unsigned char *> mapped_;            // blocks from mmap, their capacity is the mapped length
+    size_t idleBytes_;                                      // bytes parked in idle_
+    size_t maxIdleBytes_;                                   // upper bound of idleBytes_
+    size_t outstandingBytes_;                               // bytes owned by live MediaBuffers
+    std::map<size_t, std::vector<unsigned char *>> idle_;   // capacity -> released blocks
+};
+
+#endif /* BufferPool_hpp */
@@ -0,0 +1,266 @@
+//
+//  CodecPool.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include "CodecPool.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+CodecPool &CodecPool::shared() {
+    static CodecPool pool;
+    return pool;
+}
+
+CodecPool::CodecPool(): capacity_(CODEC_POOL_DEFAULT_CAPACITY) {
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+CodecPool::~CodecPool() {
+    clear();
+}
+
+std::string CodecPool::encoderKey(const SEncParamExt &param) {
+    char text[128];
+    snprintf(text, sizeof(text), "enc %dx%d T%d S%d usage %d rc %d fps %.2f idr %u threads %d complexity %d",
+             param.iPicWidth, param.iPicHeight, param.iTemporalLayerNum, param.iSpatialLayerNum, param.iUsageType,
+             param.iRCMode, param.fMaxFrameRate, param.uiIntraPeriod, param.iMultipleThreadIdc, param.iComplexityMode);
+    std::string key = text;
+    for (auto i = 0; i < param.iSpatialLayerNum && i < MAX_SPATIAL_LAYER_NUM; i++) {
+        auto &layer = param.sSpatialLayers[i];
+        snprintf(text, sizeof(text), " | %dx%d %.2f %d/%d slices %d:%u", layer.iVideoWidth, layer.iVideoHeight, layer.fFrameRate,
+                 layer.iSpatialBitrate, layer.iMaxSpatialBitrate, layer.sSliceArgument.uiSliceMode, layer.sSliceArgument.uiSliceNum);
+        key.append(text);
+    }
+
+    return key;
+}
+
+std::string CodecPool::decoderKey(const SDecodingParam &param) {
+    char text[96];
+    snprintf(text, sizeof(text), "dec dq %u ec %d bs %d parse %d", param.uiTargetDqLayer, param.eEcActiveIdc,
+             param.sVideoProperty.eVideoBsType, param.bParseOnly);
+    return text;
+}
+
+ISVCEncoder *CodecPool::createEncoder(const SEncParamExt &param) {
+    ISVCEncoder *encoder = NULL;
+    if (WelsCreateSVCEncoder(&encoder) != cmResultSuccess || !encoder) {
+        return NULL;
+    }
+
+    if (encoder->InitializeExt(&param) != 0) {
+        WelsDestroySVCEncoder(encoder);
+        return NULL;
+    }
+
+    return encoder;
+}
+
+ISVCDecoder *CodecPool::createDecoder(const SDecodingParam &param) {
+    ISVCDecoder *decoder = NULL;
+    if (WelsCreateDecoder(&decoder) != cmResultSuccess || !decoder) {
+        return NULL;
+    }
+
+    auto decParam = param;
+    if (decoder->Initialize(&decParam) != 0) {
+        WelsDestroyDecoder(decoder);
+        return NULL;
+    }
+
+    return decoder;
+}
+
+void CodecPool::destroyEncoder(ISVCEncoder *encoder) {
+    encoder->Uninitialize();
+    WelsDestroySVCEncoder(encoder);
+}
+
+void CodecPool::destroyDecoder(ISVCDecoder *decoder) {
+    decoder->Uninitialize();
+    WelsDestroyDecoder(decoder);
+}
+
+void CodecPool::evict(IdleCodecs &victims) {
+    while (idle_.size() > capacity_) {
+        victims.splice(victims.end(), idle_, std::prev(idle_.end()));
+        stats_.evictions++;
+    }
+}
+
+void CodecPool::release(IdleCodecs &victims) {
+    for (auto it = victims.begin(); it != victims.end(); it++) {
+        if (it->encoder) {
+            destroyEncoder(it->encoder);
+        }
+        if (it->decoder) {
+            destroyDecoder(it->decoder);
+        }
+    }
+    victims.clear();
+}
+
+void CodecPool::putIdle(IdleCodec &&codec) {
+    IdleCodecs victims;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        idle_.push_front(std::move(codec));
+        evict(victims);
+    }
+
+    release(victims);
+}
+
+void CodecPool::setCapacity(size_t capacity) {
+    IdleCodecs victims;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        capacity_ = capacity;
+        evict(victims);
+    }
+
+    release(victims);
+}
+
+ISVCEncoder *CodecPool::takeIdleEncoder(const std::string &key) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    for (auto it = idle_.begin(); it != idle_.end(); it++) {
+        if (it->encoder && it->key == key) {
+            auto encoder = it->encoder;
+            idle_.erase(it);
+            stats_.encoderHits++;
+            return encoder;
+        }
+    }
+
+    stats_.encoderMisses++;
+    return NULL;
+}
+
+ISVCDecoder *CodecPool::takeIdleDecoder(const std::string &key) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    for (auto it = idle_.begin(); it != idle_.end(); it++) {
+        if (it->decoder && it->key == key) {
+            auto decoder = it->decoder;
+            idle_.erase(it);
+            stats_.decoderHits++;
+            return decoder;
+        }
+    }
+
+    stats_.decoderMisses++;
+    return NULL;
+}
+
+ISVCEncoder *CodecPool::takeEncoder(const SEncParamExt &param) {
+    auto encoder = takeIdleEncoder(encoderKey(param));
+    if (!encoder) {
+        return createEncoder(param);
+    }
+
+    encoder->ForceIntraFrame(true);     // a new stream, nothing may refer to the last one
+    return encoder;
+}
+
+void CodecPool::giveEncoder(ISVCEncoder *encoder, const SEncParamExt &param) {
+    if (!encoder) {
+        return;
+    }
+
+    // bitrate / frame rate changes of the last session go, the rate control starts over
+    auto encParam = param;
+    if (encoder->SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &encParam) != 0) {
+        av_log(NULL, AV_LOG_WARNING, "CodecPool: an encoder could not be reset, destroyed\n");
+        destroyEncoder(encoder);
+        std::lock_guard<std::mutex> locker(mutex_);
+        stats_.evictions++;
+        return;
+    }
+
+    putIdle({encoderKey(param), encoder, NULL});
+}
+
+ISVCDecoder *CodecPool::takeDecoder(const SDecodingParam &param) {
+    auto decoder = takeIdleDecoder(decoderKey(param));
+    return decoder ? decoder : createDecoder(param);
+}
+
+void CodecPool::giveDecoder(ISVCDecoder *decoder, const SDecodingParam &param) {
+    if (!decoder) {
+        return;
+    }
+
+    // pictures held back for reordering belong to the last stream, its references are replaced by the next IDR
+    auto remaining = 0;
+    decoder->GetOption(DECODER_OPTION_NUM_OF_FRAMES_REMAINING_IN_BUFFER, &remaining);
+    for (; remaining > 0; remaining--) {
+        unsigned char *dst[3] = {NULL, NULL, NULL};
+        SBufferInfo info;
+        memset(&info, 0, sizeof(SBufferInfo));
+        decoder->FlushFrame(dst, &info);
+    }
+
+    putIdle({decoderKey(param), NULL, decoder});
+}
+
+void CodecPool::prewarmEncoders(const SEncParamExt &param, int count) {
+    for (auto i = 0; i < count; i++) {
+        auto encoder = createEncoder(param);
+        if (!encoder) {
+            av_log(NULL, AV_LOG_ERROR, "CodecPool: prewarming encoders failed\n");
+            return;
+        }
+        putIdle({encoderKey(param), encoder, NULL});
+    }
+}
+
+void CodecPool::prewarmDecoders(const SDecodingParam &param, int count) {
+    for (auto i = 0; i < count; i++) {
+        auto decoder = createDecoder(param);
+        if (!decoder) {
+            av_log(NULL, AV_LOG_ERROR, "CodecPool: prewarming decoders failed\n");
+            return;
+        }
+        putIdle({decoderKey(param), NULL, decoder});
+    }
+}
+
+CodecPoolStats CodecPool::stats() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto stats = stats_;
+    stats.idleEncoders = 0;
+    stats.idleDecoders = 0;
+    for (auto it = idle_.begin(); it != idle_.end(); it++) {
+        stats.idleEncoders += it->encoder ? 1 : 0;
+        stats.idleDecoders += it->decoder ? 1 : 0;
+    }
+    stats.capacity = capacity_;
+    return stats;
+}
+
+void CodecPool::report() {
+    auto current = stats();
+    auto encoderTakes = current.encoderHits + current.encoderMisses;
+    auto decoderTakes = current.decoderHits + current.decoderMisses;
+    av_log(NULL, AV_LOG_INFO, "CodecPool: encoders %llu/%llu hits (%.0f%%), decoders %llu/%llu hits (%.0f%%), idle %zu + %zu of %zu, %llu evicted\n",
+           (unsigned long long)current.encoderHits, (unsigned long long)encoderTakes, encoderTakes ? 100.0 * current.encoderHits / encoderTakes : 0.0,
+           (unsigned long long)current.decoderHits, (unsigned long long)decoderTakes, decoderTakes ? 100.0 * current.decoderHits / decoderTakes : 0.0,
+           current.idleEncoders, current.idleDecoders, current.capacity, (unsigned long long)current.evictions);
+}
+
+void CodecPool::clear() {
+    IdleCodecs victims;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        victims.swap(idle_);
+    }
+
+    release(victims);
+}
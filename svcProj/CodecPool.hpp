@@ -0,0 +1,121 @@
+//
+//  CodecPool.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef CodecPool_hpp
+#define CodecPool_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include "svc/codec_api.h"
+
+#define CODEC_POOL_DEFAULT_CAPACITY 32  // idle encoders + decoders kept, a default session uses 1 + 16
+
+struct CodecPoolStats {
+    uint64_t encoderHits;       // takes served by an idle instance
+    uint64_t encoderMisses;     // takes that created and initialized one
+    uint64_t decoderHits;
+    uint64_t decoderMisses;
+    uint64_t evictions;         // idle instances destroyed to make room or because they could not be reset
+    size_t idleEncoders;
+    size_t idleDecoders;
+    size_t capacity;
+};
+
+using CodecPoolStats = struct CodecPoolStats;
+
+/* Process wide pool of initialized OpenH264 encoders and decoders, keyed by their configuration
+ * (resolution layout, layer counts, threads / complexity / slices, decoding params). Sessions take
+ * instances instead of WelsCreate* + Initialize* and give them back instead of destroying them:
+ * an encoder gets its parameters back and starts its next stream with an IDR, a decoder is
+ * flushed and picks the next stream up at its first IDR. The least recently returned idle
+ * instance is destroyed once more than capacity are idle.
+ */
+class CodecPool {
+public:
+    static CodecPool &shared();
+
+    ~CodecPool();
+
+    // idle instances kept over all configurations, 0 turns pooling off and destroys the idle ones
+    void setCapacity(size_t capacity);
+
+    // RETURN: an encoder initialized with param, NULL if it could not be created
+    ISVCEncoder *takeEncoder(const SEncParamExt &param);
+
+    // param: the one it was taken with
+    void giveEncoder(ISVCEncoder *encoder, const SEncParamExt &param);
+
+    /* the key has no resolution: a reused decoder may come from a stream of another size, it relies on
+     * the SPS/PPS of the next IDR to reconfigure itself (every session feeds a decoder from an IDR on)
+     * RETURN: a decoder initialized with param, NULL if it could not be created
+     */
+    ISVCDecoder *takeDecoder(const SDecodingParam &param);
+
+    void giveDecoder(ISVCDecoder *decoder, const SDecodingParam &param);
+
+    /* create count idle instances up front so that the first sessions hit too, capacity permitting
+     * for long-running hosts, a one-shot process pays for them without ever reusing them
+     */
+    void prewarmEncoders(const SEncParamExt &param, int count);
+
+    void prewarmDecoders(const SDecodingParam &param, int count);
+
+    CodecPoolStats stats();
+
+    void report();
+
+    // destroy every idle instance
+    void clear();
+
+private:
+    CodecPool();
+
+    // one of encoder / decoder is set
+    struct IdleCodec {
+        std::string key;
+        ISVCEncoder *encoder;
+        ISVCDecoder *decoder;
+    };
+
+    using IdleCodecs = std::list<IdleCodec>;
+
+    static std::string encoderKey(const SEncParamExt &param);
+
+    static std::string decoderKey(const SDecodingParam &param);
+
+    static ISVCEncoder *createEncoder(const SEncParamExt &param);
+
+    static ISVCDecoder *createDecoder(const SDecodingParam &param);
+
+    static void destroyEncoder(ISVCEncoder *encoder);
+
+    static void destroyDecoder(ISVCDecoder *decoder);
+
+    // mutex held: move the least recently returned idle instances to victims until at most capacity are idle
+    void evict(IdleCodecs &victims);
+
+    // destroy outside the lock, OpenH264 teardown frees whole frame stores
+    static void release(IdleCodecs &victims);
+
+    // RETURN: the most recently returned idle instance of key, NULL if there is none
+    ISVCEncoder *takeIdleEncoder(const std::string &key);
+
+    ISVCDecoder *takeIdleDecoder(const std::string &key);
+
+    void putIdle(IdleCodec &&codec);
+
+private:
+    std::mutex mutex_;
+    size_t capacity_;
+    IdleCodecs idle_;                       // most recently returned first
+    CodecPoolStats stats_;
+};
+
+#endif /* CodecPool_hpp */
@@ -0,0 +1,149 @@
+//
+//  FrameChangeDetector.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "FrameChangeDetector.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CHANGE_DETECTOR_NEON 1
+#endif
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+static const ChangeDetectionSettings kDefaultChangeDetectionSettings = {
+    CHANGE_DETECTOR_BLOCK * CHANGE_DETECTOR_BLOCK * 2,  // tolerate a mean difference of 2 (decoder noise)
+    0,                                                  // any changed block counts
+    1,                                                  // every block, a sparser grid misses changes between its blocks
+    250,                                                // 10s at 25fps
+};
+
+FrameChangeDetector::FrameChangeDetector(const ChangeDetectionSettings &settings): settings_(settings), width_(0), height_(0), run_(0) {
+    settings_.sampleStep = std::max(settings_.sampleStep, 1);
+    settings_.changedBlocks = std::max(settings_.changedBlocks, 0);
+    memset(&stats_, 0, sizeof(ChangeDetectionStats));
+}
+
+FrameChangeDetector::~FrameChangeDetector() {}
+
+const ChangeDetectionSettings &FrameChangeDetector::defaultSettings() {
+    return kDefaultChangeDetectionSettings;
+}
+
+int FrameChangeDetector::blockSad(const unsigned char *a, int strideA, const unsigned char *b, int strideB) {
+#if defined(__SSE2__)
+    auto sum = _mm_setzero_si128();
+    for (auto row = 0; row < CHANGE_DETECTOR_BLOCK; row++) {
+        auto va = _mm_loadu_si128((const __m128i *)(a + row * strideA));
+        auto vb = _mm_loadu_si128((const __m128i *)(b + row * strideB));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));  // two partial sums, one per 8 bytes
+    }
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#elif defined(CHANGE_DETECTOR_NEON)
+    auto sum = vdupq_n_u16(0);
+    for (auto row = 0; row < CHANGE_DETECTOR_BLOCK; row++) {
+        sum = vpadalq_u8(sum, vabdq_u8(vld1q_u8(a + row * strideA), vld1q_u8(b + row * strideB)));
+    }
+    return vaddlvq_u16(sum);
+#else
+    auto sum = 0;
+    for (auto row = 0; row < CHANGE_DETECTOR_BLOCK; row++) {
+        for (auto col = 0; col < CHANGE_DETECTOR_BLOCK; col++) {
+            sum += abs(a[row * strideA + col] - b[row * strideB + col]);
+        }
+    }
+    return sum;
+#endif
+}
+
+bool FrameChangeDetector::changed(const unsigned char *luma, int stride, int width, int height) {
+    stats_.frames++;
+    if (!luma || width < CHANGE_DETECTOR_BLOCK || height < CHANGE_DETECTOR_BLOCK || settings_.maxSkips <= 0) {
+        return true;
+    }
+
+    if (width != width_ || height != height_) { // first frame or new size: sample grid and reference start over
+        width_ = width;
+        height_ = height;
+        blockX_.clear();
+        blockY_.clear();
+        // the last block of a row/column is pulled back to cover the edge
+        for (auto x = 0; x < width; x += CHANGE_DETECTOR_BLOCK * settings_.sampleStep) {
+            blockX_.push_back(std::min(x, width - CHANGE_DETECTOR_BLOCK));
+        }
+        for (auto y = 0; y < height; y += CHANGE_DETECTOR_BLOCK * settings_.sampleStep) {
+            blockY_.push_back(std::min(y, height - CHANGE_DETECTOR_BLOCK));
+        }
+
+        reference_.resize(blockX_.size() * blockY_.size() * CHANGE_DETECTOR_BLOCK * CHANGE_DETECTOR_BLOCK);
+        updateReference(luma, stride);
+        run_ = 0;
+        return true;
+    }
+
+    auto changedBlocks = 0;
+    auto ref = reference_.data();
+    for (size_t by = 0; by < blockY_.size() && changedBlocks <= settings_.changedBlocks; by++) {
+        auto rowBase = luma + (size_t)blockY_[by] * stride;
+        for (size_t bx = 0; bx < blockX_.size(); bx++, ref += CHANGE_DETECTOR_BLOCK * CHANGE_DETECTOR_BLOCK) {
+            if (blockSad(rowBase + blockX_[bx], stride, ref, CHANGE_DETECTOR_BLOCK) > settings_.blockSad
+                && ++changedBlocks > settings_.changedBlocks) {
+                break;  // changed, the rest does not matter
+            }
+        }
+    }
+
+    if (changedBlocks <= settings_.changedBlocks) {
+        if (run_ < (uint64_t)settings_.maxSkips) {
+            run_++;
+            stats_.skipped++;
+            stats_.longestRun = std::max(stats_.longestRun, run_);
+            return false;
+        }
+
+        stats_.forced++;    // keep the stream alive, reference stays what it was
+        run_ = 0;
+        return true;
+    }
+
+    updateReference(luma, stride);
+    run_ = 0;
+    return true;
+}
+
+void FrameChangeDetector::updateReference(const unsigned char *luma, int stride) {
+    auto ref = reference_.data();
+    for (size_t by = 0; by < blockY_.size(); by++) {
+        for (size_t bx = 0; bx < blockX_.size(); bx++) {
+            auto src = luma + (size_t)blockY_[by] * stride + blockX_[bx];
+            for (auto row = 0; row < CHANGE_DETECTOR_BLOCK; row++, ref += CHANGE_DETECTOR_BLOCK) {
+                memcpy(ref, src + (size_t)row * stride, CHANGE_DETECTOR_BLOCK);
+            }
+        }
+    }
+}
+
+const ChangeDetectionStats &FrameChangeDetector::stats() {
+    return stats_;
+}
+
+const ChangeDetectionSettings &FrameChangeDetector::settings() {
+    return settings_;
+}
+
+void FrameChangeDetector::report() {
+    av_log(NULL, AV_LOG_INFO, "FrameChangeDetector: frames = %llu, skipped = %llu (%.1f%%), longest run = %llu, forced = %llu\n",
+           (unsigned long long)stats_.frames, (unsigned long long)stats_.skipped, stats_.frames ? 100.0 * stats_.skipped / stats_.frames : 0.0,
+           (unsigned long long)stats_.longestRun, (unsigned long long)stats_.forced);
+}
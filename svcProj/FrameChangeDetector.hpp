@@ -0,0 +1,74 @@
+//
+//  FrameChangeDetector.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef FrameChangeDetector_hpp
+#define FrameChangeDetector_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define CHANGE_DETECTOR_BLOCK   16      // blocks are 16x16 luma samples
+
+struct ChangeDetectionSettings {
+    int blockSad;           // a block changed if its SAD against the reference exceeds this (16 * 16 * 2: mean diff of 2)
+    int changedBlocks;      // a frame changed if more than this many blocks changed
+    int sampleStep;         // compare every sampleStep-th block in both directions, 1 compares all of them. Above 1 a change
+                            // that fits between the sampled blocks (a cursor, a clock) is only encoded after maxSkips
+    int maxSkips;           // encode at least every maxSkips + 1 frames even if nothing changed, 0 never skips
+};
+
+struct ChangeDetectionStats {
+    uint64_t frames;        // frames checked
+    uint64_t skipped;       // frames found unchanged
+    uint64_t longestRun;    // longest run of skipped frames
+    uint64_t forced;        // unchanged frames passed because of maxSkips
+};
+
+using ChangeDetectionSettings = struct ChangeDetectionSettings;
+using ChangeDetectionStats = struct ChangeDetectionStats;
+
+/* Tells static frames apart from changed ones by the SAD of sampled 16x16 luma blocks
+ * against the last frame that was let through (not the last one seen, so a slow fade
+ * still crosses the threshold eventually). Chroma only changes are not detected.
+ * Not thread safe, meant to sit on the h264 decoder thread.
+ */
+class FrameChangeDetector {
+public:
+    FrameChangeDetector(const ChangeDetectionSettings &settings);
+
+    ~FrameChangeDetector();
+
+    // RETURN: true if the frame has to be encoded, false if it may be skipped
+    bool changed(const unsigned char *luma, int stride, int width, int height);
+
+    const ChangeDetectionStats &stats();
+
+    const ChangeDetectionSettings &settings();
+
+    void report();
+
+    static const ChangeDetectionSettings &defaultSettings();
+
+    // sum of absolute differences of a 16x16 block
+    static int blockSad(const unsigned char *a, int strideA, const unsigned char *b, int strideB);
+
+private:
+    void updateReference(const unsigned char *luma, int stride);
+
+private:
+    ChangeDetectionSettings settings_;
+    ChangeDetectionStats stats_;
+    int width_;
+    int height_;
+    uint64_t run_;                              // current run of skipped frames
+    std::vector<int> blockX_;                   // left edge of every sampled block column
+    std::vector<int> blockY_;                   // top edge of every sampled block row
+    std::vector<unsigned char> reference_;      // sampled blocks of the last frame let through, 16x16 each
+};
+
+#endif /* FrameChangeDetector_hpp */
@@ -0,0 +1,77 @@
+//
+//  FrameHash.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include "FrameHash.hpp"
+
+FrameHash::FrameHash(): state_(XXH3_createState()) {
+    reset();
+}
+
+FrameHash::~FrameHash() {
+    XXH3_freeState(state_);
+}
+
+void FrameHash::reset() {
+    XXH3_64bits_reset(state_);
+}
+
+void FrameHash::update(const unsigned char *data, size_t len) {
+    XXH3_64bits_update(state_, data, len);
+}
+
+void FrameHash::update(const unsigned char *plane, int stride, int width, int height) {
+    if (!plane || width <= 0 || height <= 0) {
+        return;
+    }
+
+    if (stride == width) {  // no padding, one run
+        update(plane, (size_t)width * height);
+        return;
+    }
+
+    for (auto row = 0; row < height; row++) {
+        update(plane + (size_t)row * stride, width);
+    }
+}
+
+uint64_t FrameHash::digest() {
+    return XXH3_64bits_digest(state_);
+}
+
+uint64_t FrameHash::hashI420(unsigned char *const planes[3], const int strides[2], int width, int height) {
+    FrameHash hash;
+    hash.update(planes[0], strides[0], width, height);
+    hash.update(planes[1], strides[1], width >> 1, height >> 1);
+    hash.update(planes[2], strides[1], width >> 1, height >> 1);
+    return hash.digest();
+}
+
+uint64_t FrameHash::hash(const unsigned char *data, size_t len) {
+    return XXH3_64bits(data, len);  // one shot, no state to set up
+}
+
+const char *FrameHash::name() {
+    return FRAME_HASH_NAME;
+}
+
+const char *FrameHash::implementation() {
+#if XXH_VECTOR == XXH_AVX512
+    return "avx512";
+#elif XXH_VECTOR == XXH_AVX2
+    return "avx2";
+#elif XXH_VECTOR == XXH_SSE2
+    return "sse2";
+#elif XXH_VECTOR == XXH_NEON
+    return "neon";
+#elif XXH_VECTOR == XXH_SVE
+    return "sve";
+#elif XXH_VECTOR == XXH_VSX
+    return "vsx";
+#else
+    return "scalar";
+#endif
+}
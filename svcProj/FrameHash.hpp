@@ -0,0 +1,58 @@
+//
+//  FrameHash.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef FrameHash_hpp
+#define FrameHash_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#define XXH_INLINE_ALL      // header only: every xxHash function is static inline, nothing to link
+#include "xxhash.h"
+
+#define FRAME_HASH_NAME     "xxh3"  // bump it whenever the output changes, golden manifests become stale
+
+/* XXH3_64bits (seed 0) of the bytes fed in, streamed so that the rows of a padded plane need no copy.
+ * xxHash picks its SSE2/AVX2/NEON... code path at compile time, every path gives the same value on
+ * every machine. For regression checks, not for anything that has to resist an attacker.
+ */
+class FrameHash {
+public:
+    FrameHash();
+
+    ~FrameHash();
+
+    FrameHash(const FrameHash &) = delete;
+
+    FrameHash &operator=(const FrameHash &) = delete;
+
+    void reset();
+
+    void update(const unsigned char *data, size_t len);
+
+    // rows of width bytes that are stride bytes apart, the padding does not count
+    void update(const unsigned char *plane, int stride, int width, int height);
+
+    uint64_t digest();
+
+    // RETURN: Y then U then V of an I420 picture
+    static uint64_t hashI420(unsigned char *const planes[3], const int strides[2], int width, int height);
+
+    static uint64_t hash(const unsigned char *data, size_t len);
+
+    // RETURN: FRAME_HASH_NAME, what the manifests were hashed with
+    static const char *name();
+
+    // RETURN: the code path xxHash was built with, "sse2", "avx2", "neon", "scalar"...
+    static const char *implementation();
+
+private:
+    XXH3_state_t *state_;   // 64 byte aligned, XXH3_createState() takes care of it
+};
+
+#endif /* FrameHash_hpp */
@@ -7,11 +7,11 @@
 
 #include "H264Decoder.hpp"
 
-H264Decoder::H264Decoder(int maxSize): h264PacketQueue_(std::make_shared<SyncQueue<AVPacket>>(maxSize)), h264Decoder_(NULL), decoderInitialized_(false){}
+H264Decoder::H264Decoder(const SyncQueueLimits &limits): h264PacketQueue_(std::make_shared<SyncQueue<AVPacketShr>>(limits)), h264Decoder_(NULL), decoderInitialized_(false), interrupted_(false){}
 
 H264Decoder::~H264Decoder(){}
 
-int H264Decoder::initH264Decoder(AVStream *stream) {
+int H264Decoder::initH264Decoder(AVStream *stream, bool lowDelay, int threadCount, bool keyframesOnly) {
     if (!stream) {
         av_log(NULL, AV_LOG_ERROR, "please call open_input_url firstly OR this file has NO video stream\n");
         return -1;
@@ -30,12 +30,21 @@ int H264Decoder::initH264Decoder(AVStream *stream) {
     }
     
     auto ret = avcodec_parameters_to_context(h264Decoder_, stream->codecpar);
-    h264Decoder_->thread_count = 4;
+    h264Decoder_->thread_count = std::max(threadCount, 0);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "failed to copy parameters into context\n");
         return -4;
     }
     
+    if (lowDelay) { // frame threads hold thread_count frames back before the first one comes out
+        h264Decoder_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        h264Decoder_->thread_type = FF_THREAD_SLICE;
+    }
+    
+    if (keyframesOnly) {
+        h264Decoder_->skip_frame = AVDISCARD_NONKEY;
+    }
+    
     ret = avcodec_open2(h264Decoder_, decCodec, NULL);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Could not open video codec\n");
@@ -51,24 +60,33 @@ int H264Decoder::start(NotifySVCEncoderCB notifySVCEncoder) {
         return -1;
     }
     
+    finished_ = finishedPromise_.get_future().share();
     h264DecoderThread_ =
     std::make_shared<std::thread>([this] (NotifySVCEncoderCB notifySVCEncoder) {
-        AVPacket pkt;
+        AVPacketShr pkt;
         AVFrame *outFrame = av_frame_alloc();
         while (true) {
-            av_init_packet(&pkt);
+            pkt = nullptr;
             h264PacketQueue_->front(pkt);
-            if (pkt.data == NULL || pkt.size == 0) {
+            if (!pkt || pkt->data == NULL || pkt->size == 0) {
                 break;
             }
             
-            auto status = avcodec_send_packet(h264Decoder_, &pkt);
+            auto status = avcodec_send_packet(h264Decoder_, pkt.get());
             status = avcodec_receive_frame(h264Decoder_, outFrame);
             if (notifySVCEncoder) {
                 notifySVCEncoder(false, status, outFrame);
             }
             
-            av_packet_unref(&pkt);
+            pkt = nullptr;  // give the packet buffer back before blocking on the queue again
+        }
+        
+        if (!interrupted_ && avcodec_send_packet(h264Decoder_, NULL) >= 0) {  // drain what the decoder still holds
+            while (avcodec_receive_frame(h264Decoder_, outFrame) >= 0) {
+                if (notifySVCEncoder) {
+                    notifySVCEncoder(false, 0, outFrame);
+                }
+            }
         }
         
         if (notifySVCEncoder) {
@@ -83,17 +101,50 @@ int H264Decoder::start(NotifySVCEncoderCB notifySVCEncoder) {
             
             avcodec_free_context(&h264Decoder_);
         }
+        
+        finishedPromise_.set_value();
     }, notifySVCEncoder);
     
     return 0;
 }
 
-void H264Decoder::put(AVPacket &&pkt) {
+void H264Decoder::put(AVPacketShr &&pkt) {
     if (!h264PacketQueue_) {
         return;
     }
     
-    h264PacketQueue_->put(std::forward<AVPacket>(pkt));
+    h264PacketQueue_->put(std::forward<AVPacketShr>(pkt));
+}
+
+bool H264Decoder::put(AVPacketShr &&pkt, int timeoutMs) {
+    if (!h264PacketQueue_) {
+        return false;
+    }
+    
+    return h264PacketQueue_->putFor(std::forward<AVPacketShr>(pkt), timeoutMs);
+}
+
+bool H264Decoder::waitFinished(int timeoutMs) {
+    if (!finished_.valid()) {
+        return true;
+    }
+    
+    return finished_.wait_for(std::chrono::milliseconds(timeoutMs)) == std::future_status::ready;
+}
+
+H264DecoderThread &H264Decoder::thread() {
+    return h264DecoderThread_;
+}
+
+AVPacketShr H264Decoder::allocPacket() {
+    auto pkt = av_packet_alloc();
+    if (!pkt) {
+        return nullptr;
+    }
+    
+    return AVPacketShr(pkt, [](AVPacket *pkt) {
+        av_packet_free(&pkt);
+    });
 }
 
 void H264Decoder::stop() {
@@ -103,6 +154,7 @@ void H264Decoder::stop() {
 }
 
 void H264Decoder::interrupt() {
+    interrupted_ = true;
     if (h264PacketQueue_) {
         h264PacketQueue_->interrupt();
     }
@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <thread>
+#include <atomic>
+#include <future>
 #include <iostream>
 #include <functional>
 
@@ -21,26 +23,52 @@ extern "C"
     #include "libavformat/avformat.h"
 }
 
+using AVPacketShr = std::shared_ptr<AVPacket>;   // NULL means EOF
+
+template <>
+struct SyncQueueItemBytes<AVPacketShr> {
+    static size_t bytes(const AVPacketShr &pkt) {
+        return pkt ? sizeof(AVPacket) + pkt->size : 0;
+    }
+};
 using H264DecoderThread = std::shared_ptr<std::thread>;
-using H264PacketQueue = std::shared_ptr<SyncQueue<AVPacket>>;
+using H264PacketQueue = std::shared_ptr<SyncQueue<AVPacketShr>>;
 using NotifySVCEncoderCB= std::function<void (bool eof, int status, AVFrame *decodedFrame)>;
 
 class H264Decoder {
 public:
-    H264Decoder(int MaxSize);
+    H264Decoder(const SyncQueueLimits &limits);
     
     ~H264Decoder();
     
-    int initH264Decoder(AVStream *stream);
+    /* lowDelay: output every frame as soon as it is decoded (slice threads only, no frame reordering delay)
+     * threadCount: decoding threads, 0 lets ffmpeg pick one per core
+     * keyframesOnly: skip every non key frame (AVDISCARD_NONKEY), for previews
+     * RETURN: 0 if successful
+     */
+    int initH264Decoder(AVStream *stream, bool lowDelay = false, int threadCount = 4, bool keyframesOnly = false);
     
     int start(NotifySVCEncoderCB callback);
     
-    void put(AVPacket &&pkt);
+    // a NULL packet is EOF: the frames still held back by the decoder (reordering, frame threads) are flushed first
+    void put(AVPacketShr &&pkt);
+    
+    // put() waiting at most timeoutMs for room, RETURN: false if the packet was not queued
+    bool put(AVPacketShr &&pkt, int timeoutMs);
     
+    // EOF without flushing
     void interrupt();
     
+    // RETURN: true if the decoding thread has exited (or never started) within timeoutMs
+    bool waitFinished(int timeoutMs);
+    
     void stop();
     
+    H264DecoderThread &thread();
+    
+    // wrap av_packet_alloc() so the packet and its payload are released with the last reference
+    static AVPacketShr allocPacket();
+    
 private:
     bool decoderInitialized_;
     
@@ -49,5 +77,11 @@ private:
     H264PacketQueue h264PacketQueue_;
 
     H264DecoderThread h264DecoderThread_;
+    
+    std::atomic_bool interrupted_;
+    
+    std::promise<void> finishedPromise_;
+    
+    std::shared_future<void> finished_;
 };
 #endif /* H264Decoder_hpp */
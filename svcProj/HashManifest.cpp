@@ -0,0 +1,125 @@
+//
+//  HashManifest.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <inttypes.h>
+#include "HashManifest.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+HashManifest::HashManifest(const std::string &dir, const std::string &name, HashManifestMode mode): name_(name), mode_(mode), file_(NULL), closed_(false), count_(0), mismatches_(0), firstMismatch_(-1) {
+    path_ = dir;
+    if (!path_.empty() && path_.back() != '/') {
+        path_.append("/");
+    }
+    path_.append(name).append(".hash");
+}
+
+HashManifest::~HashManifest() {
+    close();
+}
+
+int HashManifest::open() {
+    if (mode_ == HASH_MANIFEST_RECORD) {
+        file_ = fopen(path_.c_str(), "w");
+        if (!file_) {
+            av_log(NULL, AV_LOG_ERROR, "HashManifest: can not create %s\n", path_.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+    if (mode_ != HASH_MANIFEST_VERIFY) {
+        return -1;
+    }
+
+    auto file = fopen(path_.c_str(), "r");
+    if (!file) {
+        av_log(NULL, AV_LOG_ERROR, "HashManifest: no golden manifest %s\n", path_.c_str());
+        return -2;
+    }
+
+    long long index = 0;
+    Record record;
+    while (fscanf(file, "%lld %lld %" SCNx64, &index, &record.timestamp, &record.hash) == 3) {
+        golden_.push_back(record);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+void HashManifest::add(long long timestamp, uint64_t hash) {
+    auto index = count_++;
+    if (mode_ == HASH_MANIFEST_RECORD) {
+        if (file_) {
+            fprintf(file_, "%lld %lld %016" PRIx64 "\n", index, timestamp, hash);
+        }
+        return;
+    }
+
+    if (mode_ != HASH_MANIFEST_VERIFY) {
+        return;
+    }
+
+    if (index >= (long long)golden_.size()) {
+        mismatch(index, "extra frame", timestamp, 0, hash);
+    } else if (golden_[index].hash != hash) {
+        mismatch(index, "hash differs", timestamp, golden_[index].hash, hash);
+    }
+}
+
+void HashManifest::mismatch(long long index, const char *reason, long long timestamp, uint64_t expected, uint64_t actual) {
+    if (mismatches_++ == 0) {   // the first one is what matters, the rest usually follows from it
+        firstMismatch_ = index;
+        av_log(NULL, AV_LOG_ERROR, "HashManifest[%s]: first mismatch at frame %lld (timestamp %lld): %s, expected %016" PRIx64 ", got %016" PRIx64 "\n",
+               name_.c_str(), index, timestamp, reason, expected, actual);
+    }
+}
+
+int HashManifest::close() {
+    if (closed_) {
+        return mismatches_ ? -1 : 0;
+    }
+
+    closed_ = true;
+    if (mode_ == HASH_MANIFEST_RECORD) {
+        if (file_) {
+            fclose(file_);
+            file_ = NULL;
+        }
+        av_log(NULL, AV_LOG_INFO, "HashManifest[%s]: recorded %lld frames into %s\n", name_.c_str(), count_, path_.c_str());
+        return 0;
+    }
+
+    if (mode_ != HASH_MANIFEST_VERIFY) {
+        return 0;
+    }
+
+    if (count_ < (long long)golden_.size()) {
+        mismatch(count_, "frame missing", golden_[count_].timestamp, golden_[count_].hash, 0);
+    }
+
+    if (mismatches_) {
+        av_log(NULL, AV_LOG_ERROR, "HashManifest[%s]: FAILED, %lld of %lld frames differ (golden has %zu)\n",
+               name_.c_str(), mismatches_, count_, golden_.size());
+        return -1;
+    }
+
+    av_log(NULL, AV_LOG_INFO, "HashManifest[%s]: %lld frames verified\n", name_.c_str(), count_);
+    return 0;
+}
+
+long long HashManifest::firstMismatch() {
+    return firstMismatch_;
+}
+
+const std::string &HashManifest::name() {
+    return name_;
+}
@@ -0,0 +1,70 @@
+//
+//  HashManifest.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef HashManifest_hpp
+#define HashManifest_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+enum HashManifestMode {
+    HASH_MANIFEST_NONE = 0,
+    HASH_MANIFEST_RECORD,       // write <dir>/<name>.hash, it becomes the golden manifest
+    HASH_MANIFEST_VERIFY,       // compare against <dir>/<name>.hash, nothing is written
+};
+
+class HashManifest;
+using HashManifestShr = std::shared_ptr<HashManifest>;
+
+/* Frame hashes of one layer, one "<index> <timestamp> <hash>" line per frame.
+ * add() is meant to be called from one thread (the stage that produces the layer).
+ */
+class HashManifest {
+public:
+    HashManifest(const std::string &dir, const std::string &name, HashManifestMode mode);
+
+    ~HashManifest();
+
+    // RETURN: 0 if the manifest could be created (record) or loaded (verify)
+    int open();
+
+    void add(long long timestamp, uint64_t hash);
+
+    /* record: flush the file. verify: frames missing at the end count as a mismatch
+     * RETURN: 0 if recorded, or verified without any mismatch
+     */
+    int close();
+
+    // verify: index of the first frame that differs, -1 if none so far
+    long long firstMismatch();
+
+    const std::string &name();
+
+private:
+    struct Record {
+        long long timestamp;
+        uint64_t hash;
+    };
+
+    void mismatch(long long index, const char *reason, long long timestamp, uint64_t expected, uint64_t actual);
+
+private:
+    std::string path_;
+    std::string name_;
+    HashManifestMode mode_;
+    FILE *file_;
+    bool closed_;
+    long long count_;               // frames added
+    long long mismatches_;
+    long long firstMismatch_;
+    std::vector<Record> golden_;
+};
+
+#endif /* HashManifest_hpp */
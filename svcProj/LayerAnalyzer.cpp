@@ -0,0 +1,194 @@
+//
+//  LayerAnalyzer.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "LayerAnalyzer.hpp"
+
+#define LAYER_ANALYZER_READ_CHUNK   (8 << 20)       // big sequential reads keep the scanner fed
+#define LAYER_ANALYZER_UNKNOWN_T    LAYER_ANALYZER_MAX_ID   // layers_ row of the access units without temporal id
+
+LayerAnalyzer::LayerAnalyzer(AccessUnitCB callback): auOpen_(false), auHasVCL_(false), lastDependencyId_(-1), accessUnits_(0), totalBytes_(0), nonVCLNals_(0), idrCount_(0), lastIdrIndex_(-1), minIdrSpacing_(0), maxIdrSpacing_(0), sumIdrSpacing_(0), minAuBytes_(0), maxAuBytes_(0), scanner_([this](const NalUnit &nal) { onNal(nal); }), callback_(callback) {
+    memset(&au_, 0, sizeof(AccessUnitInfo));
+    memset(layers_, 0, sizeof(layers_));
+}
+
+LayerAnalyzer::~LayerAnalyzer() {}
+
+void LayerAnalyzer::feed(const unsigned char *buf, size_t len) {
+    scanner_.feed(buf, len);
+}
+
+void LayerAnalyzer::finish() {
+    scanner_.finish();
+    closeAccessUnit();
+}
+
+void LayerAnalyzer::onNal(const NalUnit &nal) {
+    auto vcl = NalScanner::isVCL(nal.type);
+    auto dependencyId = std::min(nal.dependencyId, LAYER_ANALYZER_MAX_ID - 1);
+    if (auOpen_ && auHasVCL_) {
+        // anything that has to precede the first VCL NAL, or a new picture of a layer already seen, opens the next access unit
+        auto leading = nal.type == NAL_TYPE_AUD || nal.type == NAL_TYPE_SPS || nal.type == NAL_TYPE_PPS || nal.type == NAL_TYPE_SEI
+                    || nal.type == NAL_TYPE_PREFIX || nal.type == NAL_TYPE_SUBSET_SPS;
+        auto newPicture = vcl && nal.firstSliceOfPicture && dependencyId <= lastDependencyId_;
+        if (leading || newPicture) {
+            closeAccessUnit();
+        }
+    }
+
+    if (!auOpen_) {
+        memset(&au_, 0, sizeof(AccessUnitInfo));
+        au_.index = accessUnits_;
+        au_.offset = nal.offset;
+        au_.temporalId = -1;
+        au_.maxDependencyId = -1;
+        auOpen_ = true;
+        auHasVCL_ = false;
+        lastDependencyId_ = -1;
+    }
+
+    au_.size += nal.size;
+    au_.nalCount++;
+    au_.layerBytes[dependencyId] += nal.size;
+    au_.layerNals[dependencyId]++;
+    if (nal.svcExtension) {
+        au_.temporalId = std::min(nal.temporalId, LAYER_ANALYZER_MAX_ID - 1);
+    }
+
+    if (nal.idr) {
+        au_.idr = true;
+    }
+
+    if (vcl) {
+        auHasVCL_ = true;
+        lastDependencyId_ = dependencyId;
+        au_.maxDependencyId = std::max(au_.maxDependencyId, dependencyId);
+    } else {
+        nonVCLNals_++;
+    }
+
+    totalBytes_ += nal.size;
+}
+
+void LayerAnalyzer::closeAccessUnit() {
+    if (!auOpen_) {
+        return;
+    }
+
+    auOpen_ = false;
+    auto row = au_.temporalId < 0 ? LAYER_ANALYZER_UNKNOWN_T : au_.temporalId;
+    for (auto i = 0; i < LAYER_ANALYZER_MAX_ID; i++) {
+        if (au_.layerNals[i] == 0) {
+            continue;
+        }
+
+        auto &stats = layers_[row][i];
+        stats.minFrameBytes = stats.frames ? std::min(stats.minFrameBytes, au_.layerBytes[i]) : au_.layerBytes[i];
+        stats.maxFrameBytes = std::max(stats.maxFrameBytes, au_.layerBytes[i]);
+        stats.nalCount += au_.layerNals[i];
+        stats.bytes += au_.layerBytes[i];
+        stats.frames++;
+    }
+
+    minAuBytes_ = accessUnits_ ? std::min(minAuBytes_, au_.size) : au_.size;
+    maxAuBytes_ = std::max(maxAuBytes_, au_.size);
+    accessUnits_++;
+
+    if (au_.idr) {
+        if (lastIdrIndex_ >= 0) {
+            auto spacing = au_.index - lastIdrIndex_;
+            minIdrSpacing_ = sumIdrSpacing_ ? std::min(minIdrSpacing_, spacing) : spacing;
+            maxIdrSpacing_ = std::max(maxIdrSpacing_, spacing);
+            sumIdrSpacing_ += spacing;
+        }
+
+        lastIdrIndex_ = au_.index;
+        idrCount_++;
+    }
+
+    if (callback_) {
+        callback_(au_);
+    }
+}
+
+const LayerStats &LayerAnalyzer::layer(int temporalId, int spatialId) {
+    temporalId = temporalId < 0 ? LAYER_ANALYZER_UNKNOWN_T : std::min(temporalId, LAYER_ANALYZER_MAX_ID - 1);
+    spatialId = std::max(std::min(spatialId, LAYER_ANALYZER_MAX_ID - 1), 0);
+    return layers_[temporalId][spatialId];
+}
+
+uint64_t LayerAnalyzer::accessUnits() {
+    return accessUnits_;
+}
+
+uint64_t LayerAnalyzer::idrCount() {
+    return idrCount_;
+}
+
+void LayerAnalyzer::report(FILE *out, const std::string &title) {
+    fprintf(out, "== %s: %llu bytes, %llu access units, %llu non-VCL NALs, frame bytes min/avg/max %llu/%llu/%llu\n",
+            title.c_str(), (unsigned long long)totalBytes_, (unsigned long long)accessUnits_, (unsigned long long)nonVCLNals_,
+            (unsigned long long)minAuBytes_, (unsigned long long)(accessUnits_ ? totalBytes_ / accessUnits_ : 0), (unsigned long long)maxAuBytes_);
+
+    auto spacings = idrCount_ > 1 ? idrCount_ - 1 : 0;
+    fprintf(out, "   IDR: %llu, spacing min/avg/max %llu/%.1f/%llu\n", (unsigned long long)idrCount_, (unsigned long long)minIdrSpacing_,
+            spacings ? (double)sumIdrSpacing_ / spacings : 0.0, (unsigned long long)maxIdrSpacing_);
+
+    fprintf(out, "   %2s %2s %10s %14s %10s %10s %10s %10s\n", "T", "S", "NALs", "bytes", "frames", "min", "avg", "max");
+    for (auto t = 0; t <= LAYER_ANALYZER_UNKNOWN_T; t++) {
+        for (auto s = 0; s < LAYER_ANALYZER_MAX_ID; s++) {
+            auto &stats = layers_[t][s];
+            if (stats.frames == 0) {
+                continue;
+            }
+
+            auto temporal = t == LAYER_ANALYZER_UNKNOWN_T ? std::string("?") : std::to_string(t);   // no prefix NAL told it
+            fprintf(out, "   %2s %2d %10llu %14llu %10llu %10llu %10llu %10llu\n", temporal.c_str(), s, (unsigned long long)stats.nalCount,
+                    (unsigned long long)stats.bytes, (unsigned long long)stats.frames, (unsigned long long)stats.minFrameBytes,
+                    (unsigned long long)(stats.bytes / stats.frames), (unsigned long long)stats.maxFrameBytes);
+        }
+    }
+}
+
+int LayerAnalyzer::analyzeFile(const std::string &path, FILE *out) {
+    auto file = fopen(path.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "can not open %s\n", path.c_str());
+        return -1;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    setvbuf(file, NULL, _IONBF, 0);     // the chunk below is the only buffer
+    auto chunk = static_cast<unsigned char *>(malloc(LAYER_ANALYZER_READ_CHUNK));
+    if (!chunk) {
+        fclose(file);
+        return -2;
+    }
+
+    LayerAnalyzer analyzer;
+    while (true) {
+        auto got = fread(chunk, 1, LAYER_ANALYZER_READ_CHUNK, file);
+        if (got == 0) {
+            break;
+        }
+
+        analyzer.feed(chunk, got);
+    }
+
+    analyzer.finish();
+    analyzer.report(out, path);
+
+    free(chunk);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,92 @@
+//
+//  LayerAnalyzer.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef LayerAnalyzer_hpp
+#define LayerAnalyzer_hpp
+
+#include <stdio.h>
+#include <string>
+#include "NalScanner.hpp"
+
+#define LAYER_ANALYZER_MAX_ID   8           // temporal_id and dependency_id are 3 bits wide
+
+struct AccessUnitInfo {
+    uint64_t index;                                 // position in the stream, starting at 0
+    uint64_t offset;                                // first byte of the first NAL
+    uint64_t size;                                  // all NALs of this access unit
+    int nalCount;
+    int temporalId;                                 // -1 if no NAL carried one (no prefix NAL, a base layer only dump)
+    int maxDependencyId;                            // -1 if it has no VCL NAL
+    bool idr;
+    uint64_t layerBytes[LAYER_ANALYZER_MAX_ID];     // per dependency_id, parameter sets count for layer 0
+    int layerNals[LAYER_ANALYZER_MAX_ID];
+};
+
+struct LayerStats {
+    uint64_t nalCount;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t minFrameBytes;
+    uint64_t maxFrameBytes;
+};
+
+using AccessUnitInfo = struct AccessUnitInfo;
+using LayerStats = struct LayerStats;
+using AccessUnitCB = std::function<void (const AccessUnitInfo &au)>;
+
+/* Groups the NALs of an Annex-B stream into access units and keeps per (T,S) statistics.
+ * A NAL without svc extension belongs to the temporal layer of its access unit,
+ * an access unit without any svc extension is counted under temporal id unknown.
+ */
+class LayerAnalyzer {
+public:
+    LayerAnalyzer(AccessUnitCB callback = nullptr);
+
+    ~LayerAnalyzer();
+
+    void feed(const unsigned char *buf, size_t len);
+
+    void finish();
+
+    // temporalId: -1 for the access units whose temporal id is unknown
+    const LayerStats &layer(int temporalId, int spatialId);
+
+    uint64_t accessUnits();
+
+    uint64_t idrCount();
+
+    void report(FILE *out, const std::string &title);
+
+    // read a whole .data dump in large chunks. RETURN: 0 if successful
+    static int analyzeFile(const std::string &path, FILE *out);
+
+private:
+    void onNal(const NalUnit &nal);
+
+    void closeAccessUnit();
+
+private:
+    bool auOpen_;
+    bool auHasVCL_;
+    int lastDependencyId_;
+    AccessUnitInfo au_;
+    uint64_t accessUnits_;
+    uint64_t totalBytes_;
+    uint64_t nonVCLNals_;
+    uint64_t idrCount_;
+    int64_t lastIdrIndex_;
+    uint64_t minIdrSpacing_;
+    uint64_t maxIdrSpacing_;
+    uint64_t sumIdrSpacing_;
+    uint64_t minAuBytes_;
+    uint64_t maxAuBytes_;
+    LayerStats layers_[LAYER_ANALYZER_MAX_ID + 1][LAYER_ANALYZER_MAX_ID];    // [T][S], the last row is temporal id unknown
+    NalScanner scanner_;
+    AccessUnitCB callback_;
+};
+
+#endif /* LayerAnalyzer_hpp */
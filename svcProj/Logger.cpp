@@ -0,0 +1,381 @@
+//
+//  Logger.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "Logger.hpp"
+
+#define SVC_LOG_RATE_SLOTS      64      // call sites rate limited per thread, colliding ones share a slot
+
+struct Logger::LogRing {
+    LogRing(): head(0), tail(0), dropped(0), droppedReported(0), closed(false), threadId(0) {
+        memset(rates, 0, sizeof(rates));
+    }
+
+    LogRecord records[SVC_LOG_RING_RECORDS];
+    LogRecord scratch;                      // synchronous writes while the logger is not running
+    RateState rates[SVC_LOG_RATE_SLOTS];    // producer only
+    std::atomic<uint64_t> head;             // next record the logger thread reads
+    std::atomic<uint64_t> tail;             // next record the owning thread writes
+    std::atomic<uint64_t> dropped;          // records lost to a full ring
+    uint64_t droppedReported;               // consumer only
+    std::atomic_bool closed;                // its thread exited, goes once drained
+    uint32_t threadId;
+};
+
+// the holder goes with its thread, the ring stays until the logger thread drained it
+struct LogRingHolder {
+    std::shared_ptr<Logger::LogRing> ring;
+
+    ~LogRingHolder() {
+        if (ring) {
+            ring->closed.store(true, std::memory_order_release);
+        }
+    }
+};
+
+std::atomic<int> Logger::level_(AV_LOG_INFO);
+
+static uint64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Logger &Logger::shared() {
+    static Logger logger;
+    return logger;
+}
+
+LoggerSettings Logger::defaultSettings() {
+    return {NULL, 50, 1000, AV_LOG_WARNING, 20};   // debug output asked for is output in full
+}
+
+Logger::Logger(): settings_(defaultSettings()), running_(false), nextThreadId_(0), epoch_(std::chrono::steady_clock::now()), lineOpen_(false) {}
+
+Logger::~Logger() {
+    stop();
+}
+
+void Logger::setLevel(int level) {
+    level_.store(level, std::memory_order_relaxed);
+    av_log_set_level(level);
+}
+
+void Logger::setSettings(const LoggerSettings &settings) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (running_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: logger settings must be set before start\n");
+        return;
+    }
+
+    settings_ = settings;
+}
+
+void Logger::start() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (running_) {
+        return;
+    }
+
+    running_ = true;
+    thread_ = std::thread([this] {
+        while (running_) {
+            drain();
+            std::unique_lock<std::mutex> locker(mutex_);
+            wakeup_.wait_for(locker, std::chrono::milliseconds(settings_.flushIntervalMs), [this] { return !running_; });
+        }
+        drain();
+    });
+    av_log_set_callback(avLogCallback);
+}
+
+void Logger::stop() {
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+
+    av_log_set_callback(av_log_default_callback);
+    wakeup_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Logger::flush() {
+    drain();
+}
+
+Logger::LogRingShr &Logger::threadRing() {
+    thread_local LogRingHolder holder;
+    if (!holder.ring) {
+        holder.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> locker(mutex_);
+        holder.ring->threadId = nextThreadId_++;
+        rings_.push_back(holder.ring);
+    }
+
+    return holder.ring;
+}
+
+LogRecord *Logger::begin(int level, const char *format) {
+    auto &ring = threadRing();
+    auto now = steadyNs();
+
+    // repeated messages: burst per window and call site, the next one through tells how many were left out
+    RateState unlimited = {format, now, 0, 0};
+    auto limited = settings_.burst > 0 && level <= settings_.rateLimitLevel;
+    auto &rate = limited ? ring->rates[(reinterpret_cast<uintptr_t>(format) >> 3) % SVC_LOG_RATE_SLOTS] : unlimited;
+    if (rate.format != format) {
+        rate = {format, now, 0, 0};
+    } else if (now - rate.windowBegin >= (uint64_t)settings_.windowMs * 1000000) {
+        rate.windowBegin = now;
+        rate.count = 0;
+    }
+
+    if (limited && rate.count >= settings_.burst) {
+        rate.suppressed++;
+        return NULL;
+    }
+    rate.count++;
+
+    LogRecord *record = &ring->scratch;
+    if (running_.load(std::memory_order_relaxed)) {
+        auto tail = ring->tail.load(std::memory_order_relaxed);
+        if (tail - ring->head.load(std::memory_order_acquire) >= SVC_LOG_RING_RECORDS) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        record = &ring->records[tail % SVC_LOG_RING_RECORDS];
+    }
+
+    record->ns = now;
+    record->format = format;
+    record->level = level;
+    record->suppressed = rate.suppressed;
+    record->argc = 0;
+    record->textUsed = 0;
+    record->text[0] = 0;
+    rate.suppressed = 0;
+    return record;
+}
+
+void Logger::commit(LogRecord *record) {
+    auto &ring = threadRing();
+    if (record == &ring->scratch) {
+        std::lock_guard<std::mutex> locker(writeMutex_);
+        write(*record, ring->threadId);
+        fflush(settings_.out ? settings_.out : stderr);
+        return;
+    }
+
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+LogArg *Logger::nextArg(LogRecord &record) {
+    return record.argc < SVC_LOG_MAX_ARGS ? &record.args[record.argc++] : NULL;
+}
+
+void Logger::capture(LogRecord &record, const char *const &value) {
+    auto arg = nextArg(record);
+    if (!arg) {
+        return;
+    }
+
+    // the string may be gone by the time it is formatted, a tag of a decoder that was torn down
+    auto text = value ? value : "(null)";
+    auto room = SVC_LOG_TEXT_BYTES - record.textUsed;
+    arg->type = LogArg::STRING;
+    if (room == 0) {
+        arg->offset = SVC_LOG_TEXT_BYTES - 1;   // the terminator of the last string, an empty one
+        return;
+    }
+
+    auto length = std::min(strlen(text), (size_t)room - 1);
+    memcpy(record.text + record.textUsed, text, length);
+    record.text[record.textUsed + length] = 0;
+    arg->offset = record.textUsed;
+    record.textUsed += static_cast<uint32_t>(length + 1);
+}
+
+void Logger::capture(LogRecord &record, char *const &value) {
+    capture(record, static_cast<const char *>(value));
+}
+
+void Logger::capture(LogRecord &record, const std::string &value) {
+    capture(record, value.c_str());
+}
+
+std::string Logger::format(const LogRecord &record) {
+    if (!record.format) {
+        return record.text;
+    }
+
+    std::string out;
+    char piece[256];
+    uint32_t argAt = 0;
+    for (auto p = record.format; *p; p++) {
+        if (*p != '%') {
+            out.push_back(*p);
+            continue;
+        }
+
+        if (p[1] == '%') {
+            out.push_back('%');
+            p++;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion, the length is replaced: every argument was widened
+        std::string spec = "%";
+        for (p++; *p && strchr("-+ #0", *p); p++) {
+            spec.push_back(*p);
+        }
+        for (; *p && (isdigit(*p) || *p == '.'); p++) {
+            spec.push_back(*p);
+        }
+        for (; *p && strchr("hlLqjzt", *p); p++) {}
+        if (!*p) {
+            break;
+        }
+
+        auto conversion = *p;
+        if (argAt >= record.argc) {
+            out.append("<?>");
+            continue;
+        }
+
+        auto &arg = record.args[argAt++];
+        auto isInteger = arg.type == LogArg::SIGNED || arg.type == LogArg::UNSIGNED;
+        piece[0] = 0;
+        switch (conversion) {
+            case 'd': case 'i':
+                spec.append("lld");
+                snprintf(piece, sizeof(piece), spec.c_str(), arg.type == LogArg::DOUBLE ? (long long)arg.d : arg.i);
+                break;
+            case 'c':   // %c takes an int
+                spec.push_back('c');
+                snprintf(piece, sizeof(piece), spec.c_str(), arg.type == LogArg::DOUBLE ? (int)arg.d : (int)arg.i);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                spec.append("ll").push_back(conversion);
+                snprintf(piece, sizeof(piece), spec.c_str(), arg.type == LogArg::DOUBLE ? (unsigned long long)arg.d : arg.u);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec.push_back(conversion);
+                snprintf(piece, sizeof(piece), spec.c_str(), isInteger ? (arg.type == LogArg::SIGNED ? (double)arg.i : (double)arg.u) : arg.d);
+                break;
+            case 's':
+                spec.push_back('s');
+                snprintf(piece, sizeof(piece), spec.c_str(), arg.type == LogArg::STRING ? record.text + arg.offset : "<?>");
+                break;
+            case 'p':
+                snprintf(piece, sizeof(piece), "%p", arg.type == LogArg::POINTER ? arg.p : (const void *)(uintptr_t)arg.u);
+                break;
+            default:
+                snprintf(piece, sizeof(piece), "<%%%c?>", conversion);
+                break;
+        }
+        out.append(piece);
+    }
+
+    return out;
+}
+
+void Logger::write(const LogRecord &record, uint32_t threadId) {
+    auto out = settings_.out ? settings_.out : stderr;
+    auto text = format(record);
+    if (!lineOpen_) {
+        auto seconds = (record.ns - std::chrono::duration_cast<std::chrono::nanoseconds>(epoch_.time_since_epoch()).count()) / 1e9;
+        fprintf(out, "[%10.3f][%2u] ", seconds, threadId);
+        if (record.suppressed) {
+            fprintf(out, "(%u similar suppressed) ", record.suppressed);
+        }
+    }
+
+    fputs(text.c_str(), out);
+    lineOpen_ = !text.empty() && text.back() != '\n';
+}
+
+void Logger::drain() {
+    std::lock_guard<std::mutex> drainLocker(drainMutex_);
+    std::vector<LogRingShr> rings;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        rings = rings_;
+    }
+
+    // what every ring holds right now, written in time order over all threads
+    struct Pending {
+        const LogRecord *record;
+        uint32_t threadId;
+    };
+    std::vector<Pending> pending;
+    std::vector<uint64_t> tails(rings.size());
+    for (size_t i = 0; i < rings.size(); i++) {
+        auto &ring = rings[i];
+        auto head = ring->head.load(std::memory_order_relaxed);
+        tails[i] = ring->tail.load(std::memory_order_acquire);
+        for (auto at = head; at < tails[i]; at++) {
+            pending.push_back({&ring->records[at % SVC_LOG_RING_RECORDS], ring->threadId});
+        }
+    }
+    std::stable_sort(pending.begin(), pending.end(), [](const Pending &a, const Pending &b) {
+        return a.record->ns < b.record->ns;
+    });
+
+    {
+        std::lock_guard<std::mutex> locker(writeMutex_);
+        auto out = settings_.out ? settings_.out : stderr;
+        for (auto it = pending.begin(); it != pending.end(); it++) {
+            write(*it->record, it->threadId);
+        }
+
+        for (auto it = rings.begin(); it != rings.end(); it++) {
+            auto dropped = (*it)->dropped.load(std::memory_order_relaxed);
+            if (dropped != (*it)->droppedReported) {
+                fprintf(out, "%sLogger: thread %u dropped %llu messages, its ring was full\n", lineOpen_ ? "\n" : "",
+                        (*it)->threadId, (unsigned long long)(dropped - (*it)->droppedReported));
+                (*it)->droppedReported = dropped;
+                lineOpen_ = false;
+            }
+        }
+        fflush(out);
+    }
+
+    for (size_t i = 0; i < rings.size(); i++) {
+        rings[i]->head.store(tails[i], std::memory_order_release);
+    }
+
+    // rings of exited threads go once nothing is left in them
+    std::lock_guard<std::mutex> locker(mutex_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const LogRingShr &ring) {
+        return ring->closed.load(std::memory_order_acquire) && ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire);
+    }), rings_.end());
+}
+
+void Logger::avLogCallback(void *avcl, int level, const char *format, va_list vl) {
+    level &= 0xff;  // the upper bits may carry a color
+    if (!enabled(level)) {
+        return;
+    }
+
+    auto &logger = shared();
+    auto record = logger.begin(level, format);
+    if (!record) {
+        return;
+    }
+
+    // the va_list does not outlive this call, ffmpeg's messages are formatted here
+    thread_local int printPrefix = 1;
+    av_log_format_line2(avcl, level, format, vl, record->text, sizeof(record->text), &printPrefix);
+    record->format = NULL;
+    logger.commit(record);
+}
@@ -0,0 +1,240 @@
+//
+//  Logger.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef Logger_hpp
+#define Logger_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <type_traits>
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+// the most verbose level compiled in, -DSVC_LOG_MIN_LEVEL=AV_LOG_INFO drops every SVC_LOG debug call from the binary
+#ifndef SVC_LOG_MIN_LEVEL
+#define SVC_LOG_MIN_LEVEL AV_LOG_DEBUG
+#endif
+
+#define SVC_LOG_MAX_ARGS        10
+#define SVC_LOG_TEXT_BYTES      192     // copied %s arguments / an ffmpeg message, longer ones are cut
+#define SVC_LOG_RING_RECORDS    512     // per thread, a full ring drops instead of waiting
+#define SVC_LOG_LEVEL_KEEP      INT_MIN // for a level argument: leave the process wide level as it is
+
+/* av_log drop-in for hot paths: the level is checked before any argument is evaluated, the format
+ * string (a literal) and the arguments are captured into a ring of the calling thread, formatting
+ * and writing happen on the logger thread. %s arguments are copied, everything else by value.
+ */
+#define SVC_LOG(level, ...) do { \
+    if ((level) <= SVC_LOG_MIN_LEVEL && Logger::enabled(level)) { \
+        Logger::log((level), __VA_ARGS__); \
+    } \
+} while (0)
+
+struct LogArg {
+    enum Type : uint8_t {
+        SIGNED,
+        UNSIGNED,
+        DOUBLE,
+        STRING,         // offset into LogRecord::text
+        POINTER,
+    } type;
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        const void *p;
+        uint32_t offset;
+    };
+};
+
+struct LogRecord {
+    uint64_t ns;                            // steady clock when it was logged
+    const char *format;                     // NULL if text already is the message (ffmpeg's own logs)
+    int level;
+    uint32_t suppressed;                    // similar messages the rate limit dropped before this one
+    uint32_t argc;
+    uint32_t textUsed;
+    LogArg args[SVC_LOG_MAX_ARGS];
+    char text[SVC_LOG_TEXT_BYTES];
+};
+
+struct LoggerSettings {
+    FILE *out;                              // stderr if NULL
+    int burst;                              // messages per call site, thread and window, 0 for no limit
+    int windowMs;
+    int rateLimitLevel;                     // the least severe level the limit applies to, less severe ones always pass
+    int flushIntervalMs;                    // how often the logger thread drains the rings
+};
+
+using LogArg = struct LogArg;
+using LogRecord = struct LogRecord;
+using LoggerSettings = struct LoggerSettings;
+
+struct LogRingHolder;
+
+/* Process wide asynchronous logger. start() installs it as ffmpeg's log callback too, av_log
+ * calls are then formatted on the calling thread (their va_list can not be kept) but written
+ * by the logger thread, without ffmpeg's global callback lock. Each thread logs into a ring of
+ * its own (single producer, the logger thread consumes), records of all rings are written in
+ * time order per drain. Before start() and after stop() SVC_LOG writes synchronously.
+ */
+class Logger {
+public:
+    static Logger &shared();
+
+    ~Logger();
+
+    static bool enabled(int level) {
+        return level <= level_.load(std::memory_order_relaxed);
+    }
+
+    // SVC_LOG and av_log level, av_log_set_level included
+    void setLevel(int level);
+
+    // before start
+    void setSettings(const LoggerSettings &settings);
+
+    // idempotent
+    void start();
+
+    // drains the rings, restores ffmpeg's default log callback
+    void stop();
+
+    // RETURN: once everything logged before the call is written
+    void flush();
+
+    template <typename... Args>
+    static void log(int level, const char *format, const Args&... args) {
+        auto &logger = shared();
+        auto record = logger.begin(level, format);
+        if (!record) {
+            return;
+        }
+
+        int captured[] = {0, (capture(*record, args), 0)...};
+        (void)captured;
+        logger.commit(record);
+    }
+
+    static LoggerSettings defaultSettings();
+
+private:
+    struct RateState {
+        const char *format;
+        uint64_t windowBegin;
+        int count;
+        uint32_t suppressed;
+    };
+
+    struct LogRing;
+
+    friend struct LogRingHolder;
+
+    using LogRingShr = std::shared_ptr<LogRing>;
+
+    Logger();
+
+    // RETURN: the record to fill, NULL if rate limited or the ring is full
+    LogRecord *begin(int level, const char *format);
+
+    void commit(LogRecord *record);
+
+    LogRingShr &threadRing();
+
+    void drain();
+
+    void write(const LogRecord &record, uint32_t threadId);
+
+    static std::string format(const LogRecord &record);
+
+    static void avLogCallback(void *avcl, int level, const char *format, va_list vl);
+
+    static LogArg *nextArg(LogRecord &record);
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    capture(LogRecord &record, const T &value) {
+        auto arg = nextArg(record);
+        if (arg) {
+            arg->type = LogArg::SIGNED;
+            arg->i = value;
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    capture(LogRecord &record, const T &value) {
+        auto arg = nextArg(record);
+        if (arg) {
+            arg->type = LogArg::UNSIGNED;
+            arg->u = value;
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_enum<T>::value>::type
+    capture(LogRecord &record, const T &value) {
+        capture(record, static_cast<long long>(value));
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    capture(LogRecord &record, const T &value) {
+        auto arg = nextArg(record);
+        if (arg) {
+            arg->type = LogArg::DOUBLE;
+            arg->d = value;
+        }
+    }
+
+    template <typename T>
+    static void capture(LogRecord &record, T *const &value) {
+        auto arg = nextArg(record);
+        if (arg) {
+            arg->type = LogArg::POINTER;
+            arg->p = value;
+        }
+    }
+
+    template <size_t N>
+    static void capture(LogRecord &record, const char (&value)[N]) {
+        capture(record, static_cast<const char *>(value));
+    }
+
+    static void capture(LogRecord &record, const char *const &value);
+
+    static void capture(LogRecord &record, char *const &value);
+
+    static void capture(LogRecord &record, const std::string &value);
+
+private:
+    static std::atomic<int> level_;
+    LoggerSettings settings_;
+    std::atomic_bool running_;
+    std::thread thread_;
+    std::mutex mutex_;                      // rings_, start / stop
+    std::mutex drainMutex_;                 // one consumer at a time: the logger thread or flush()
+    std::mutex writeMutex_;                 // synchronous writes before start / after stop
+    std::condition_variable wakeup_;
+    std::vector<LogRingShr> rings_;
+    uint32_t nextThreadId_;
+    std::chrono::steady_clock::time_point epoch_;
+    bool lineOpen_;                         // the last message did not end its line
+};
+
+#endif /* Logger_hpp */
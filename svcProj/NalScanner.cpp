@@ -0,0 +1,242 @@
+//
+//  NalScanner.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <algorithm>
+#include "NalScanner.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+NalScanner::NalScanner(NalUnitCB callback): inNal_(false), headerLen_(0), tailLen_(0), consumed_(0), base_(NULL), callback_(callback) {
+    memset(&cur_, 0, sizeof(NalUnit));
+}
+
+NalScanner::~NalScanner() {}
+
+size_t NalScanner::findStartCode(const unsigned char *buf, size_t len) {
+    size_t i = 0;
+    // compare buf[i], buf[i + 1], buf[i + 2] against 00 00 01 for a whole vector of i at once
+#if defined(__AVX2__)
+    auto zero32 = _mm256_setzero_si256();
+    auto one32 = _mm256_set1_epi8(1);
+    for (; i + 34 <= len; i += 32) {
+        auto a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i)), zero32);
+        auto b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i + 1)), zero32);
+        auto c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i + 2)), one32);
+        auto mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    auto zero16 = _mm_setzero_si128();
+    auto one16 = _mm_set1_epi8(1);
+    for (; i + 18 <= len; i += 16) {
+        auto a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), zero16);
+        auto b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 1)), zero16);
+        auto c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 2)), one16);
+        auto mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+    auto zero16 = vdupq_n_u8(0);
+    auto one16 = vdupq_n_u8(1);
+    for (; i + 18 <= len; i += 16) {
+        auto a = vceqq_u8(vld1q_u8(buf + i), zero16);
+        auto b = vceqq_u8(vld1q_u8(buf + i + 1), zero16);
+        auto c = vceqq_u8(vld1q_u8(buf + i + 2), one16);
+        if (vmaxvq_u8(vandq_u8(vandq_u8(a, b), c))) {
+            break;  // NEON has no movemask, the scalar loop below pins down the position
+        }
+    }
+#endif
+    for (; i + 3 <= len; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+bool NalScanner::isVCL(int type) {
+    return type == NAL_TYPE_SLICE || type == NAL_TYPE_SLICE_IDR || type == NAL_TYPE_SLICE_EXT;
+}
+
+void NalScanner::parseHeader(const unsigned char *header, int headerLen, NalUnit &nal) {
+    nal.type = 0;
+    nal.nri = 0;
+    nal.svcExtension = false;
+    nal.idr = false;
+    nal.dependencyId = 0;
+    nal.qualityId = 0;
+    nal.temporalId = 0;
+    nal.firstSliceOfPicture = false;
+    if (headerLen <= 0) {
+        return;
+    }
+
+    nal.type = header[0] & 0x1f;
+    nal.nri = (header[0] >> 5) & 0x03;
+    if (nal.type == NAL_TYPE_PREFIX || nal.type == NAL_TYPE_SLICE_EXT) {
+        /* nal_unit_header_svc_extension:
+         * svc_extension_flag(1) idr_flag(1) priority_id(6)
+         * no_inter_layer_pred_flag(1) dependency_id(3) quality_id(4)
+         * temporal_id(3) use_ref_base_pic_flag(1) discardable_flag(1) output_flag(1) reserved_three_2bits(2)
+         */
+        if (headerLen >= 4) {
+            nal.svcExtension = (header[1] & 0x80) != 0;
+            nal.idr = (header[1] & 0x40) != 0;
+            nal.dependencyId = (header[2] >> 4) & 0x07;
+            nal.qualityId = header[2] & 0x0f;
+            nal.temporalId = (header[3] >> 5) & 0x07;
+        }
+
+        if (nal.type == NAL_TYPE_SLICE_EXT && headerLen >= 5) {
+            nal.firstSliceOfPicture = (header[4] & 0x80) != 0;  // ue(v) of 0 is a single '1' bit
+        }
+        return;
+    }
+
+    nal.idr = nal.type == NAL_TYPE_SLICE_IDR;
+    if (isVCL(nal.type) && headerLen >= 2) {
+        nal.firstSliceOfPicture = (header[1] & 0x80) != 0;
+    }
+}
+
+void NalScanner::scan(const unsigned char *buf, size_t len, NalUnitCB callback) {
+    NalScanner scanner(callback);
+    scanner.base_ = buf;
+    scanner.feed(buf, len);
+    scanner.finish();
+}
+
+int NalScanner::byteAt(uint64_t pos, const unsigned char *buf) {
+    if (pos >= consumed_) {
+        return buf[pos - consumed_];
+    }
+
+    auto back = consumed_ - pos;
+    if (back > (uint64_t)tailLen_) {
+        return -1;
+    }
+
+    return tail_[tailLen_ - back];
+}
+
+void NalScanner::emit(uint64_t end) {
+    if (!inNal_) {
+        return;
+    }
+
+    cur_.size = end - cur_.offset;
+    auto headerLen = (int)std::min<uint64_t>(headerLen_, cur_.size - cur_.startCodeLen);
+    parseHeader(header_, headerLen, cur_);
+    cur_.data = base_ ? base_ + cur_.offset : NULL;
+    inNal_ = false;
+    if (callback_) {
+        callback_(cur_);
+    }
+}
+
+void NalScanner::collectHeader(const unsigned char *buf, size_t len) {
+    if (!inNal_ || headerLen_ >= NAL_HEADER_MAX_BYTES) {
+        return;
+    }
+
+    auto next = cur_.offset + cur_.startCodeLen + headerLen_;
+    if (next < consumed_ || next >= consumed_ + len) {
+        return;
+    }
+
+    auto from = next - consumed_;
+    auto count = std::min<uint64_t>(NAL_HEADER_MAX_BYTES - headerLen_, len - from);
+    memcpy(header_ + headerLen_, buf + from, count);
+    headerLen_ += count;
+}
+
+void NalScanner::onStartCode(uint64_t pos, const unsigned char *buf, size_t len) {
+    auto start = pos;
+    if (pos > 0 && byteAt(pos - 1, buf) == 0) {   // 00 00 00 01
+        start = pos - 1;
+    }
+
+    emit(start);    // bytes before the very first start code are not reported
+
+    memset(&cur_, 0, sizeof(NalUnit));
+    cur_.offset = start;
+    cur_.startCodeLen = (int)(pos + 3 - start);
+    headerLen_ = 0;
+    inNal_ = true;
+    collectHeader(buf, len);
+}
+
+void NalScanner::feed(const unsigned char *buf, size_t len) {
+    if (!buf || len == 0) {
+        return;
+    }
+
+    collectHeader(buf, len);    // header of a NAL whose start code ended the previous chunk
+
+    // start codes straddling the previous chunk and this one
+    if (tailLen_ > 0) {
+        unsigned char joint[5];
+        auto head = std::min<size_t>(2, len);
+        memcpy(joint, tail_, tailLen_);
+        memcpy(joint + tailLen_, buf, head);
+        for (auto j = std::max(tailLen_ - 2, 0); j < tailLen_; j++) {  // the 01 has to come from buf
+            if (j + 3 > tailLen_ + (int)head) {
+                break;
+            }
+
+            if (joint[j] == 0 && joint[j + 1] == 0 && joint[j + 2] == 1) {
+                onStartCode(consumed_ - tailLen_ + j, buf, len);
+            }
+        }
+    }
+
+    size_t pos = 0;
+    while (pos + 3 <= len) {
+        auto found = findStartCode(buf + pos, len - pos);
+        if (found >= len - pos) {
+            break;
+        }
+
+        onStartCode(consumed_ + pos + found, buf, len);
+        pos += found + 3;
+    }
+
+    // keep the last three bytes for the next chunk
+    if (len >= 3) {
+        memcpy(tail_, buf + len - 3, 3);
+        tailLen_ = 3;
+    } else {
+        unsigned char joint[5];
+        memcpy(joint, tail_, tailLen_);
+        memcpy(joint + tailLen_, buf, len);
+        auto total = tailLen_ + (int)len;
+        tailLen_ = std::min(total, 3);
+        memcpy(tail_, joint + total - tailLen_, tailLen_);
+    }
+
+    consumed_ += len;
+}
+
+void NalScanner::finish() {
+    emit(consumed_);
+    inNal_ = false;
+    headerLen_ = 0;
+    tailLen_ = 0;
+    consumed_ = 0;
+}
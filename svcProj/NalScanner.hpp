@@ -0,0 +1,92 @@
+//
+//  NalScanner.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef NalScanner_hpp
+#define NalScanner_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <functional>
+
+#define NAL_HEADER_MAX_BYTES    5           // nal header + svc extension + first byte of slice header
+
+enum NalUnitType {
+    NAL_TYPE_SLICE = 1,
+    NAL_TYPE_SLICE_IDR = 5,
+    NAL_TYPE_SEI = 6,
+    NAL_TYPE_SPS = 7,
+    NAL_TYPE_PPS = 8,
+    NAL_TYPE_AUD = 9,
+    NAL_TYPE_PREFIX = 14,
+    NAL_TYPE_SUBSET_SPS = 15,
+    NAL_TYPE_SLICE_EXT = 20,
+};
+
+struct NalUnit {
+    uint64_t offset;                // where the start code begins, counted from the first byte fed
+    uint64_t size;                  // start code + payload, up to the next start code
+    int startCodeLen;               // 3 or 4
+    int type;
+    int nri;
+    bool svcExtension;              // NAL_TYPE_PREFIX / NAL_TYPE_SLICE_EXT carry dependency/quality/temporal ids
+    bool idr;
+    int dependencyId;               // spatial id
+    int qualityId;
+    int temporalId;
+    bool firstSliceOfPicture;       // VCL only: first_mb_in_slice == 0
+    const unsigned char *data;      // start code of this NAL, only set by NalScanner::scan()
+};
+
+using NalUnit = struct NalUnit;
+using NalUnitCB = std::function<void (const NalUnit &nal)>;
+
+/* Annex-B start code scanner.
+ * feed() may be called with chunks of any size, start codes and NAL headers split across
+ * chunks are stitched together. Only NAL headers are kept, payloads are never copied.
+ */
+class NalScanner {
+public:
+    NalScanner(NalUnitCB callback);
+
+    ~NalScanner();
+
+    void feed(const unsigned char *buf, size_t len);
+
+    void finish();      // emit the last NAL, then the scanner can be reused from offset 0
+
+    // scan a whole buffer in one go, NalUnit::data points into buf
+    static void scan(const unsigned char *buf, size_t len, NalUnitCB callback);
+
+    // RETURN: index of the first 00 00 01 in buf, len if there is none
+    static size_t findStartCode(const unsigned char *buf, size_t len);
+
+    static void parseHeader(const unsigned char *header, int headerLen, NalUnit &nal);
+
+    static bool isVCL(int type);
+
+private:
+    void onStartCode(uint64_t pos, const unsigned char *buf, size_t len);
+
+    void collectHeader(const unsigned char *buf, size_t len);
+
+    void emit(uint64_t end);
+
+    int byteAt(uint64_t pos, const unsigned char *buf);
+
+private:
+    bool inNal_;                                    // cur_ has a start code but no end yet
+    NalUnit cur_;
+    int headerLen_;
+    unsigned char header_[NAL_HEADER_MAX_BYTES];
+    int tailLen_;
+    unsigned char tail_[3];                         // last bytes of the previous chunk
+    uint64_t consumed_;                             // offset of the chunk being fed
+    const unsigned char *base_;                     // set by scan() only
+    NalUnitCB callback_;
+};
+
+#endif /* NalScanner_hpp */
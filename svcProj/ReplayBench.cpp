@@ -0,0 +1,262 @@
+//
+//  ReplayBench.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "ReplayBench.hpp"
+#include "SVCDecoder.hpp"
+#include "LayerAnalyzer.hpp"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#define REPLAY_RSS_SAMPLE_MS    5
+
+ReplayBench::ReplayBench(const ReplayOptions &options): options_(options), bufferPool_(BufferPool::create(0)) {
+    options_.loops = std::max(options_.loops, 1);
+    options_.queueSize = std::max(options_.queueSize, 1);
+}
+
+ReplayBench::~ReplayBench() {}
+
+int ReplayBench::load(const std::string &path) {
+    auto file = fopen(path.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "can not open %s\n", path.c_str());
+        return -1;
+    }
+
+    std::vector<unsigned char> content;
+    unsigned char chunk[1 << 16];
+    while (true) {
+        auto got = fread(chunk, 1, sizeof(chunk), file);
+        if (got == 0) {
+            break;
+        }
+        content.insert(content.end(), chunk, chunk + got);
+    }
+    fclose(file);
+
+    ReplayLayer layer;
+    layer.path = path;
+    auto slash = path.find_last_of('/');
+    layer.tag = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    layer.tag = layer.tag.substr(0, layer.tag.find_last_of('.'));   // SVC_T<t>_<w>x<h>
+    layer.bytes = content.size();
+    layer.frames = 0;
+    layer.seconds = 0;
+    layer.peakRssBytes = 0;
+
+    // every access unit in a buffer of its own, exactly what the decoder was fed
+    auto failed = false;
+    LayerAnalyzer analyzer([&](const AccessUnitInfo &au) {
+        auto buffer = bufferPool_->acquire(au.size);
+        if (!buffer) {
+            failed = true;
+            return;
+        }
+        memcpy(buffer->data(), content.data() + au.offset, au.size);
+        layer.accessUnits.push_back(buffer);
+    });
+    analyzer.feed(content.data(), content.size());
+    analyzer.finish();
+
+    if (failed || layer.accessUnits.empty()) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), failed ? "out of memory" : "no access unit");
+        return -2;
+    }
+
+    layers_.push_back(std::move(layer));
+    return 0;
+}
+
+size_t ReplayBench::currentRssBytes() {
+#if defined(__linux__)
+    auto file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+
+    long pages = 0, resident = 0;
+    auto got = fscanf(file, "%ld %ld", &pages, &resident);
+    fclose(file);
+    return got == 2 ? (size_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+#else
+    return 0;
+#endif
+}
+
+int ReplayBench::replay(std::vector<ReplayLayer *> &layers) {
+    using Clock = std::chrono::steady_clock;
+    std::string noDump;
+    std::vector<std::shared_ptr<SVCDecoder>> decoders;
+    std::vector<std::vector<Clock::time_point>> putTimes(layers.size());
+    std::vector<Clock::time_point> begins(layers.size()), lastOutputs(layers.size());
+
+    auto baseline = currentRssBytes();
+    std::atomic_bool sampling(true);
+    std::atomic<size_t> peakRss(baseline);
+    std::thread sampler([&] {
+        while (sampling) {
+            auto rss = currentRssBytes();
+            if (rss > peakRss) {
+                peakRss = rss;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(REPLAY_RSS_SAMPLE_MS));
+        }
+    });
+
+    for (size_t i = 0; i < layers.size(); i++) {
+        auto layer = layers[i];
+        putTimes[i].resize(layer->accessUnits.size() * options_.loops);
+        layer->latenciesMs.reserve(putTimes[i].size());
+
+        auto decoder = std::make_shared<SVCDecoder>(SyncQueueLimits(options_.queueSize), noDump, std::string(layer->tag));
+        if (decoder->initSVCDecoder()) {
+            fprintf(stderr, "%s: can not init the svc decoder\n", layer->tag.c_str());
+            decoders.push_back(nullptr);
+            continue;
+        }
+
+        // the timestamp is the sequence number of the access unit, it comes back with the picture
+        auto &times = putTimes[i];
+        auto &lastOutput = lastOutputs[i];
+        decoder->start([layer, &times, &lastOutput](bool eof, int status, SBufferInfo *pDecodedInfo, uchar **, int, SVCDecoder *) {
+            if (eof || status || pDecodedInfo->iBufferStatus != 1) {
+                return;
+            }
+
+            auto now = Clock::now();
+            auto seq = pDecodedInfo->uiOutYuvTimeStamp;
+            if (seq < times.size()) {
+                layer->latenciesMs.push_back(std::chrono::duration<double, std::milli>(now - times[seq]).count());
+            }
+            layer->frames++;
+            lastOutput = now;
+        });
+        decoders.push_back(decoder);
+    }
+
+    std::vector<std::thread> feeders;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (!decoders[i]) {
+            continue;
+        }
+
+        feeders.emplace_back([this, i, &layers, &decoders, &putTimes, &begins] {
+            auto layer = layers[i];
+            auto decoder = decoders[i];
+            auto interval = options_.fps > 0 ? std::chrono::duration<double>(1.0 / options_.fps) : std::chrono::duration<double>(0);
+            auto begin = Clock::now();
+            begins[i] = begin;
+
+            long long seq = 0;
+            for (auto loop = 0; loop < options_.loops; loop++) {
+                for (auto it = layer->accessUnits.begin(); it != layer->accessUnits.end(); it++, seq++) {
+                    if (options_.fps > 0) {
+                        std::this_thread::sleep_until(begin + std::chrono::duration_cast<Clock::duration>(interval * seq));
+                    }
+
+                    SVCH264Data data;
+                    data.timestamp = seq;
+                    data.temporalId = 0;
+                    data.compressedDataLen = static_cast<int>((*it)->size());
+                    data.compressedData = *it;
+                    putTimes[i][seq] = Clock::now();
+                    decoder->put(std::move(data));
+                }
+            }
+
+            decoder->put(SVCH264Data());    // EOF
+        });
+    }
+
+    for (auto it = feeders.begin(); it != feeders.end(); it++) {
+        it->join();
+    }
+
+    for (auto it = decoders.begin(); it != decoders.end(); it++) {
+        if (*it) {
+            (*it)->stop();
+        }
+    }
+
+    sampling = false;
+    sampler.join();
+
+    auto ret = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (!decoders[i]) {
+            ret = -1;
+            continue;
+        }
+
+        layers[i]->seconds = layers[i]->frames ? std::chrono::duration<double>(lastOutputs[i] - begins[i]).count() : 0;
+        layers[i]->peakRssBytes = options_.serial ? peakRss - std::min(baseline, peakRss.load()) : peakRss.load();
+    }
+
+    return ret;
+}
+
+int ReplayBench::run(FILE *out) {
+    if (layers_.empty()) {
+        return -1;
+    }
+
+    auto ret = 0;
+    if (options_.serial) {
+        for (auto it = layers_.begin(); it != layers_.end(); it++) {
+            std::vector<ReplayLayer *> one(1, &*it);
+            ret |= replay(one);
+        }
+    } else {
+        std::vector<ReplayLayer *> all;
+        for (auto it = layers_.begin(); it != layers_.end(); it++) {
+            all.push_back(&*it);
+        }
+        ret = replay(all);
+    }
+
+    fprintf(out, "== replay: %zu layers, %d loops, %s, %s, loaded %.1f MB\n", layers_.size(), options_.loops,
+            options_.fps > 0 ? (std::to_string(options_.fps) + " fps").c_str() : "as fast as possible",
+            options_.serial ? "serial (RSS above baseline)" : "concurrent (process RSS)",
+            bufferPool_->outstandingBytes() / 1048576.0);
+    fprintf(out, "   %-24s %8s %10s %9s %9s %9s %9s %9s %10s\n", "layer", "AUs", "frames", "fps", "p50 ms", "p90 ms", "p99 ms", "max ms", "peak MB");
+    for (auto it = layers_.begin(); it != layers_.end(); it++) {
+        report(out, *it);
+    }
+
+    return ret;
+}
+
+void ReplayBench::report(FILE *out, ReplayLayer &layer) {
+    auto &latencies = layer.latenciesMs;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        auto at = std::min(latencies.size() - 1, (size_t)(p * (latencies.size() - 1) + 0.5));
+        return latencies[at];
+    };
+
+    fprintf(out, "   %-24s %8zu %10llu %9.1f %9.2f %9.2f %9.2f %9.2f %10.1f\n", layer.tag.c_str(), layer.accessUnits.size(),
+            (unsigned long long)layer.frames, layer.seconds > 0 ? layer.frames / layer.seconds : 0.0,
+            percentile(0.5), percentile(0.9), percentile(0.99), latencies.empty() ? 0.0 : latencies.back(),
+            layer.peakRssBytes / 1048576.0);
+}
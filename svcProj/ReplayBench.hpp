@@ -0,0 +1,66 @@
+//
+//  ReplayBench.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef ReplayBench_hpp
+#define ReplayBench_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "BufferPool.hpp"
+
+struct ReplayOptions {
+    double fps;             // feed rate per layer, <= 0 feeds as fast as the decoder takes it
+    int loops;              // how many times every dump is played
+    bool serial;            // one layer after the other, so the peak memory can be told apart per layer
+    int queueSize;          // access units queued per decoder
+};
+
+using ReplayOptions = struct ReplayOptions;
+
+/* Decode-only benchmark: the .data dumps of SVCDecoder are loaded and split into access
+ * units up front, then fed to one SVCDecoder per dump without demux, h264 decode or encode.
+ * Reports decode fps, enqueue-to-output latency percentiles and peak RSS per (T, S) layer.
+ */
+class ReplayBench {
+public:
+    ReplayBench(const ReplayOptions &options);
+
+    ~ReplayBench();
+
+    // RETURN: 0 if the dump could be read and holds at least one access unit
+    int load(const std::string &path);
+
+    // RETURN: 0 if every layer was replayed
+    int run(FILE *out);
+
+    static size_t currentRssBytes();
+
+private:
+    struct ReplayLayer {
+        std::string path;
+        std::string tag;
+        std::vector<MediaBufferShr> accessUnits;    // loaded once, shared by every loop
+        size_t bytes;
+        uint64_t frames;                            // pictures output by the decoder
+        double seconds;                             // first put to last picture
+        size_t peakRssBytes;                        // peak RSS while this layer ran (above the baseline if serial)
+        std::vector<double> latenciesMs;            // put -> picture out
+    };
+
+    int replay(std::vector<ReplayLayer *> &layers);
+
+    void report(FILE *out, ReplayLayer &layer);
+
+private:
+    ReplayOptions options_;
+    BufferPoolShr bufferPool_;
+    std::vector<ReplayLayer> layers_;
+};
+
+#endif /* ReplayBench_hpp */
@@ -5,9 +5,14 @@
 //  Created by Asterisk on 3/19/21.
 //
 
+#include <map>
 #include "SVCDecoder.hpp"
+#include "CodecPool.hpp"
 
-SVCDecoder::SVCDecoder(int maxSize, std::string &dumpDir, std::string &&tag): svcH264DataQueue_(std::make_shared<SyncQueue<SVCH264Data>>(maxSize)), svcDecoder_(NULL), decoderThread_(NULL), decoderInitialized_(false), tag_(tag), dumpSvcHandler_(nullptr), dumpYuvHandler_(nullptr){
+#define SVC_DECODER_MAX_PENDING_FRAMES  16      // frames the decoder may hold back before they count as lost
+#define SVC_DECODER_EWMA_WEIGHT         0.1     // weight of the newest decode time
+
+SVCDecoder::SVCDecoder(const SyncQueueLimits &limits, std::string &dumpDir, std::string &&tag): svcH264DataQueue_(std::make_shared<SyncQueue<SVCH264Data>>(limits)), svcDecoder_(NULL), decoderThread_(NULL), decoderInitialized_(false), decodeTimeMs_(0), tag_(tag), dumpSvcHandler_(nullptr), dumpYuvHandler_(nullptr){
     if (!dumpDir.empty() && !tag_.empty()) {
         auto svcTempName = tag_;
         dumpSvcHandler_ = std::make_shared<Localize>(dumpDir, svcTempName.append(".data"));
@@ -20,6 +25,11 @@ SVCDecoder::SVCDecoder(int maxSize, std::string &dumpDir, std::string &&tag): sv
 }
 
 SVCDecoder::~SVCDecoder() {
+    if (svcDecoder_ && !decoderThread_) {   // initialized but never started, the thread gives it back otherwise
+        CodecPool::shared().giveDecoder(svcDecoder_, decodingParam());
+        svcDecoder_ = NULL;
+    }
+    
     if (dumpYuvHandler_) {
         dumpYuvHandler_->flush();
         dumpSvcHandler_->close();
@@ -31,21 +41,20 @@ SVCDecoder::~SVCDecoder() {
     }
 }
 
-int SVCDecoder::initSVCDecoder() {
+SDecodingParam SVCDecoder::decodingParam() {
     SDecodingParam decParam;
-    auto ret = WelsCreateDecoder(&svcDecoder_);
-    if (cmResultSuccess != ret) {
-        return -1;
-    }
-    
     memset(&decParam, 0, sizeof(SDecodingParam));
     decParam.uiTargetDqLayer = UCHAR_MAX;
     decParam.eEcActiveIdc = ERROR_CON_FRAME_COPY_CROSS_IDR;
     decParam.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_DEFAULT;
-    
-    ret = svcDecoder_->Initialize(&decParam);
-    if (ret != 0) {
-        return -2;
+    return decParam;
+}
+
+int SVCDecoder::initSVCDecoder() {
+    // an idle decoder from an earlier session if there is one
+    svcDecoder_ = CodecPool::shared().takeDecoder(decodingParam());
+    if (!svcDecoder_) {
+        return -1;
     }
 
     decoderInitialized_ = true;
@@ -57,40 +66,64 @@ int SVCDecoder::start(NotifyUserCB notifyUser) {
         return -1;
     }
     
+    finished_ = finishedPromise_.get_future().share();
     decoderThread_ =
     std::make_shared<std::thread>([this] (NotifyUserCB notifyUser) {
         auto status = 0;
         SBufferInfo dstInfo;
         SVCH264Data svcH264Data;
-        unsigned char *pDstBuf = NULL;
+        unsigned char *pDstBuf[3] = {NULL, NULL, NULL};     // Y, U, V planes filled by DecodeFrame2
+        std::map<long long, int> temporalIds;               // timestamp -> temporal id of frames not output yet
         
         while (true) {
-            memset(&svcH264Data, 0, sizeof(SVCH264Data));
+            svcH264Data = SVCH264Data();
             svcH264DataQueue_->front(svcH264Data);
-            if (svcH264Data.compressedDataLen <= 0 || svcH264Data.compressedData == NULL) { // time to go out
+            if (svcH264Data.compressedDataLen <= 0 || !svcH264Data.compressedData) { // time to go out
                 break;
             }
             
             memset(&dstInfo, 0, sizeof(SBufferInfo));
-            auto inputBuffer = svcH264Data.compressedData;
+            auto inputBuffer = svcH264Data.compressedData->data();
             auto inputBufferLen = svcH264Data.compressedDataLen;
             dstInfo.uiInBsTimeStamp = svcH264Data.timestamp;
-            status = svcDecoder_->DecodeFrame2(inputBuffer, inputBufferLen, &pDstBuf, &dstInfo);
-            if (notifyUser) {
-                notifyUser(false, status, &dstInfo, &pDstBuf, this);
+            temporalIds[svcH264Data.timestamp] = svcH264Data.temporalId;
+            auto decodeBegin = std::chrono::steady_clock::now();
+            status = svcDecoder_->DecodeFrame2(inputBuffer, inputBufferLen, pDstBuf, &dstInfo);
+            auto decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeBegin).count();
+            auto average = decodeTimeMs_.load(std::memory_order_relaxed);
+            decodeTimeMs_.store(average > 0 ? average + (decodeMs - average) * SVC_DECODER_EWMA_WEIGHT : decodeMs, std::memory_order_relaxed);
+            
+            // the output may lag behind the input, look the temporal id up by the output timestamp
+            auto temporalId = svcH264Data.temporalId;
+            if (dstInfo.iBufferStatus == 1) {
+                auto found = temporalIds.find(dstInfo.uiOutYuvTimeStamp);
+                if (found != temporalIds.end()) {
+                    temporalId = found->second;
+                    temporalIds.erase(temporalIds.begin(), ++found);    // older ones will never come out
+                }
             }
             
-            delete[] inputBuffer;
+            while (temporalIds.size() > SVC_DECODER_MAX_PENDING_FRAMES) {
+                temporalIds.erase(temporalIds.begin());
+            }
+            
+            if (notifyUser) {
+                notifyUser(false, status, &dstInfo, pDstBuf, temporalId, this);
+            }
         }
         
+        svcH264Data = SVCH264Data();    // compressed data goes back to the pool
+        
         if (notifyUser) {
-            notifyUser(true, 0, NULL, NULL, this);
+            notifyUser(true, 0, NULL, NULL, 0, this);
         }
         
         if (svcDecoder_) {
-            svcDecoder_->Uninitialize();
-            WelsDestroyDecoder(svcDecoder_);
+            CodecPool::shared().giveDecoder(svcDecoder_, decodingParam());
+            svcDecoder_ = NULL;
         }
+        
+        finishedPromise_.set_value();
     }, notifyUser);
     
     return 0;
@@ -104,18 +137,46 @@ void SVCDecoder::put(SVCH264Data &&svcH264Data) {
     svcH264DataQueue_->put(std::forward<SVCH264Data>(svcH264Data));
 }
 
+bool SVCDecoder::tryPut(SVCH264Data &&svcH264Data) {
+    if (!svcH264DataQueue_) {
+        return false;
+    }
+    
+    return svcH264DataQueue_->tryPut(std::forward<SVCH264Data>(svcH264Data));
+}
+
+size_t SVCDecoder::queueSize() {
+    return svcH264DataQueue_ ? svcH264DataQueue_->size() : 0;
+}
+
+double SVCDecoder::decodeTimeMs() {
+    return decodeTimeMs_.load(std::memory_order_relaxed);
+}
+
 void SVCDecoder::stop() {
     if (decoderThread_ && decoderThread_->joinable()) {
         decoderThread_->join();
     }
 }
 
+bool SVCDecoder::waitFinished(int timeoutMs) {
+    if (!finished_.valid()) {
+        return true;
+    }
+    
+    return finished_.wait_for(std::chrono::milliseconds(timeoutMs)) == std::future_status::ready;
+}
+
 void SVCDecoder::interrupt() {
     if (svcH264DataQueue_) {
         svcH264DataQueue_->interrupt();
     }
 }
 
+DecoderThread &SVCDecoder::thread() {
+    return decoderThread_;
+}
+
 LocalizeShr &SVCDecoder::dumpSvcHandler() {
     return dumpSvcHandler_;
 }
@@ -10,6 +10,7 @@
 
 #include <list>
 #include <thread>
+#include <future>
 #include <atomic>
 #include <memory>
 #include <stdio.h>
@@ -18,38 +19,78 @@
 
 #include "Localize.hpp"
 #include "SyncQueue.hpp"
+#include "BufferPool.hpp"
 #include "svc/codec_api.h"
 
 struct SVCH264Data {
     long long timestamp;
+    int temporalId;                     // temporal layer of this access unit
     int compressedDataLen;
-    unsigned char * compressedData;
+    MediaBufferShr compressedData;      // NULL means EOF
 };
 
 class SVCDecoder;
 using uchar = unsigned char;
 using SVCH264Data = struct SVCH264Data;
+
+template <>
+struct SyncQueueItemBytes<SVCH264Data> {
+    // what this decoder holds: its access unit, not the whole shared buffer
+    static size_t bytes(const SVCH264Data &data) {
+        return data.compressedData ? data.compressedDataLen : 0;
+    }
+};
+
+// the buffer is shared by every decoder queue (and the dispatcher), the session pays for it once
+template <>
+struct SyncQueueItemBudget<SVCH264Data> {
+    static size_t bytes(const SVCH264Data &data) {
+        return data.compressedData ? data.compressedData->capacity() : 0;
+    }
+
+    static const void *key(const SVCH264Data &data) {
+        return data.compressedData.get();
+    }
+};
+
 using LocalizeShr = std::shared_ptr<Localize>;
 using DecoderThread = std::shared_ptr<std::thread>;
 using SVCH264DataQueue = std::shared_ptr<SyncQueue<SVCH264Data>>;
-using NotifyUserCB = std::function<void (bool eof, int status, SBufferInfo *pDecodedInfo, uchar **ppDst, SVCDecoder *thiz)>;
+// temporalId: temporal layer of the decoded frame, it belongs to every operating point T >= temporalId
+using NotifyUserCB = std::function<void (bool eof, int status, SBufferInfo *pDecodedInfo, uchar **ppDst, int temporalId, SVCDecoder *thiz)>;
 
 class SVCDecoder {
  
 public:
-    SVCDecoder(int maxSize, std::string &dumpDir, std::string &&extraInfo);
+    SVCDecoder(const SyncQueueLimits &limits, std::string &dumpDir, std::string &&extraInfo);
     
     ~SVCDecoder();
     
     int initSVCDecoder();
     
+    // what every decoder is initialized with, the CodecPool key of them
+    static SDecodingParam decodingParam();
+    
     int start(NotifyUserCB callback);
         
     void put(SVCH264Data &&svcH264Data);
     
+    // RETURN: false if the queue is full, the data is not taken then
+    bool tryPut(SVCH264Data &&svcH264Data);
+    
+    size_t queueSize();
+    
+    // moving average of DecodeFrame2 in milliseconds
+    double decodeTimeMs();
+    
     void interrupt();
     
+    // RETURN: true if the decoding thread has exited (or never started) within timeoutMs
+    bool waitFinished(int timeoutMs);
+    
     void stop();
+    
+    DecoderThread &thread();
             
     LocalizeShr &dumpSvcHandler();
     
@@ -70,5 +111,11 @@ private:
     DecoderThread decoderThread_;
 
     SVCH264DataQueue svcH264DataQueue_;                                 //svc h264 date queue
+    
+    std::atomic<double> decodeTimeMs_;                                  // EWMA of the decode time
+    
+    std::promise<void> finishedPromise_;
+    
+    std::shared_future<void> finished_;
 };
 #endif /* SVCDecoder_hpp */
@@ -0,0 +1,75 @@
+//
+//  SVCDispatcher.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include "SVCDispatcher.hpp"
+
+SVCDispatcher::SVCDispatcher(const SyncQueueLimits &limits): queue_(std::make_shared<SyncQueue<EncodedAccessUnit>>(limits)), thread_(NULL) {}
+
+SVCDispatcher::~SVCDispatcher() {}
+
+int SVCDispatcher::start(DispatchCB dispatch) {
+    if (thread_) {
+        return -1;
+    }
+
+    finished_ = finishedPromise_.get_future().share();
+    thread_ = std::make_shared<std::thread>([this] (DispatchCB dispatch) {
+        EncodedAccessUnit au;
+        while (true) {
+            au = EncodedAccessUnit();
+            queue_->front(au);  // left as is when interrupted: EOF
+            if (dispatch) {
+                dispatch(au);
+            }
+
+            if (!au.bitstream) {
+                break;
+            }
+        }
+
+        au = EncodedAccessUnit();   // the bitstream goes back to the pool
+        finishedPromise_.set_value();
+    }, dispatch);
+
+    return 0;
+}
+
+void SVCDispatcher::put(EncodedAccessUnit &&au) {
+    if (!queue_) {
+        return;
+    }
+
+    queue_->put(std::forward<EncodedAccessUnit>(au));
+}
+
+size_t SVCDispatcher::queueSize() {
+    return queue_ ? queue_->size() : 0;
+}
+
+void SVCDispatcher::interrupt() {
+    if (queue_) {
+        queue_->interrupt();
+    }
+}
+
+bool SVCDispatcher::waitFinished(int timeoutMs) {
+    if (!finished_.valid()) {
+        return true;
+    }
+
+    return finished_.wait_for(std::chrono::milliseconds(timeoutMs)) == std::future_status::ready;
+}
+
+void SVCDispatcher::stop() {
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+}
+
+DispatcherThread &SVCDispatcher::thread() {
+    return thread_;
+}
@@ -0,0 +1,103 @@
+//
+//  SVCDispatcher.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef SVCDispatcher_hpp
+#define SVCDispatcher_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "SyncQueue.hpp"
+#include "BufferPool.hpp"
+
+// one layer of an access unit
+struct EncodedLayer {
+    int temporalId;
+    int spatialId;          // of the session, the spatial base of a simulcast level included
+    int end;                // the NAL of this operating point is bitstream[0, end): this layer and every one before it
+    unsigned char layerType;    // VIDEO_CODING_LAYER, NON_VIDEO_CODING_LAYER for the parameter sets (spatial id 0)
+};
+
+// what an encoder produced for one picture, owned: the encoder's own buffers are reused by the next EncodeFrame
+struct EncodedAccessUnit {
+    long long timestamp;
+    bool idr;
+    int spatialBase;        // spatial id of the first layer
+    std::vector<EncodedLayer> layers;
+    MediaBufferShr bitstream;   // every layer back to back, NULL means EOF
+    bool followed;          // decodedAt is known, the stage timings follow this picture
+    std::chrono::steady_clock::time_point decodedAt;
+};
+
+using EncodedLayer = struct EncodedLayer;
+using EncodedAccessUnit = struct EncodedAccessUnit;
+
+template <>
+struct SyncQueueItemBytes<EncodedAccessUnit> {
+    static size_t bytes(const EncodedAccessUnit &au) {
+        return au.bitstream ? au.bitstream->capacity() : 0;
+    }
+};
+
+// the decoder queues get the same buffer, it is charged once
+template <>
+struct SyncQueueItemBudget<EncodedAccessUnit> {
+    static size_t bytes(const EncodedAccessUnit &au) {
+        return SyncQueueItemBytes<EncodedAccessUnit>::bytes(au);
+    }
+
+    static const void *key(const EncodedAccessUnit &au) {
+        return au.bitstream.get();
+    }
+};
+
+using DispatcherThread = std::shared_ptr<std::thread>;
+using DispatchCB = std::function<void (EncodedAccessUnit &au)>;
+
+/* The dispatch stage: routing, dumps and per consumer backpressure run on a thread of their own,
+ * the encoders only encode and hand their access units over. EOF (or an interrupt) reaches the
+ * callback as an access unit without bitstream, the thread ends after it.
+ */
+class SVCDispatcher {
+public:
+    SVCDispatcher(const SyncQueueLimits &limits);
+
+    ~SVCDispatcher();
+
+    int start(DispatchCB dispatch);
+
+    // blocks while the dispatch queue is full
+    void put(EncodedAccessUnit &&au);
+
+    size_t queueSize();
+
+    void interrupt();
+
+    // RETURN: true if the dispatching thread has exited (or never started) within timeoutMs
+    bool waitFinished(int timeoutMs);
+
+    void stop();
+
+    DispatcherThread &thread();
+
+private:
+    std::shared_ptr<SyncQueue<EncodedAccessUnit>> queue_;
+
+    DispatcherThread thread_;
+
+    std::promise<void> finishedPromise_;
+
+    std::shared_future<void> finished_;
+};
+
+using SVCDispatcherShr = std::shared_ptr<SVCDispatcher>;
+
+#endif /* SVCDispatcher_hpp */
@@ -6,22 +6,41 @@
 //
 
 #include "SVCEncoder.hpp"
+#include "CodecPool.hpp"
 
-SVCEncoder::SVCEncoder(int maxSize): pictureQueue_(std::make_shared<SyncQueue<SSourcePicture>>(maxSize)), svcEncoder_(NULL), encoderInitialized_(false), encoderThread_(NULL){}
+SVCEncoder::SVCEncoder(const SyncQueueLimits &limits): pictureQueue_(std::make_shared<SyncQueue<SVCPicture>>(limits)), svcEncoder_(NULL), encoderInitialized_(false), encoderThread_(NULL), forceIntraFrame_(false), lastEncodeMs_(0), tuning_(SVCTuningFile::builtin()), intraPeriod_(SVC_ENCODER_INTRA_PERIOD), sourceFrameRate_(SVC_ENCODER_FRAME_RATE){}
 
 SVCEncoder::~SVCEncoder(){}
 
+int SVCEncoder::defaultParams(SEncParamExt &param) {
+    // GetDefaultParams needs an instance, it is asked once per process
+    static int status = -1;
+    static SEncParamExt defaults;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        ISVCEncoder *encoder = NULL;
+        if (WelsCreateSVCEncoder(&encoder) != cmResultSuccess || !encoder) {
+            return;
+        }
+        
+        memset(&defaults, 0, sizeof(SEncParamExt));
+        encoder->GetDefaultParams(&defaults);
+        WelsDestroySVCEncoder(encoder);
+        status = 0;
+    });
+    
+    param = defaults;
+    return status;
+}
+
 int SVCEncoder::initSVCEncoder(int width, int height, int temporalNum, int spatialNum, std::vector<SpatialData> &spatials) {
-    TagEncParamExt encParam;
-    auto ret = WelsCreateSVCEncoder(&svcEncoder_);
-    if (cmResultSuccess != ret) {
+    auto &encParam = encParam_;
+    if (defaultParams(encParam)) {
         return -1;
     }
     
-    memset(&encParam, 0, sizeof(SEncParamExt));
-    svcEncoder_->GetDefaultParams(&encParam);
     encParam.iUsageType = CAMERA_VIDEO_REAL_TIME;
-    encParam.fMaxFrameRate = 25;
+    encParam.fMaxFrameRate = sourceFrameRate_;
     encParam.iPicWidth = width;
     encParam.iPicHeight = height;
     encParam.iRCMode = RC_QUALITY_MODE;
@@ -30,29 +49,40 @@ int SVCEncoder::initSVCEncoder(int width, int height, int temporalNum, int spati
     encParam.bEnableAdaptiveQuant = false;
     encParam.bEnableFrameSkip = false;  //true
     encParam.bEnableLongTermReference = false;
-    encParam.uiIntraPeriod = 50;
+    encParam.uiIntraPeriod = intraPeriod_;
     encParam.eSpsPpsIdStrategy = CONSTANT_ID;
     encParam.bPrefixNalAddingCtrl = false;
     encParam.iSpatialLayerNum = spatialNum;
     encParam.iTemporalLayerNum = temporalNum;
+    if (tuning_.encoderThreads >= 0) {
+        encParam.iMultipleThreadIdc = tuning_.encoderThreads;
+    }
+    if (tuning_.encoderComplexity >= 0) {
+        encParam.iComplexityMode = static_cast<ECOMPLEXITY_MODE>(std::min(tuning_.encoderComplexity, static_cast<int>(HIGH_COMPLEXITY)));
+    }
 
     for (auto i = spatialNum - 1; i >= 0; i--) {
         auto item = spatials.at(i);
         encParam.iTargetBitrate += item.bitrate;
         encParam.sSpatialLayers[i].iVideoWidth = item.width;
         encParam.sSpatialLayers[i].iVideoHeight = item.height;
-        encParam.sSpatialLayers[i].fFrameRate = 25;
+        encParam.sSpatialLayers[i].fFrameRate = layerFrameRate(item.frameRate, sourceFrameRate_, temporalNum);
         encParam.sSpatialLayers[i].iSpatialBitrate = item.bitrate;
         encParam.sSpatialLayers[i].iMaxSpatialBitrate = item.bitrate * 3 >> 1;
+        if (tuning_.encoderSlices > 1) {    // slices are what the encoder threads work on in parallel
+            encParam.sSpatialLayers[i].sSliceArgument.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+            encParam.sSpatialLayers[i].sSliceArgument.uiSliceNum = tuning_.encoderSlices;
+        }
     }
     
-    ret = svcEncoder_->InitializeExt(&encParam);
-    if (ret != 0) {
-        return ret;
+    // an idle encoder of the same layout from an earlier session if there is one
+    svcEncoder_ = CodecPool::shared().takeEncoder(encParam);
+    if (!svcEncoder_) {
+        return -2;
     }
     
     encoderInitialized_ = true;
-    return ret;
+    return 0;
 }
 
 int SVCEncoder::start(NotifySVCDecoderCB notifySVCDecoder) {
@@ -60,14 +90,16 @@ int SVCEncoder::start(NotifySVCDecoderCB notifySVCDecoder) {
         return -1;
     }
     
+    finished_ = finishedPromise_.get_future().share();
     encoderThread_ =
     std::make_shared<std::thread>([this] (NotifySVCDecoderCB notifySVCDecoder) {
         SFrameBSInfo encodedInfo;
-        SSourcePicture i420Picture;
+        SVCPicture sourcePic;
         while (true) {
-            memset(&i420Picture, 0, sizeof(SSourcePicture));
-            pictureQueue_->front(i420Picture);
-            if (i420Picture.iPicWidth <= 0 || i420Picture.iPicHeight <= 0) {   // time to break
+            sourcePic = SVCPicture();
+            pictureQueue_->front(sourcePic);
+            auto &i420Picture = sourcePic.picture;
+            if (!sourcePic.buffer || i420Picture.iPicWidth <= 0 || i420Picture.iPicHeight <= 0) {   // time to break
                 break;
             }
             
@@ -75,43 +107,103 @@ int SVCEncoder::start(NotifySVCDecoderCB notifySVCDecoder) {
                 break;
             }
             
-            memset(&encodedInfo, 0, sizeof(SFrameBSInfo));
-            auto status = svcEncoder_->EncodeFrame(&i420Picture, &encodedInfo);
+            auto status = encode(sourcePic, &encodedInfo);
             if (notifySVCDecoder) {
                 notifySVCDecoder(false, status, &encodedInfo);
             }
-            
-            delete [] i420Picture.pData[0];
-            delete [] i420Picture.pData[1];
-            delete [] i420Picture.pData[2];
         }
         
+        sourcePic = SVCPicture();   // planes go back to the pool
+        
         if (notifySVCDecoder) { // send a terminal signal
             notifySVCDecoder(true, 0, NULL);
         }
         
-        if (svcEncoder_) {
-            svcEncoder_->Uninitialize();
-            WelsDestroySVCEncoder(svcEncoder_);
-        }
-        
+        release();
+        finishedPromise_.set_value();
     }, notifySVCDecoder);
 
     return 0;
 }
 
-void SVCEncoder::put(SSourcePicture &&sourcePic) {
+void SVCEncoder::setTuning(const SVCTuning &tuning) {
+    tuning_ = tuning;
+}
+
+void SVCEncoder::setIntraPeriod(unsigned int frames) {
+    intraPeriod_ = std::max(frames, 1u);
+}
+
+void SVCEncoder::setSourceFrameRate(float fps) {
+    sourceFrameRate_ = fps > 0 ? fps : SVC_ENCODER_FRAME_RATE;
+}
+
+float SVCEncoder::layerFrameRate(float cap, float sourceFps, int temporalNum) {
+    auto rate = sourceFps;
+    for (auto dropped = 0; cap > 0 && rate > cap && dropped < temporalNum - 1; dropped++) {
+        rate /= 2;
+    }
+    
+    return rate;
+}
+
+int SVCEncoder::encode(SVCPicture &sourcePic, SFrameBSInfo *pEncodedInfo) {
+    if (!encoderInitialized_ || !svcEncoder_) {
+        return -1;
+    }
+    
+    if (forceIntraFrame_.exchange(false)) {
+        svcEncoder_->ForceIntraFrame(true);
+    }
+    
+    memset(pEncodedInfo, 0, sizeof(SFrameBSInfo));
+    auto encodeBegin = std::chrono::steady_clock::now();
+    auto status = svcEncoder_->EncodeFrame(&sourcePic.picture, pEncodedInfo);
+    lastEncodeMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeBegin).count();
+    return status;
+}
+
+double SVCEncoder::lastEncodeMs() {
+    return lastEncodeMs_;
+}
+
+void SVCEncoder::release() {
+    if (svcEncoder_) {
+        CodecPool::shared().giveEncoder(svcEncoder_, encParam_);
+        svcEncoder_ = NULL;
+    }
+}
+
+void SVCEncoder::forceIntraFrame() {
+    forceIntraFrame_ = true;
+}
+
+void SVCEncoder::put(SVCPicture &&sourcePic) {
     if (!pictureQueue_) {
         return;
     }
     
-    pictureQueue_->put(std::forward<SSourcePicture>(sourcePic));
+    pictureQueue_->put(std::forward<SVCPicture>(sourcePic));
+}
+
+bool SVCEncoder::waitFinished(int timeoutMs) {
+    if (!finished_.valid()) {
+        return true;
+    }
+    
+    return finished_.wait_for(std::chrono::milliseconds(timeoutMs)) == std::future_status::ready;
 }
 
 void SVCEncoder::stop() {
     if (encoderThread_ && encoderThread_->joinable()) {
         encoderThread_->join();
     }
+    
+    release();  // never started: encode() was called inline
+}
+
+EncoderThread &SVCEncoder::thread() {
+    return encoderThread_;
 }
 
 void SVCEncoder::interrupt() {
@@ -10,46 +10,132 @@
 
 #include <stdio.h>
 #include <thread>
+#include <future>
 #include <vector>
 #include <memory>
 #include <iostream>
 #include "SyncQueue.hpp"
+#include "BufferPool.hpp"
+#include "SVCTuning.hpp"
 #include "svc/codec_api.h"
 
+#define SVC_ENCODER_INTRA_PERIOD    50      // pictures from one IDR to the next
+#define SVC_ENCODER_FRAME_RATE      25      // if the source does not tell its own
+
 struct SpatialData {
     int width;
     int height;
     int bitrate;
+    float frameRate;    // cap of this layer, 0 for the source rate; coded at the source rate halved per dropped temporal layer
+};
+
+// an I420 picture whose planes live in buffer, a NULL buffer means EOF
+struct SVCPicture {
+    SSourcePicture picture;
+    MediaBufferShr buffer;
 };
 
 using SpatialData = struct SpatialData;
+using SVCPicture = struct SVCPicture;
+
+template <>
+struct SyncQueueItemBytes<SVCPicture> {
+    static size_t bytes(const SVCPicture &pic) {
+        return pic.buffer ? pic.buffer->capacity() : 0;
+    }
+};
+
+// a simulcast level of the source size encodes the source buffer itself, it is charged once
+template <>
+struct SyncQueueItemBudget<SVCPicture> {
+    static size_t bytes(const SVCPicture &pic) {
+        return SyncQueueItemBytes<SVCPicture>::bytes(pic);
+    }
+
+    static const void *key(const SVCPicture &pic) {
+        return pic.buffer.get();
+    }
+};
+
 using EncoderThread = std::shared_ptr<std::thread>;
-using PictureQueue = std::shared_ptr<SyncQueue<SSourcePicture>>;
+using PictureQueue = std::shared_ptr<SyncQueue<SVCPicture>>;
 using NotifySVCDecoderCB= std::function<void (bool eof, int status, SFrameBSInfo *pEncodedInfo)>;
 
 class SVCEncoder {
 public:
-    SVCEncoder(int maxSize);
+    SVCEncoder(const SyncQueueLimits &limits);
     
     ~SVCEncoder();
     
     int initSVCEncoder(int width, int height, int temporalNum, int spatialNum, std::vector<SpatialData> &spatials);
     
+    // threads, complexity and slices of the next initSVCEncoder, -1 keeps OpenH264's default
+    void setTuning(const SVCTuning &tuning);
+    
+    // pictures from one IDR to the next of the next initSVCEncoder, 1 makes every picture an IDR
+    void setIntraPeriod(unsigned int frames);
+    
+    // frame rate of the pictures put / encoded, the base of every layer's cap. Before initSVCEncoder
+    void setSourceFrameRate(float fps);
+    
+    /* the rate a layer capped at cap is coded at: OpenH264 drops whole temporal layers of a spatial layer,
+     * so it is sourceFps / 2^k, at most temporalNum - 1 halvings
+     */
+    static float layerFrameRate(float cap, float sourceFps, int temporalNum);
+    
     int start(NotifySVCDecoderCB notifySVCDecoder);
     
-    void put(SSourcePicture && sourcePic);
+    void put(SVCPicture && sourcePic);
+    
+    /* encode on the calling thread instead of start() + put(), for a fused pipeline
+     * RETURN: status of EncodeFrame
+     */
+    int encode(SVCPicture &sourcePic, SFrameBSInfo *pEncodedInfo);
+    
+    // how long the last EncodeFrame took, only meaningful on the encoding thread
+    double lastEncodeMs();
+    
+    // the next picture is encoded as an IDR, callable from any thread
+    void forceIntraFrame();
     
     void interrupt();
     
+    // RETURN: true if the encoding thread has exited (or never started) within timeoutMs
+    bool waitFinished(int timeoutMs);
+    
     void stop();
+    
+    EncoderThread &thread();
+    
+private:
+    void release();
+    
+    // OpenH264's defaults, RETURN: 0 if successful
+    static int defaultParams(SEncParamExt &param);
             
 private:
     bool encoderInitialized_;
     
     ISVCEncoder *svcEncoder_;
     
+    SEncParamExt encParam_;                     // it was taken from / goes back to the CodecPool with
+    
     PictureQueue pictureQueue_;
 
     EncoderThread encoderThread_;
+    
+    std::atomic_bool forceIntraFrame_;          // applied on the encoder thread, the encoder is not thread safe
+    
+    double lastEncodeMs_;
+    
+    SVCTuning tuning_;
+    
+    unsigned int intraPeriod_;
+    
+    float sourceFrameRate_;
+    
+    std::promise<void> finishedPromise_;
+    
+    std::shared_future<void> finished_;
 };
 #endif /* SVCEncoder_hpp */
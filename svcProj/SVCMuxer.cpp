@@ -0,0 +1,240 @@
+//
+//  SVCMuxer.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <string>
+#include "SVCMuxer.hpp"
+#include "NalScanner.hpp"
+
+SVCMuxer::SVCMuxer(const std::string &path, const std::string &format, int fragmentMs): path_(path), fragmentMs_(fragmentMs), outCtx_(NULL), videoStream_(NULL), headerWritten_(false), failed_(false), videoFrames_(0), audioPackets_(0), lastVideoDts_(AV_NOPTS_VALUE) {
+    auto ret = avformat_alloc_output_context2(&outCtx_, NULL, format.empty() ? NULL : format.c_str(), path_.c_str());
+    if (ret < 0 || !outCtx_) {
+        av_log(NULL, AV_LOG_ERROR, "SVCMuxer: can not create output for %s, ret = %d\n", path_.c_str(), ret);
+        failed_ = true;
+    }
+}
+
+SVCMuxer::~SVCMuxer() {
+    close();
+}
+
+int SVCMuxer::addVideoStream(int width, int height) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (failed_ || videoStream_) {
+        return -1;
+    }
+
+    videoStream_ = avformat_new_stream(outCtx_, NULL);
+    if (!videoStream_) {
+        return -2;
+    }
+
+    videoStream_->time_base = (AVRational){1, 1000};    // encoder timestamps are milliseconds
+    videoStream_->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    videoStream_->codecpar->codec_id = AV_CODEC_ID_H264;
+    videoStream_->codecpar->format = AV_PIX_FMT_YUV420P;
+    videoStream_->codecpar->width = width;
+    videoStream_->codecpar->height = height;
+    return 0;
+}
+
+int SVCMuxer::addAudioStream(AVStream *source) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (failed_ || !source || headerWritten_) {
+        return -1;
+    }
+
+    auto stream = avformat_new_stream(outCtx_, NULL);
+    if (!stream) {
+        return -2;
+    }
+
+    auto ret = avcodec_parameters_copy(stream->codecpar, source->codecpar);
+    if (ret < 0) {
+        return ret;
+    }
+
+    stream->codecpar->codec_tag = 0;    // let the container pick its own tag
+    stream->time_base = source->time_base;
+    audioStreams_[source] = stream;
+    return 0;
+}
+
+int SVCMuxer::writeHeader(const unsigned char *au, int size) {
+    // SPS/PPS of the IDR become the extradata, the subset SPS of the enhancement layers stays in band
+    std::string extradata;
+    NalScanner::scan(au, size, [&extradata](const NalUnit &nal) {
+        if (nal.type == NAL_TYPE_SPS || nal.type == NAL_TYPE_PPS) {
+            extradata.append((const char *)nal.data, nal.size);
+        }
+    });
+
+    if (extradata.empty()) {
+        av_log(NULL, AV_LOG_ERROR, "SVCMuxer: IDR of %s carries no SPS/PPS\n", path_.c_str());
+        return -1;
+    }
+
+    auto par = videoStream_->codecpar;
+    par->extradata = static_cast<uint8_t *>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (!par->extradata) {
+        return AVERROR(ENOMEM);
+    }
+    memcpy(par->extradata, extradata.data(), extradata.size());
+    par->extradata_size = static_cast<int>(extradata.size());
+
+    if (!(outCtx_->oformat->flags & AVFMT_NOFILE)) {
+        auto ret = avio_open(&outCtx_->pb, path_.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "SVCMuxer: can not open %s, ret = %d\n", path_.c_str(), ret);
+            return ret;
+        }
+    }
+
+    AVDictionary *options = NULL;
+    auto name = outCtx_->oformat->name;
+    if (strstr(name, "mp4") || strstr(name, "mov")) {  // fragments that start at keyframes, playable while written
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        if (fragmentMs_ > 0) {
+            av_dict_set_int(&options, "frag_duration", (int64_t)fragmentMs_ * 1000, 0);
+        }
+    } else if (strstr(name, "matroska") || strstr(name, "webm")) {
+        if (fragmentMs_ > 0) {
+            av_dict_set_int(&options, "cluster_time_limit", fragmentMs_, 0);
+        }
+    }
+
+    auto ret = avformat_write_header(outCtx_, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "SVCMuxer: can not write header of %s, ret = %d\n", path_.c_str(), ret);
+        return ret;
+    }
+
+    headerWritten_ = true;
+    av_dump_format(outCtx_, 0, path_.c_str(), 1);
+
+    // audio that came in while waiting for the IDR
+    while (!pendingAudio_.empty()) {
+        auto &front = pendingAudio_.front();
+        writeAudioLocked(front.first, front.second);
+        pendingAudio_.pop_front();
+    }
+
+    return 0;
+}
+
+void SVCMuxer::writeVideo(const unsigned char *au, int size, long long timestampMs, bool idr) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (failed_ || !videoStream_ || size <= 0) {
+        return;
+    }
+
+    if (!headerWritten_) {
+        if (!idr) {     // nothing is decodable before the first IDR
+            return;
+        }
+
+        if (writeHeader(au, size)) {
+            failed_ = true;
+            return;
+        }
+    }
+
+    auto pkt = H264Decoder::allocPacket();
+    if (!pkt || av_new_packet(pkt.get(), size) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "SVCMuxer: no memory for a video packet, drop it\n");
+        return;
+    }
+
+    memcpy(pkt->data, au, size);
+    pkt->stream_index = videoStream_->index;
+    pkt->pts = av_rescale_q(timestampMs, (AVRational){1, 1000}, videoStream_->time_base);
+    if (lastVideoDts_ != AV_NOPTS_VALUE && pkt->pts <= lastVideoDts_) {    // millisecond timestamps may collide
+        pkt->pts = lastVideoDts_ + 1;
+    }
+    pkt->dts = pkt->pts;
+    lastVideoDts_ = pkt->dts;
+    if (idr) {
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    auto ret = av_interleaved_write_frame(outCtx_, pkt.get());
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "SVCMuxer: failed to write video of %s, ret = %d\n", path_.c_str(), ret);
+        return;
+    }
+
+    videoFrames_++;
+}
+
+void SVCMuxer::writeAudio(const AVPacket *pkt, AVStream *source) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (failed_ || !pkt || audioStreams_.find(source) == audioStreams_.end()) {
+        return;
+    }
+
+    auto ref = H264Decoder::allocPacket();
+    if (!ref || av_packet_ref(ref.get(), pkt) < 0) {
+        return;
+    }
+
+    if (!headerWritten_) {
+        if (pendingAudio_.size() >= SVC_MUXER_MAX_PENDING_AUDIO) {
+            pendingAudio_.pop_front();
+        }
+        pendingAudio_.push_back(std::make_pair(ref, source));
+        return;
+    }
+
+    writeAudioLocked(ref, source);
+}
+
+void SVCMuxer::writeAudioLocked(AVPacketShr &pkt, AVStream *source) {
+    auto stream = audioStreams_[source];
+    pkt->stream_index = stream->index;
+    pkt->pos = -1;
+    av_packet_rescale_ts(pkt.get(), source->time_base, stream->time_base);
+    auto ret = av_interleaved_write_frame(outCtx_, pkt.get());
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_WARNING, "SVCMuxer: failed to write audio of %s, ret = %d\n", path_.c_str(), ret);
+        return;
+    }
+
+    audioPackets_++;
+}
+
+int SVCMuxer::close() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (!outCtx_) {
+        return failed_ ? -1 : 0;
+    }
+
+    auto ret = 0;
+    if (headerWritten_) {
+        av_interleaved_write_frame(outCtx_, NULL);  // flush the interleaving queue
+        ret = av_write_trailer(outCtx_);
+        av_log(NULL, AV_LOG_INFO, "SVCMuxer: %s closed, video frames = %lld, audio packets = %lld\n", path_.c_str(), videoFrames_, audioPackets_);
+    } else {
+        av_log(NULL, AV_LOG_WARNING, "SVCMuxer: %s got no IDR, nothing written\n", path_.c_str());
+        ret = -1;
+    }
+
+    if (outCtx_->pb && !(outCtx_->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&outCtx_->pb);
+    }
+
+    avformat_free_context(outCtx_);
+    outCtx_ = NULL;
+    videoStream_ = NULL;
+    audioStreams_.clear();
+    pendingAudio_.clear();
+    return ret;
+}
+
+const std::string &SVCMuxer::path() {
+    return path_;
+}
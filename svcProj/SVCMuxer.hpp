@@ -0,0 +1,82 @@
+//
+//  SVCMuxer.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef SVCMuxer_hpp
+#define SVCMuxer_hpp
+
+#include <stdio.h>
+#include <map>
+#include <list>
+#include <mutex>
+#include <string>
+#include <memory>
+#include "H264Decoder.hpp"
+
+extern "C"
+{
+    #include "libavformat/avformat.h"
+}
+
+#define SVC_MUXER_MAX_PENDING_AUDIO     1024    // audio packets kept while waiting for the first IDR
+
+class SVCMuxer;
+using SVCMuxerShr = std::shared_ptr<SVCMuxer>;
+
+/* Writes one (T, S) operating point as fragmented MP4 or Matroska, audio of the input is
+ * remuxed untouched next to it. The header goes out with the first IDR, whose SPS/PPS
+ * become the extradata, audio that arrives before that is held back.
+ * Enhancement layer NALs (prefix/slice extension) stay in band: a plain H.264 player shows
+ * the base layer, an SVC aware decoder gets the whole operating point.
+ * writeVideo() and writeAudio() may be called from different threads.
+ */
+class SVCMuxer {
+public:
+    /* path: output file, format: "mp4", "matroska"..., empty to guess it from path
+     * fragmentMs: fragment (mp4) / cluster (mkv) duration, short ones keep the latency low
+     */
+    SVCMuxer(const std::string &path, const std::string &format, int fragmentMs);
+
+    ~SVCMuxer();
+
+    // RETURN: 0 if successful
+    int addVideoStream(int width, int height);
+
+    // copy the parameters of an input audio stream, RETURN: 0 if successful
+    int addAudioStream(AVStream *source);
+
+    // one access unit in Annex-B, timestampMs on the encoder clock
+    void writeVideo(const unsigned char *au, int size, long long timestampMs, bool idr);
+
+    // the payload is referenced, not copied, source is the input stream the packet comes from
+    void writeAudio(const AVPacket *pkt, AVStream *source);
+
+    // write the trailer, RETURN: 0 if successful
+    int close();
+
+    const std::string &path();
+
+private:
+    int writeHeader(const unsigned char *au, int size);
+
+    void writeAudioLocked(AVPacketShr &pkt, AVStream *source);
+
+private:
+    std::mutex mutex_;
+    std::string path_;
+    int fragmentMs_;
+    AVFormatContext *outCtx_;
+    AVStream *videoStream_;
+    bool headerWritten_;
+    bool failed_;
+    long long videoFrames_;
+    long long audioPackets_;
+    long long lastVideoDts_;
+    std::map<AVStream *, AVStream *> audioStreams_;                 // input stream -> output stream
+    std::list<std::pair<AVPacketShr, AVStream *>> pendingAudio_;    // before the header
+};
+
+#endif /* SVCMuxer_hpp */
@@ -6,9 +6,20 @@
 //
 
 #include "SVCProj.hpp"
+#include "CodecPool.hpp"
 #include "Localize.hpp"
+#include "FrameHash.hpp"
 
-SVCProj::SVCProj(int temporalNum, int spatialNum, std::initializer_list<SpatialData> spatialList): svcTemporalNum_(temporalNum), svcSpatialNum_(spatialNum), stop_(false), fmtCtx_(NULL), readThread_(NULL), svcH264Decoders_(SVCDecoderShrVec(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, NULL)), h264Decoder_(NULL), started_(false), svcH264Encoder_(NULL), syncQueueMaxSize_(50) {
+#define SVC_BUFFER_POOL_IDLE_BYTES  (64 << 20)    // released pictures/NALs kept around for reuse
+#define SVC_SHM_RING_BYTES          (8 << 20)     // access units exported per operating point
+#define SVC_SHM_RING_SLOTS          1024          // access units a reader may fall behind by
+#define SVC_SHM_RING_PICTURES       8             // decoded pictures exported per operating point
+
+SVCSessionConfig::SVCSessionConfig(): syncQueueMaxSize(50), syncQueueMaxBytes(0), syncQueueMaxLatencyMs(0), startupOptions({false, 0, 0, false}), encodeMode(SVC_ENCODE_LAYERED), pipelineMode(SVC_PIPELINE_QUEUED), overflowPolicies(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, SVC_OVERFLOW_BLOCK), temporalMode(SVC_TEMPORAL_PER_DECODER), tuning(SVCTuningFile::builtin()), frameLimit(0), rangeBeginMs(0), rangeEndMs(0), rangeOriginMs(0), preview(false), multiTrack(false), verifyMode(HASH_MANIFEST_NONE), shmFrames(false), shmRingBytes(0), adaptive(false), adaptiveSettings(AdaptiveReceiver::defaultSettings()), lazyDecoders(false) {}
+
+SVCProj::SVCProj(int temporalNum, int spatialNum, std::initializer_list<SpatialData> spatialList): SVCProj(temporalNum, spatialNum, SpatialDataVec(spatialList)) {}
+
+SVCProj::SVCProj(int temporalNum, int spatialNum, const SpatialDataVec &spatialList): svcTemporalNum_(temporalNum), svcSpatialNum_(spatialNum), stop_(false), h264Stream_(NULL), fmtCtx_(NULL), readThread_(NULL), svcH264Decoders_(SVCDecoderShrVec(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, NULL)), layerViews_(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM), verifyFailures_(0), nextSubscriptionId_(0), decoderRefs_(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, 0), decoderSynced_(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, true), decoderDisconnected_(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, false), routesReady_(false), h264Decoder_(NULL), started_(false), svcH264Encoder_(NULL), overflowDrops_(MAX_SPATIAL_LAYER_NUM * MAX_TEMPORAL_LAYER_NUM, 0), sourcePictures_(0), codedPictures_(MAX_SPATIAL_LAYER_NUM, 0), parent_(NULL), memoryBudget_(nullptr), bufferPool_(BufferPool::create(SVC_BUFFER_POOL_IDLE_BYTES)), pendingInits_(0), pendingDecoderInits_(0) {
     
     svcTemporalNum_ = std::max(std::min(svcTemporalNum_, MAX_TEMPORAL_LAYER_NUM), 1);
     svcSpatialNum_ = std::max(std::min(static_cast<int>(spatialList.size()), std::min(svcSpatialNum_, MAX_SPATIAL_LAYER_NUM)), 1);
@@ -20,7 +31,11 @@ SVCProj::SVCProj(int temporalNum, int spatialNum, std::initializer_list<SpatialD
 
 SVCProj::~SVCProj()
 {
-    if (fmtCtx_) {
+    if (started_) { // never leave stage threads running on a dead session
+        stop(SVC_SHUTDOWN_DISCARD);
+    }
+    
+    if (fmtCtx_ && !parent_) {  // a track only borrows the input of its session
         avformat_close_input(&fmtCtx_);
     }
 }
@@ -33,331 +48,1927 @@ void SVCProj::start(std::string &url, std::string &dumpDir, int maxSize, int log
     }
     
     started_ = true;
+    resetStartupTimings();
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        tracks_.clear();
+    }
+    
+    if (config_.tuning.queueMaxSize > 0) {
+        maxSize = config_.tuning.queueMaxSize;
+    }
+    
     if (maxSize > 0) {
-        syncQueueMaxSize_ = maxSize;
+        config_.syncQueueMaxSize = maxSize;
+    } else if (config_.syncQueueMaxBytes > 0 || memoryBudget_) {  // byte budgets replace the item count
+        config_.syncQueueMaxSize = 0;
+    }
+    
+    if (placement_) {   // codec worker threads created below inherit the caller's placement
+        placement_->bindCurrentThread();
     }
     
     auto ret = openInputSourceMedia(url, logLevel);
     if (ret) {
         av_log(NULL, AV_LOG_ERROR, "call open_input_url failed, ret = %d\n", ret);
+        if (placement_) {
+            placement_->restoreCurrentThread();
+        }
         return ;
     }
     
+    seekToRange();
+    config_.dumpDataDir = dumpDir;
+    trackTag_ = config_.multiTrack ? "V" + std::to_string(h264Stream_->index) + "_" : "";
+    startChain();
+    createTracks();
+    
+    // read packet from input media file
+    startReadThread();
+    bindStageThreads();
+}
+
+// h264 decoder -> svc encoder -> svc decoders of h264Stream_, started but not fed yet
+void SVCProj::startChain() {
     auto picWidth = h264Stream_->codecpar->width;
     auto picHeight = h264Stream_->codecpar->height;
     av_log(NULL, AV_LOG_DEBUG, "OpenInput: media_width = %d, media_height = %d\n", picWidth, picHeight);
     
-    dumpDataDir_ = dumpDir;
     correctSpatialData();    // correct some data like spatials
     
     av_log(NULL, AV_LOG_DEBUG, "OpenInput: svcTemporalNum = %d, svcSpatialNum = %d\n", svcTemporalNum_, svcSpatialNum_);
     // 1. init one h264 decoder
     initH264Decoder();
     
-    // 2. init one svc encoder
-    initSVCH264Encoder(picWidth, picHeight);
+    // 2. create one svc encoder and several svc spatial decoders, their queues take data before the codecs are ready
+    createSVCH264Encoder();
+    createDispatcher();
+    createSVCH264Decoders();
+    createAdaptiveReceivers();
+    createMuxers();
+    pendingDecoderInits_ = static_cast<int>(svcH264Decoders_.size() - std::count(svcH264Decoders_.begin(), svcH264Decoders_.end(), nullptr));
+    pendingInits_ = 1 + pendingDecoderInits_;
+    if (pendingDecoderInits_ == 0) {    // lazy and nobody subscribed yet
+        markStartup(startupTimings_.decodersInit, "svc decoders initialized");
+    }
     
-    // 4. init several svc spatial decoders
-    initSVCH264Decoders();
+    // 3. init them, a fast start does it concurrently while the first packets are already being decoded
+    if (config_.startupOptions.fastStart) {
+        if (config_.pipelineMode == SVC_PIPELINE_FUSED) {  // the h264 decoder thread encodes, the encoder has to be there first
+            initSVCH264Encoder(picWidth, picHeight);
+        } else {
+            startupTasks_.push_back(std::async(std::launch::async, [this, picWidth, picHeight] {
+                initSVCH264Encoder(picWidth, picHeight);
+            }));
+        }
         
-    // read packet from input media file
-    readThread_ = std::make_shared<std::thread>([this]{
-        while (!stop_) {
-            AVPacket pkt;
-            av_init_packet(&pkt);
-            auto read_ret = av_read_frame(fmtCtx_, &pkt);
-            if (read_ret < 0 ) {
-                av_packet_unref(&pkt);
-                av_log(NULL, AV_LOG_ERROR, "readThread: Failed to read frame, ret = %d\n", read_ret);
-                break;
-            }
-                    
-            if (fmtCtx_->streams[pkt.stream_index] != h264Stream_) { // only video to decode
-                av_packet_unref(&pkt);
+        for (size_t i = 0; i < svcH264Decoders_.size(); i++) {
+            if (svcH264Decoders_.at(i) == NULL) {
                 continue;
             }
             
-            // send packet to H264 decoder queue
-            if (!h264Decoder_) {
-                break;
+            startupTasks_.push_back(std::async(std::launch::async, [this, i] {
+                initSVCH264Decoder(i);
+            }));
+        }
+    } else {
+        initSVCH264Encoder(picWidth, picHeight);
+        for (size_t i = 0; i < svcH264Decoders_.size(); i++) {
+            if (svcH264Decoders_.at(i) != NULL) {
+                initSVCH264Decoder(i);
             }
-            
-            h264Decoder_->put(std::forward<AVPacket>(pkt));
         }
-    });
+    }
 }
 
-SVCProj* SVCProj::interrupt() {
-    stop_ = true;
+SVCProj *SVCProj::setVideoTracks(const std::vector<int> &streamIndexes) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: video tracks must be set before start\n");
+        return this;
+    }
+    
+    config_.multiTrack = true;
+    config_.videoTracks = streamIndexes;
     return this;
 }
 
-void SVCProj::stop() {
-    if (!started_) {
-        av_log(NULL, AV_LOG_WARNING, "warning: SVCProj has not started.......");
-        return;
-    }
-    
-    started_ = false;
-    
-    if (readThread_) {
-        readThread_->join();
+SVCProj *SVCProj::track(int streamIndex) {
+    if (h264Stream_ && h264Stream_->index == streamIndex) {
+        return this;
     }
     
-    if (h264Decoder_) { // stop h264 decoder
-        AVPacket nullPkt = {.data = NULL, .size = 0};
-        h264Decoder_->put(std::forward<AVPacket>(nullPkt));
-        h264Decoder_->stop();
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    for (auto it = tracks_.begin(); it != tracks_.end(); it++) {
+        if ((*it)->h264Stream_->index == streamIndex) {
+            return it->get();
+        }
     }
     
-    if (svcH264Encoder_) {  // stop svc encoder
-        svcH264Encoder_->stop();
+    return NULL;
+}
+
+bool SVCProj::selectedTrack(int streamIndex) {
+    if (fmtCtx_->streams[streamIndex]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+        return false;
     }
     
-    for (auto it = svcH264Decoders_.begin(); it != svcH264Decoders_.end(); it++) {    // stop all svc decoders
-        if (*it == NULL) {
+    return !config_.multiTrack || config_.videoTracks.empty() || std::find(config_.videoTracks.begin(), config_.videoTracks.end(), streamIndex) != config_.videoTracks.end();
+}
+
+// every selected video track after the first gets a chain of its own, fed by the read thread of this session
+void SVCProj::createTracks() {
+    std::vector<std::shared_ptr<SVCProj>> tracks;
+    for (auto i = static_cast<unsigned int>(h264Stream_->index + 1); config_.multiTrack && i < fmtCtx_->nb_streams; i++) {
+        if (!selectedTrack(i)) {
             continue;
         }
         
-        (*it)->stop();
+        auto stream = fmtCtx_->streams[i];
+        if (stream->codecpar->width <= 0 || stream->codecpar->height <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "createTracks: video stream %d has no picture size, skipped\n", i);
+            continue;
+        }
+        
+        auto track = createTrack(stream);
+        track->startChain();
+        tracks.push_back(track);
+        av_log(NULL, AV_LOG_INFO, "createTracks: video stream %d, %dx%d\n", i, stream->codecpar->width, stream->codecpar->height);
     }
+    
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    tracks_ = tracks;
 }
 
-int SVCProj::openInputSourceMedia(std::string &url, int logLevel)
-{
-    if (url.empty()) {
-        av_log(NULL, AV_LOG_ERROR, "%s is invalid\n", url.c_str());
-        return -1;
-    }
-    
-    avformat_network_init();
-    av_log_set_level(logLevel);
-    auto ret = avformat_open_input(&fmtCtx_, url.c_str(), NULL, NULL);
-    if (ret) {
-        av_log(NULL, AV_LOG_ERROR, "Couldn't open input stream, ret = %d\n", ret);
-        return ret;
-    }
+// a session for stream that shares the input, buffers, placement and budget of this one
+std::shared_ptr<SVCProj> SVCProj::createTrack(AVStream *stream) {
+    auto track = std::make_shared<SVCProj>(svcTemporalNum_, svcSpatialNum_, spatialSettings_);  // the top layer is corrected to stream
+    track->parent_ = this;
+    track->fmtCtx_ = fmtCtx_;
+    track->h264Stream_ = stream;
+    track->trackTag_ = "V" + std::to_string(stream->index) + "_";
+    track->started_ = true;
+    track->resetStartupTimings();
+    track->config_ = config_;
+    track->memoryBudget_ = memoryBudget_;
+    track->bufferPool_ = bufferPool_;
+    track->placement_ = placement_;
+    track->changeDetector_ = changeDetector_ ? std::make_shared<FrameChangeDetector>(changeDetector_->settings()) : nullptr;    // its own reference picture
     
-    
-    ret = avformat_find_stream_info(fmtCtx_, NULL);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Couldn't find stream information");
-        return ret;
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    track->subscriptions_ = subscriptions_;     // same ids, unsubscribe() is forwarded
+    track->nextSubscriptionId_ = (stream->index + 1) << 20;    // its own subscriptions never collide with them
+    return track;
+}
+
+SVCProj *SVCProj::setPreviewMode(const std::vector<int> &spatialIds) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: preview mode must be set before start\n");
+        return this;
     }
     
-    for (auto i = 0; i < fmtCtx_->nb_streams; i++) {
-        if (fmtCtx_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            h264Stream_ = fmtCtx_->streams[i];
-            break;
+    config_.preview = true;
+    config_.previewSpatials.clear();
+    for (auto it = spatialIds.begin(); it != spatialIds.end(); it++) {
+        if (*it < 0 || *it >= svcSpatialNum_) {
+            av_log(NULL, AV_LOG_ERROR, "setPreviewMode: S%d is not a spatial layer of this session\n", *it);
+            continue;
+        }
+        
+        if (std::find(config_.previewSpatials.begin(), config_.previewSpatials.end(), *it) == config_.previewSpatials.end()) {
+            config_.previewSpatials.push_back(*it);
         }
     }
+    std::sort(config_.previewSpatials.begin(), config_.previewSpatials.end());   // the encoder wants them from small to large
     
-    if (!h264Stream_) {
-        av_log(NULL, AV_LOG_ERROR, "this file has NO video stream\n");
-        return -2;
+    svcTemporalNum_ = 1;    // an IDR is all base layer, there is nothing for T1+ to carry
+    return this;
+}
+
+SVCProj *SVCProj::setTimeRange(long long beginMs, long long endMs) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: time range must be set before start\n");
+        return this;
     }
     
-    av_dump_format(fmtCtx_, 0, url.c_str(), 0);
-
-    return 0;
+    config_.rangeBeginMs = std::max(beginMs, 0LL);
+    config_.rangeEndMs = endMs > config_.rangeBeginMs ? endMs : 0;
+    return this;
 }
 
-void SVCProj::correctSpatialData() {
-    auto originWidth = h264Stream_->codecpar->width;
-    auto originHeight = h264Stream_->codecpar->height;
-    while (spatialSettings_.size() > svcSpatialNum_) {
-        spatialSettings_.pop_back();
+// the keyframe before the range begins, the pictures up to it are only decoded
+void SVCProj::seekToRange() {
+    config_.rangeOriginMs = fmtCtx_->start_time != AV_NOPTS_VALUE ? av_rescale(fmtCtx_->start_time, 1000, AV_TIME_BASE) : 0;
+    if (config_.rangeBeginMs <= 0) {
+        return;
     }
     
-    auto largest = spatialSettings_.at(svcSpatialNum_ - 1);
-    if (largest.width != originWidth || largest.height != originHeight) {
-        largest.width = originWidth;
-        largest.height = originHeight;
-        spatialSettings_.at(svcSpatialNum_ - 1) = largest;
+    auto target = av_rescale(config_.rangeOriginMs + config_.rangeBeginMs, AV_TIME_BASE, 1000);
+    auto ret = avformat_seek_file(fmtCtx_, -1, INT64_MIN, target, target, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_WARNING, "SVCProj: can not seek to %lld ms, decoding from the start, ret = %d\n", config_.rangeBeginMs, ret);
     }
 }
 
-SSourcePicture &&SVCProj::createSSourcePicture(AVFrame *frame) {
-    SSourcePicture sourcePic;
-    memset(&sourcePic, 0, sizeof(SSourcePicture));
-    sourcePic.iPicWidth = frame->width;
-    sourcePic.iPicHeight = frame->height;
-    sourcePic.iColorFormat = videoFormatI420;
-    sourcePic.iStride[0] = sourcePic.iPicWidth;
-    sourcePic.iStride[1] = sourcePic.iPicWidth >> 1;
-    sourcePic.iStride[2] = sourcePic.iPicWidth >> 1;
-    
-    auto y_size = frame->width * frame->height;
-    sourcePic.pData[0] = new unsigned char[y_size];
-    memcpy(sourcePic.pData[0], frame->data[0], y_size);
-    
-    auto u_size = frame->width * frame->height >> 2;
-    sourcePic.pData[1] = new unsigned char[u_size];
-    memcpy(sourcePic.pData[1], frame->data[1], u_size);
-    
-    auto v_size = frame->width * frame->height >> 2;
-    sourcePic.pData[2] = new unsigned char[v_size];
-    memcpy(sourcePic.pData[2], frame->data[2], v_size);
-    
+long long SVCProj::frameTimestampMs(AVFrame *frame) {
     AVRational dst_timebase = (AVRational){1, 1000};
     AVRational src_timebase = h264Stream_->time_base;
-    sourcePic.uiTimeStamp = av_rescale_q_rnd(frame->pts, src_timebase, dst_timebase, AV_ROUND_DOWN);
-    return std::move(sourcePic);
+    return av_rescale_q_rnd(frame->pts, src_timebase, dst_timebase, AV_ROUND_DOWN);
 }
 
-void SVCProj::initH264Decoder() {
-    h264Decoder_ = std::make_shared<H264Decoder>(syncQueueMaxSize_);
-    auto status = h264Decoder_->initH264Decoder(h264Stream_);
-    av_log(NULL, AV_LOG_DEBUG, "initH264Decoder: status = %d\n", status);
-    h264Decoder_->start([this](bool eof, int status, AVFrame* frame) {
-        if (eof) {
-            SSourcePicture nullSourcePic;
-            av_log(NULL, AV_LOG_DEBUG, "H264Decoder: send a terminal signal to SVC spatial encoder\n");
-            memset(&nullSourcePic, 0, sizeof(SSourcePicture));
-            svcH264Encoder_->put(std::move(nullSourcePic));
-            return;
-        }
-        
-        if (status < 0) {
-            av_log(NULL, AV_LOG_ERROR, "H264Decoder: frame is not available\n");
-            return;
-        }
-        
-        // send I420 picture to SVC Spatial encoder
-        SSourcePicture spatialPic = createSSourcePicture(frame);
-        svcH264Encoder_->put(std::move(spatialPic));
-    });
+// decode order, AV_NOPTS_VALUE if unknown
+long long SVCProj::packetTimestampMs(AVPacket *pkt, AVStream *stream) {
+    auto ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    return ts != AV_NOPTS_VALUE ? av_rescale_q(ts, stream->time_base, (AVRational){1, 1000}) : AV_NOPTS_VALUE;
 }
 
-void SVCProj::initSVCH264Encoder(int width, int height) {
-    svcH264Encoder_ = std::make_shared<SVCEncoder>(syncQueueMaxSize_);
-    auto status = svcH264Encoder_->initSVCEncoder(width, height, svcTemporalNum_, svcSpatialNum_, spatialSettings_);
-    av_log(NULL, AV_LOG_DEBUG, "initSVCH264Encoder: status = %d\n", status);
-    svcH264Encoder_->start([this](bool eof, int status, SFrameBSInfo *pEncodedInfo) {
-        if (eof) {  // EOF
-            av_log(NULL, AV_LOG_DEBUG, "SVCH264Encoder: send a terminaate signal to all SVC Temporal decoders\n");
-            for (auto it = svcH264Decoders_.begin(); it != svcH264Decoders_.end(); it++) {
-                if(*it == NULL) {
-                    continue;
-                }
-                
-                SVCH264Data nullData = { .compressedDataLen = 0, .compressedData = NULL};
-                (*it)->put(std::move(nullData));
+bool SVCProj::inTimeRange(long long timestampMs) {
+    if (timestampMs < config_.rangeOriginMs + config_.rangeBeginMs) {
+        return false;
+    }
+    
+    return config_.rangeEndMs <= 0 || timestampMs < config_.rangeOriginMs + config_.rangeEndMs;
+}
+
+// path with _v<stream index> in front of its extension if several tracks are processed
+std::string SVCProj::trackPath(const std::string &path) {
+    if (trackTag_.empty()) {
+        return path;
+    }
+    
+    auto suffix = "_v" + std::to_string(h264Stream_->index);
+    auto dot = path.find_last_of('.');
+    auto slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + suffix;
+    }
+    
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+void SVCProj::startReadThread() {
+    readThread_ = std::make_shared<std::thread>([this]{
+        std::vector<int> videoPackets(fmtCtx_->nb_streams, 0); // per video stream, the frame limit holds for each track
+        size_t chainsAtLimit = 0;
+        auto ranged = config_.rangeBeginMs > 0 || config_.rangeEndMs > 0;
+        std::vector<bool> pastRange(fmtCtx_->nb_streams, false);   // video streams whose decode order passed the range end
+        size_t chainsPastRange = 0;
+        while (!stop_) {
+            auto pkt = H264Decoder::allocPacket();
+            if (!pkt) {
+                av_log(NULL, AV_LOG_ERROR, "readThread: Failed to alloc packet\n");
+                break;
             }
-            return ;
-        }
-        
-        // not EOF
-        if (pEncodedInfo->eFrameType == videoFrameTypeInvalid || pEncodedInfo->eFrameType == videoFrameTypeSkip) {
-            av_log(NULL, AV_LOG_ERROR, "SVCH264Encoder: frame type is invalid, frameType = %d\n", pEncodedInfo->eFrameType);
-            return;
-        }
-        
-        //  dispatch SVC H264 compressed data to corresponding SVC decoder correctly
-        /* 1. spatial rules
-         * 低分辨率是基本层，增强层是建立在基本层之上的差值。故:高分辨率需要将基本层与对应的增强层组合
-         * 例如：完整的1080p的NAL = NAL_360p(基本层) + NAL_480p(增强层) + NAL_720p(增强层) + NAL_1080p(增强层)
-         * 2. temporal rules
-         * iTemporalLayerNum 的值为 1 时，使用 uiGopSize = 1 的配置，即每一帧为一组，每一组的uiTemporalId 值为 0
-         * iTemporalLayerNum 的值为 2 时，使用 uiGopSize = 2 的配置，即每两帧为一组，每一组中对应的uiTemporalId 为 [0, 1]
-         * iTemporalLayerNum 的值为 3 时，使用 uiGopSize = 4 的配置，即每四帧为一组，每一组中对应的uiTemporalId 为 [0, 2, 1, 2]
-         * iTemporalLayerNum 的值为 4 时，使用 uiGopSize = 8 的配置，即每八帧为一组，每一组中对应的uiTemporalId 为 [0, 3, 2, 3, 1, 3, 2, 3]
-         */
-        
-        // 每一次只有一个temporalId但是可能有多个spatialId, temporal层面的NAL不需要拼接， Spatial层面的NAL需要拼接。
-        auto totalLayerNum = pEncodedInfo->iLayerNum;
-        for (auto curLayerIndex = 0; curLayerIndex < totalLayerNum; curLayerIndex++) {
-            auto curLayerInfo = pEncodedInfo->sLayerInfo[curLayerIndex];
-            auto curSpatialId = curLayerInfo.uiSpatialId;
-            auto curTemporalId = curLayerInfo.uiTemporalId;
-            av_log(NULL, AV_LOG_DEBUG, "svcH264Encoder: temporal_id = %d, spatial_id = %d\n", curTemporalId, curSpatialId);
-
-            auto totalSize = 0; // 计算出某空域NAL所需要的完整数据大小，因为spatial NAL是按照低分辨率到高分辨率出场的, 累加即可。
-            for (auto i = 0; i <= curLayerIndex; i++) {
-                auto tmp = pEncodedInfo->sLayerInfo[i];
-                for (auto nalIdx = 0; nalIdx < tmp.iNalCount; nalIdx++) {
-                    totalSize += tmp.pNalLengthInByte[nalIdx];
+            
+            auto read_ret = av_read_frame(fmtCtx_, pkt.get());
+            if (read_ret < 0 ) {
+                av_log(NULL, AV_LOG_ERROR, "readThread: Failed to read frame, ret = %d\n", read_ret);
+                break;
+            }
+                    
+            auto stream = fmtCtx_->streams[pkt->stream_index];
+            SVCProj *chain = stream == h264Stream_ ? this : NULL;
+            for (auto track = tracks_.begin(); !chain && track != tracks_.end(); track++) {
+                chain = (*track)->h264Stream_ == stream ? track->get() : NULL;
+            }
+            
+            auto timestampMs = ranged ? packetTimestampMs(pkt.get(), stream) : AV_NOPTS_VALUE;
+            if (chain && timestampMs != AV_NOPTS_VALUE && config_.rangeEndMs > 0 && timestampMs >= config_.rangeOriginMs + config_.rangeEndMs) {
+                // decode order: nothing after it is shown before the end, the rest of this stream is not needed
+                if (!pastRange.at(pkt->stream_index)) {
+                    pastRange.at(pkt->stream_index) = true;
+                    if (++chainsPastRange == 1 + tracks_.size()) {
+                        av_log(NULL, AV_LOG_INFO, "readThread: end of the range reached at %lld ms\n", timestampMs - config_.rangeOriginMs);
+                        break;
+                    }
                 }
+                continue;
             }
             
-            /* T0 需要 temporalId = {0}的NAL,
-             * T1 需要 temporalId = {0, 1}的NAL,
-             * T2 需要 temporalId = {0, 1, 2}的NAL,
-             * T3 需要 temporalId = {0, 1, 2, 3}的NAL
-             * 即 NAL的temporal = 0时，需要向 T0，T1，T2，T3 发送。
-             * NAL的temporal = 1时，需要向T1，T2，T3 发送。
-             * 以此类推....
-             */
-            for (auto temporalId = 0; temporalId < svcTemporalNum_ - curTemporalId; temporalId++) {
-                // 根据上面的提示， 给需要temporalId=x的decoder发送完整的NAL，必须得到目标decoder。
-                auto decoderAt = (svcTemporalNum_ - temporalId - 1) * MAX_SPATIAL_LAYER_NUM + curSpatialId;
-                auto svcDecoder = svcH264Decoders_.at(decoderAt);
-                if (svcDecoder == NULL) {
-                    av_log(NULL, AV_LOG_ERROR, "SVCH264Encoder: Fatal Something Wrong\n");
+            if (!chain) { // only video to decode, audio goes straight to the muxers
+                if (stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO || (timestampMs != AV_NOPTS_VALUE && !inTimeRange(timestampMs))) {
                     continue;
                 }
                 
-                // 组合spatial NAL(多个NAL组合成一个一个完整的NAL)
-                auto bufferPtrOffset = 0;
-                auto pBuf = new unsigned char[totalSize];
-                for (auto j = 0; j <= curLayerIndex; j++) {
-                    auto totalSizeOfCurrentLayerInfo = 0;
-                    auto tmp = pEncodedInfo->sLayerInfo[j];
-                    for (auto nalIdx = 0; nalIdx < tmp.iNalCount; nalIdx++) {
-                        totalSizeOfCurrentLayerInfo += tmp.pNalLengthInByte[nalIdx];
-                    }
-                    
-                    memcpy(pBuf + bufferPtrOffset, tmp.pBsBuf, totalSizeOfCurrentLayerInfo);
-                    bufferPtrOffset += totalSizeOfCurrentLayerInfo;
+                for (auto it = muxers_.begin(); it != muxers_.end(); it++) {
+                    (*it)->writeAudio(pkt.get(), stream);
                 }
                 
-                // dispatch NAL
-                SVCH264Data data = { .compressedDataLen = totalSize, .compressedData = pBuf, .timestamp = pEncodedInfo->uiTimeStamp};
-                if (svcDecoder->dumpSvcHandler()) { // dump svc compressed data into file
-                    svcDecoder->dumpSvcHandler()->write(pBuf, totalSize);
+                for (auto track = tracks_.begin(); track != tracks_.end(); track++) {
+                    for (auto it = (*track)->muxers_.begin(); it != (*track)->muxers_.end(); it++) {
+                        (*it)->writeAudio(pkt.get(), stream);
+                    }
                 }
-                svcDecoder->put(std::move(data));
+                continue;
+            }
+            
+            if (config_.preview && !(pkt->flags & AV_PKT_FLAG_KEY)) {    // the decoder would skip it anyway, save the queue hop
+                continue;
+            }
+            
+            auto &packets = videoPackets.at(pkt->stream_index);
+            if (config_.frameLimit > 0 && packets >= config_.frameLimit) {
+                continue;
+            }
+            
+            if (chain->h264Decoder_) {
+                // send packet to H264 decoder queue, the ones before the range too: they lead up to its first picture
+                chain->h264Decoder_->put(std::move(pkt));
+                packets++;
+            } else {    // its chain failed to start, nothing to feed, the other tracks go on
+                packets = config_.frameLimit;
+            }
+            
+            if (config_.frameLimit > 0 && packets >= config_.frameLimit && ++chainsAtLimit == 1 + tracks_.size()) {
+                av_log(NULL, AV_LOG_INFO, "readThread: frame limit %d reached on every track\n", config_.frameLimit);
+                break;
             }
         }
     });
 }
 
-void SVCProj::initSVCH264Decoders() {
-    for (auto i = 0; i < svcTemporalNum_; i++) {
-        for (auto j = 0; j < svcSpatialNum_; j++) {
-            auto item = spatialSettings_.at(j);
-            std::string uniqueTag = "SVC_T";
-            uniqueTag.append(std::to_string(i)).append("_").append(std::to_string(item.width)).append("x").append(std::to_string(item.height));
-            auto svcDecoder = std::make_shared<SVCDecoder>(syncQueueMaxSize_, dumpDataDir_, std::move(uniqueTag));
-            auto status = svcDecoder->initSVCDecoder();
-            av_log(NULL, AV_LOG_DEBUG, "initSVCH264Decoders: status = %d\n", status);
-            svcH264Decoders_.at(i * MAX_SPATIAL_LAYER_NUM + j) = svcDecoder;
-            svcDecoder->start([this](bool eof, int status, SBufferInfo *pDecodedInfo, uchar **ppDst, SVCDecoder *thiz){
-                if (eof) {
-                    av_log(NULL, NULL, "SVCH264Decoder[%s]: time to Game Over, Bye...\n", thiz->tag().c_str());
-                    return;
-                }
-                
-                if (status || pDecodedInfo->iBufferStatus != 1) {
-                    av_log(NULL, AV_LOG_DEBUG, "SVCH264Decoder[%s]: Decoded Data is Unavailable, status: %d, bufferStatus: %d\n",
-                           thiz->tag().c_str(), status, pDecodedInfo->iBufferStatus);
-                    return;
-                }
-                
-                // can print some info about decoded yuv
-                auto inTimestamp = pDecodedInfo->uiInBsTimeStamp;
-                auto outTimestamp = pDecodedInfo->uiOutYuvTimeStamp;
-                auto width = pDecodedInfo->UsrData.sSystemBuffer.iWidth;
-                auto height = pDecodedInfo->UsrData.sSystemBuffer.iHeight;
-                auto strideY = pDecodedInfo->UsrData.sSystemBuffer.iStride[0];
-                auto strideUV = pDecodedInfo->UsrData.sSystemBuffer.iStride[1];
-
-                av_log(NULL, AV_LOG_DEBUG, "SVCH264Decoder[%s]: outTimestamp: %lld, inTimestamp: %lld, width: %d, height: %d, stideY: %d, strideUV: %d\n",
-                       thiz->tag().c_str(), outTimestamp, inTimestamp, width, height, strideY, strideUV);
-                if (thiz->dumpYuvHandler()) {   // dump yuv which is decoded from svc into file
-                    thiz->dumpYuvHandler()->write(ppDst, strideY, width, height);
-                }
-            });
-        }
+SVCProj *SVCProj::setEncodeMode(SVCEncodeMode mode) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: encode mode must be set before start\n");
+        return this;
+    }
+    
+    config_.encodeMode = mode;
+    return this;
+}
+
+SVCProj *SVCProj::setPipelineMode(SVCPipelineMode mode) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: pipeline mode must be set before start\n");
+        return this;
+    }
+    
+    config_.pipelineMode = mode;
+    return this;
+}
+
+SVCProj *SVCProj::setOverflowPolicy(SVCOverflowPolicy policy) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: overflow policy must be set before start\n");
+        return this;
+    }
+    
+    std::fill(config_.overflowPolicies.begin(), config_.overflowPolicies.end(), policy);
+    return this;
+}
+
+SVCProj *SVCProj::setOverflowPolicy(int temporalId, int spatialId, SVCOverflowPolicy policy) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: overflow policy must be set before start\n");
+        return this;
+    }
+    
+    if (temporalId < 0 || temporalId >= MAX_TEMPORAL_LAYER_NUM || spatialId < 0 || spatialId >= MAX_SPATIAL_LAYER_NUM) {
+        av_log(NULL, AV_LOG_ERROR, "setOverflowPolicy: T%d S%d is out of range\n", temporalId, spatialId);
+        return this;
+    }
+    
+    config_.overflowPolicies.at(decoderSlot(temporalId, spatialId)) = policy;
+    return this;
+}
+
+SVCProj *SVCProj::setTuning(const SVCTuning &tuning) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: tuning must be set before start\n");
+        return this;
+    }
+    
+    config_.tuning = tuning;
+    if (config_.tuning.fused >= 0) {
+        config_.pipelineMode = config_.tuning.fused ? SVC_PIPELINE_FUSED : SVC_PIPELINE_QUEUED;
+    }
+    return this;
+}
+
+int SVCProj::loadTuning(const std::string &path) {
+    auto tuning = config_.tuning;
+    auto ret = SVCTuningFile::load(path, tuning);
+    if (ret) {
+        av_log(NULL, AV_LOG_WARNING, "warning: can not read tuning %s, ret = %d\n", path.c_str(), ret);
+        return ret;
+    }
+    
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: tuning must be loaded before start\n");
+        return -2;
+    }
+    
+    setTuning(tuning);
+    av_log(NULL, AV_LOG_INFO, "SVCProj: tuning %s applied\n", path.c_str());
+    return 0;
+}
+
+SVCProj *SVCProj::setFrameLimit(int frames) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: frame limit must be set before start\n");
+        return this;
+    }
+    
+    config_.frameLimit = std::max(frames, 0);
+    return this;
+}
+
+StageTimingsShr SVCProj::stageTimings() {
+    return stageTimings_;
+}
+
+SVCProj *SVCProj::setTemporalMode(SVCTemporalMode mode) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: temporal mode must be set before start\n");
+        return this;
+    }
+    
+    config_.temporalMode = mode;
+    return this;
+}
+
+SVCProj *SVCProj::setFrameOutput(SVCFrameOutputCB frameOutput) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: frame output must be set before start\n");
+        return this;
+    }
+    
+    config_.frameOutput = frameOutput;
+    return this;
+}
+
+SVCProj *SVCProj::addMuxOutput(int temporalId, int spatialId, const std::string &path, const std::string &format, int fragmentMs) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: mux outputs must be added before start\n");
+        return this;
     }
+    
+    if (path.empty()) {
+        return this;
+    }
+    
+    config_.muxOutputs.push_back(SVCMuxOutput{temporalId, spatialId, path, format, fragmentMs});
+    return this;
+}
+
+void SVCProj::createMuxers() {
+    for (auto it = config_.muxOutputs.begin(); it != config_.muxOutputs.end(); it++) {
+        if (it->temporalId < 0 || it->temporalId >= svcTemporalNum_ || it->spatialId < 0 || it->spatialId >= svcSpatialNum_) {
+            av_log(NULL, AV_LOG_ERROR, "createMuxers: T%d S%d is not an operating point of this session\n", it->temporalId, it->spatialId);
+            continue;
+        }
+        
+        auto &view = layerViews_.at(it->temporalId * MAX_SPATIAL_LAYER_NUM + it->spatialId);
+        auto muxer = std::make_shared<SVCMuxer>(trackPath(it->path), it->format, it->fragmentMs);
+        auto spatial = spatialSettings_.at(it->spatialId);
+        if (muxer->addVideoStream(spatial.width, spatial.height)) {
+            av_log(NULL, AV_LOG_ERROR, "createMuxers: can not mux %s into %s\n", view.tag.c_str(), it->path.c_str());
+            continue;
+        }
+        
+        for (unsigned int i = 0; i < fmtCtx_->nb_streams; i++) {
+            if (fmtCtx_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                muxer->addAudioStream(fmtCtx_->streams[i]);
+            }
+        }
+        
+        view.muxer = muxer;
+        muxers_.push_back(muxer);
+    }
+}
+
+SVCProj *SVCProj::setAdaptiveReceivers(const AdaptiveSettings &settings) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: adaptive receivers must be set before start\n");
+        return this;
+    }
+    
+    config_.adaptive = true;
+    config_.adaptiveSettings = settings;
+    return this;
+}
+
+void SVCProj::createAdaptiveReceivers() {
+    adaptiveReceivers_.clear();
+    if (!config_.adaptive) {
+        return;
+    }
+    
+    if (config_.temporalMode == SVC_TEMPORAL_SHARED) {   // a shared decoder feeds every lower T, it can not step down for them
+        av_log(NULL, AV_LOG_WARNING, "warning: adaptive receivers need a decoder per operating point, ignored\n");
+        return;
+    }
+    
+    std::lock_guard<std::mutex> locker(adaptiveMutex_);
+    adaptiveReceivers_.assign(svcH264Decoders_.size(), nullptr);
+    for (size_t i = 0; i < svcH264Decoders_.size(); i++) {
+        if (svcH264Decoders_.at(i)) {
+            adaptiveReceivers_.at(i) = createAdaptiveReceiver(i);
+        }
+    }
+}
+
+AdaptiveReceiverShr SVCProj::createAdaptiveReceiver(int layerAt) {
+    auto sourceFps = sourceFrameRate();
+    std::vector<int> spatialAreas;
+    std::vector<float> spatialFrameRates;
+    for (auto it = spatialSettings_.begin(); it != spatialSettings_.end(); it++) {
+        spatialAreas.push_back(it->width * it->height);
+        spatialFrameRates.push_back(it->frameRate);
+    }
+    
+    return std::make_shared<AdaptiveReceiver>(layerViews_.at(layerAt).tag, layerAt / MAX_SPATIAL_LAYER_NUM, layerAt % MAX_SPATIAL_LAYER_NUM,
+                                              svcTemporalNum_, spatialAreas, spatialFrameRates, sourceFps, config_.adaptiveSettings);
+}
+
+/* feed a layer to every adaptive receiver whose current operating point it belongs to,
+ * a full queue drops it instead of holding up the encoder and the other receivers
+ */
+void SVCProj::dispatchAdaptive(SVCDecoderShrVec &routes, long long timestamp, int temporalId, int spatialId, MediaBufferShr &buffer, int size) {
+    std::lock_guard<std::mutex> locker(adaptiveMutex_);
+    for (size_t i = 0; i < adaptiveReceivers_.size(); i++) {
+        auto &receiver = adaptiveReceivers_.at(i);
+        if (!receiver || !routes.at(i) || !receiver->wants(temporalId, spatialId)) {
+            continue;
+        }
+        
+        SVCH264Data data;
+        data.timestamp = timestamp;
+        data.temporalId = temporalId;
+        data.compressedDataLen = size;
+        data.compressedData = buffer;
+        if (routes.at(i)->tryPut(std::move(data))) {
+            receiver->onDelivered();
+        } else {
+            receiver->onDropped(temporalId);
+        }
+    }
+}
+
+void SVCProj::closeMuxers() {
+    for (auto it = layerViews_.begin(); it != layerViews_.end(); it++) {
+        it->muxer = nullptr;
+    }
+    
+    for (auto it = muxers_.begin(); it != muxers_.end(); it++) {
+        (*it)->close();
+    }
+    
+    muxers_.clear();
+}
+
+SVCProj *SVCProj::setChangeDetection(const ChangeDetectionSettings &settings) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: change detection must be set before start\n");
+        return this;
+    }
+    
+    changeDetector_ = std::make_shared<FrameChangeDetector>(settings);
+    return this;
+}
+
+SVCProj *SVCProj::setVerification(HashManifestMode mode, const std::string &manifestDir) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: verification must be set before start\n");
+        return this;
+    }
+    
+    config_.verifyMode = manifestDir.empty() ? HASH_MANIFEST_NONE : mode;
+    config_.manifestDir = manifestDir;
+    return this;
+}
+
+SVCProj *SVCProj::setShmExport(const std::string &prefix, bool frames, size_t ringBytes) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: shared memory export must be set before start\n");
+        return this;
+    }
+    
+    config_.shmPrefix = prefix;
+    config_.shmFrames = frames;
+    config_.shmRingBytes = ringBytes ? ringBytes : SVC_SHM_RING_BYTES;
+    return this;
+}
+
+void SVCProj::createShmRings(int layerAt, int width, int height) {
+    auto &view = layerViews_.at(layerAt);
+    auto temporalId = layerAt / MAX_SPATIAL_LAYER_NUM, spatialId = layerAt % MAX_SPATIAL_LAYER_NUM;
+    auto name = config_.shmPrefix + "_" + trackTag_ + "T" + std::to_string(temporalId) + "_S" + std::to_string(spatialId);
+    view.auRing = std::make_shared<ShmRingWriter>(name + ".au", config_.shmRingBytes, SVC_SHM_RING_SLOTS);
+    if (view.auRing->create(SHM_RING_ACCESS_UNITS, view.tag, temporalId, spatialId, width, height)) {
+        av_log(NULL, AV_LOG_ERROR, "createShmRings: %s is not exported\n", view.tag.c_str());
+        view.auRing = nullptr;
+    }
+    
+    if (!config_.shmFrames) {
+        return;
+    }
+    
+    size_t pictureBytes = (size_t)width * height * 3 / 2;
+    view.frameRing = std::make_shared<ShmRingWriter>(name + ".yuv", SVC_SHM_RING_PICTURES * pictureBytes, SVC_SHM_RING_PICTURES);
+    if (view.frameRing->create(SHM_RING_I420_FRAMES, view.tag, temporalId, spatialId, width, height)) {
+        av_log(NULL, AV_LOG_ERROR, "createShmRings: pictures of %s are not exported\n", view.tag.c_str());
+        view.frameRing = nullptr;
+    }
+}
+
+void SVCProj::closeShmRings() {
+    for (auto it = layerViews_.begin(); it != layerViews_.end(); it++) {
+        if (it->auRing) {
+            it->auRing->close();
+        }
+        
+        if (it->frameRing) {
+            it->frameRing->close();
+        }
+        
+        it->auRing = nullptr;
+        it->frameRing = nullptr;
+    }
+}
+
+int SVCProj::verifyFailures() {
+    auto failures = verifyFailures_;
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    for (auto it = tracks_.begin(); it != tracks_.end(); it++) {
+        failures += (*it)->verifyFailures();
+    }
+    return failures;
+}
+
+void SVCProj::closeManifests() {
+    if (config_.verifyMode == HASH_MANIFEST_NONE) {
+        return;
+    }
+    
+    auto manifests = 0;
+    verifyFailures_ = 0;
+    for (auto it = layerViews_.begin(); it != layerViews_.end(); it++) {
+        if (it->auHash) {
+            verifyFailures_ += it->auHash->close() ? 1 : 0;
+            manifests++;
+        }
+        
+        if (it->frameHash) {
+            verifyFailures_ += it->frameHash->close() ? 1 : 0;
+            manifests++;
+        }
+        
+        it->auHash = nullptr;
+        it->frameHash = nullptr;
+    }
+    
+    av_log(NULL, verifyFailures_ ? AV_LOG_ERROR : AV_LOG_INFO, "SVCProj %s: %d manifests, %d failed, hash = %s (%s)\n",
+           config_.verifyMode == HASH_MANIFEST_RECORD ? "record" : "verify", manifests, verifyFailures_, FrameHash::name(), FrameHash::implementation());
+}
+
+SVCProj *SVCProj::setStartupOptions(const StartupOptions &options) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: startup options must be set before start\n");
+        return this;
+    }
+    
+    config_.startupOptions = options;
+    return this;
+}
+
+void SVCProj::resetStartupTimings() {
+    startupBegin_ = std::chrono::steady_clock::now();
+    startupTimings_.open = -1;
+    startupTimings_.probe = -1;
+    startupTimings_.h264DecoderInit = -1;
+    startupTimings_.encoderInit = -1;
+    startupTimings_.decodersInit = -1;
+    startupTimings_.firstFrameDecoded = -1;
+    startupTimings_.firstFrameEncoded = -1;
+    startupTimings_.firstFrameSVCDecoded = -1;
+}
+
+void SVCProj::markStartup(std::atomic<long long> &phase, const char *name) {
+    if (phase.load(std::memory_order_relaxed) >= 0) {  // only the first time counts
+        return;
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startupBegin_).count();
+    long long expected = -1;
+    if (phase.compare_exchange_strong(expected, elapsed)) {
+        av_log(NULL, AV_LOG_INFO, "SVCProj startup: %s at %lld ms\n", name, (long long)elapsed);
+    }
+}
+
+void SVCProj::waitStartup() {
+    for (auto it = startupTasks_.begin(); it != startupTasks_.end(); it++) {
+        if (it->valid()) {
+            it->wait();
+        }
+    }
+    
+    startupTasks_.clear();
+}
+
+void SVCProj::onStartupFinished() {
+    av_log(NULL, AV_LOG_INFO, "SVCProj startup(%s): open = %lld, probe = %lld, h264 decoder = %lld, svc encoder = %lld, svc decoders = %lld, first frame decoded = %lld ms\n",
+           config_.startupOptions.fastStart ? "fast" : "sequential", startupTimings_.open.load(), startupTimings_.probe.load(), startupTimings_.h264DecoderInit.load(),
+           startupTimings_.encoderInit.load(), startupTimings_.decodersInit.load(), startupTimings_.firstFrameDecoded.load());
+    
+    if (placement_) {
+        placement_->report();
+    }
+}
+
+SVCProj *SVCProj::setPlacement(const PlacementPolicy &policy) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: placement must be set before start\n");
+        return this;
+    }
+    
+    placement_ = std::make_shared<ThreadPlacement>(policy);
+    if (!placement_->enabled() && policy.hugePages == HUGE_PAGE_NONE) {
+        placement_ = nullptr;
+        return this;
+    }
+    
+    bufferPool_->setPlacement(policy.numaNode, policy.hugePages);
+    return this;
+}
+
+// svc encoder and decoder threads are bound by initSVCH264Encoder/initSVCH264Decoder, they may still be starting
+void SVCProj::bindStageThreads() {
+    if (!placement_) {
+        return;
+    }
+    
+    if (readThread_) {
+        placement_->bindThread(*readThread_, "read");
+    }
+    
+    if (h264Decoder_ && h264Decoder_->thread()) {
+        placement_->bindThread(*h264Decoder_->thread(), "h264 decoder");
+    }
+    
+    placement_->restoreCurrentThread();
+    bufferPool_->report("session");
+}
+
+SVCProj* SVCProj::interrupt() {
+    stop_ = true;
+    return this;
+}
+
+void SVCProj::stop(SVCShutdownMode mode, int drainTimeoutMs) {
+    if (!started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: SVCProj has not started.......");
+        return;
+    }
+    
+    started_ = false;
+    waitStartup();  // every stage has to exist before it can be drained or interrupted
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);   // subscriptions from now on wait for the next start
+        routesReady_ = false;
+    }
+    
+    if (mode == SVC_SHUTDOWN_DISCARD) { // unblock every put/front, queued data is released by its owner
+        stop_ = true;
+        interruptStages();
+    }
+    
+    if (readThread_) {
+        readThread_->join();
+    }
+    
+    std::vector<std::future<void>> trackStops;  // nothing feeds the tracks any more, they drain next to this chain
+    for (auto it = tracks_.begin(); it != tracks_.end(); it++) {
+        auto track = *it;
+        trackStops.push_back(std::async(std::launch::async, [track, mode, drainTimeoutMs] {
+            track->stop(mode, drainTimeoutMs);
+        }));
+    }
+    
+    auto drainStart = std::chrono::steady_clock::now();
+    auto eofQueued = true;
+    if (h264Decoder_) { // EOF travels through h264 decoder -> svc encoder -> svc decoders, a stuck decoder must not hold stop() forever
+        eofQueued = h264Decoder_->put(AVPacketShr(), std::max(drainTimeoutMs, 0));
+    }
+    
+    auto spentMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - drainStart).count();
+    if (!eofQueued || !waitStagesFinished(drainTimeoutMs - static_cast<int>(spentMs))) {
+        if (mode == SVC_SHUTDOWN_DRAIN) {
+            av_log(NULL, AV_LOG_WARNING, "SVCProj: drain did not finish in %d ms, discard the rest\n", drainTimeoutMs);
+        }
+        interruptStages();
+    }
+    
+    if (h264Decoder_) { // stop h264 decoder
+        h264Decoder_->stop();
+    }
+    
+    if (svcH264Encoder_) {  // stop svc encoder
+        svcH264Encoder_->stop();
+    }
+    
+    if (simulcastEncoder_) {
+        simulcastEncoder_->stop();
+    }
+    
+    if (dispatcher_) {  // it feeds the decoders, they go after it
+        dispatcher_->stop();
+    }
+    
+    auto decoders = liveDecoders();
+    for (auto it = decoders.begin(); it != decoders.end(); it++) {    // stop all svc decoders
+        if (*it == NULL) {
+            continue;
+        }
+        
+        (*it)->stop();
+    }
+    
+    closeManifests();   // every stage is gone, nobody adds hashes any more
+    if (changeDetector_) {
+        changeDetector_->report();
+    }
+    closeMuxers();
+    closeShmRings();    // readers see the rings closed and read what is left
+    
+    if (stageTimings_) {
+        stageTimings_->report(config_.pipelineMode == SVC_PIPELINE_FUSED ? "fused" : "queued");
+    }
+    
+    for (auto it = adaptiveReceivers_.begin(); it != adaptiveReceivers_.end(); it++) {
+        if (*it) {
+            (*it)->report();
+        }
+    }
+    
+    reportOverflows();
+    reportFrameRates();
+    for (auto it = trackStops.begin(); it != trackStops.end(); it++) {
+        it->wait();
+    }
+    
+    if (parent_) {  // pools, budget and logger are the session's, it reports them
+        return;
+    }
+    
+    CodecPool::shared().report();
+    
+    if (memoryBudget_) {
+        av_log(NULL, AV_LOG_INFO, "SVCProj: queued bytes peak = %zu, budget = %zu\n", memoryBudget_->peakBytes(), memoryBudget_->maxBytes());
+    }
+    
+    Logger::shared().flush();   // what this session logged is out once stop returns
+}
+
+SVCProj *SVCProj::setMemoryBudget(size_t queueMaxBytes, size_t sessionMaxBytes, int queueMaxLatencyMs) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: memory budget must be set before start\n");
+        return this;
+    }
+    
+    config_.syncQueueMaxBytes = queueMaxBytes;
+    config_.syncQueueMaxLatencyMs = std::max(queueMaxLatencyMs, 0);
+    memoryBudget_ = sessionMaxBytes > 0 ? std::make_shared<MemoryBudget>(sessionMaxBytes) : nullptr;
+    return this;
+}
+
+SyncQueueLimits SVCProj::queueLimits() {
+    return SyncQueueLimits(config_.syncQueueMaxSize, config_.syncQueueMaxBytes, config_.syncQueueMaxLatencyMs, memoryBudget_);
+}
+
+void SVCProj::interruptStages() {
+    if (h264Decoder_) {
+        h264Decoder_->interrupt();
+    }
+    
+    if (svcH264Encoder_) {
+        svcH264Encoder_->interrupt();
+    }
+    
+    if (simulcastEncoder_) {
+        simulcastEncoder_->interrupt();
+    }
+    
+    if (dispatcher_) {
+        dispatcher_->interrupt();
+    }
+    
+    for (auto it = tracks_.begin(); it != tracks_.end(); it++) {    // the read thread may wait on one of them
+        (*it)->interruptStages();
+    }
+    
+    auto decoders = liveDecoders();
+    for (auto it = decoders.begin(); it != decoders.end(); it++) {
+        if (*it == NULL) {
+            continue;
+        }
+        
+        (*it)->interrupt();
+    }
+}
+
+bool SVCProj::waitStagesFinished(int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+    auto remainingMs = [&deadline]() {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return static_cast<int>(std::max<long long>(left.count(), 0));
+    };
+    
+    if (h264Decoder_ && !h264Decoder_->waitFinished(remainingMs())) {
+        return false;
+    }
+    
+    if (svcH264Encoder_ && !svcH264Encoder_->waitFinished(remainingMs())) {
+        return false;
+    }
+    
+    if (simulcastEncoder_ && !simulcastEncoder_->waitFinished(remainingMs())) {
+        return false;
+    }
+    
+    if (dispatcher_ && !dispatcher_->waitFinished(remainingMs())) {
+        return false;
+    }
+    
+    auto decoders = liveDecoders();
+    for (auto it = decoders.begin(); it != decoders.end(); it++) {
+        if (*it != NULL && !(*it)->waitFinished(remainingMs())) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+int SVCProj::openInputSourceMedia(std::string &url, int logLevel)
+{
+    if (url.empty()) {
+        av_log(NULL, AV_LOG_ERROR, "%s is invalid\n", url.c_str());
+        return -1;
+    }
+    
+    avformat_network_init();
+    if (logLevel != SVC_LOG_LEVEL_KEEP) {   // a host running several sessions sets it once, not every session
+        Logger::shared().setLevel(logLevel);
+    }
+    Logger::shared().start();   // ffmpeg's logs too, from here on nothing waits for stderr
+    
+    AVDictionary *options = NULL;
+    if (config_.startupOptions.probeSize > 0) {
+        av_dict_set_int(&options, "probesize", config_.startupOptions.probeSize, 0);
+    }
+    
+    if (config_.startupOptions.analyzeDurationUs > 0) {
+        av_dict_set_int(&options, "analyzeduration", config_.startupOptions.analyzeDurationUs, 0);
+    }
+    
+    if (config_.startupOptions.lowDelay) { // hand packets out as soon as they are demuxed
+        av_dict_set(&options, "fflags", "nobuffer", 0);
+        av_dict_set_int(&options, "max_delay", 0, 0);
+    }
+    
+    auto ret = avformat_open_input(&fmtCtx_, url.c_str(), NULL, &options);
+    av_dict_free(&options);
+    if (ret) {
+        av_log(NULL, AV_LOG_ERROR, "Couldn't open input stream, ret = %d\n", ret);
+        return ret;
+    }
+    
+    markStartup(startupTimings_.open, "input opened");
+    ret = avformat_find_stream_info(fmtCtx_, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Couldn't find stream information");
+        return ret;
+    }
+    
+    h264Stream_ = NULL;
+    for (unsigned int i = 0; i < fmtCtx_->nb_streams; i++) {
+        if (selectedTrack(i)) {
+            h264Stream_ = fmtCtx_->streams[i];
+            break;
+        }
+    }
+    
+    if (!h264Stream_) {
+        av_log(NULL, AV_LOG_ERROR, "this file has NO video stream\n");
+        return -2;
+    }
+    
+    if (h264Stream_->codecpar->width <= 0 && (config_.startupOptions.probeSize > 0 || config_.startupOptions.analyzeDurationUs > 0)) {
+        // the bounded probe did not reach a picture size, fall back to ffmpeg's defaults once
+        av_log(NULL, AV_LOG_WARNING, "OpenInput: bounded probe found no picture size, probe again with defaults\n");
+        fmtCtx_->probesize = 5000000;
+        fmtCtx_->max_analyze_duration = 0;
+        ret = avformat_find_stream_info(fmtCtx_, NULL);
+        if (ret < 0 || h264Stream_->codecpar->width <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "Couldn't find video size, ret = %d\n", ret);
+            return ret < 0 ? ret : -3;
+        }
+    }
+    
+    markStartup(startupTimings_.probe, "stream info probed");
+    av_dump_format(fmtCtx_, 0, url.c_str(), 0);
+
+    return 0;
+}
+
+void SVCProj::correctSpatialData() {
+    auto originWidth = h264Stream_->codecpar->width;
+    auto originHeight = h264Stream_->codecpar->height;
+    while (spatialSettings_.size() > static_cast<size_t>(svcSpatialNum_)) {
+        spatialSettings_.pop_back();
+    }
+    
+    auto largest = spatialSettings_.at(svcSpatialNum_ - 1);
+    if (largest.width != originWidth || largest.height != originHeight) {
+        largest.width = originWidth;
+        largest.height = originHeight;
+        spatialSettings_.at(svcSpatialNum_ - 1) = largest;
+    }
+    
+    if (!config_.preview || config_.previewSpatials.empty()) {
+        return;
+    }
+    
+    SpatialDataVec previewSpatials;
+    for (auto it = config_.previewSpatials.begin(); it != config_.previewSpatials.end(); it++) {
+        previewSpatials.push_back(spatialSettings_.at(*it));
+    }
+    
+    spatialSettings_ = previewSpatials;
+    svcSpatialNum_ = static_cast<int>(spatialSettings_.size());
+    for (size_t i = 0; i < config_.previewSpatials.size(); i++) {   // they are the layers now, a restart / track keeps them all
+        config_.previewSpatials.at(i) = i;
+    }
+}
+
+SVCPicture SVCProj::createSSourcePicture(AVFrame *frame) {
+    SVCPicture sourcePic;
+    auto &picture = sourcePic.picture;
+    memset(&picture, 0, sizeof(SSourcePicture));
+    
+    auto y_size = frame->width * frame->height;
+    auto u_size = frame->width * frame->height >> 2;
+    auto v_size = frame->width * frame->height >> 2;
+    sourcePic.buffer = bufferPool_->acquire(y_size + u_size + v_size);  // one block for all three planes
+    if (!sourcePic.buffer) {
+        return sourcePic;
+    }
+    
+    picture.iPicWidth = frame->width;
+    picture.iPicHeight = frame->height;
+    picture.iColorFormat = videoFormatI420;
+    picture.iStride[0] = picture.iPicWidth;
+    picture.iStride[1] = picture.iPicWidth >> 1;
+    picture.iStride[2] = picture.iPicWidth >> 1;
+    
+    picture.pData[0] = sourcePic.buffer->data();
+    av_image_copy_plane(picture.pData[0], picture.iStride[0], frame->data[0], frame->linesize[0], frame->width, frame->height);
+    
+    picture.pData[1] = picture.pData[0] + y_size;
+    av_image_copy_plane(picture.pData[1], picture.iStride[1], frame->data[1], frame->linesize[1], frame->width >> 1, frame->height >> 1);
+    
+    picture.pData[2] = picture.pData[1] + u_size;
+    av_image_copy_plane(picture.pData[2], picture.iStride[2], frame->data[2], frame->linesize[2], frame->width >> 1, frame->height >> 1);
+    
+    picture.uiTimeStamp = frameTimestampMs(frame);
+    return sourcePic;
+}
+
+void SVCProj::initH264Decoder() {
+    h264Decoder_ = std::make_shared<H264Decoder>(queueLimits());
+    auto status = h264Decoder_->initH264Decoder(h264Stream_, config_.startupOptions.lowDelay, config_.tuning.decoderThreads >= 0 ? config_.tuning.decoderThreads : 4, config_.preview);
+    av_log(NULL, AV_LOG_DEBUG, "initH264Decoder: status = %d\n", status);
+    markStartup(startupTimings_.h264DecoderInit, "h264 decoder initialized");
+    h264Decoder_->start([this](bool eof, int status, AVFrame* frame) {
+        if (eof) {
+            av_log(NULL, AV_LOG_DEBUG, "H264Decoder: send a terminal signal to SVC spatial encoder\n");
+            putPicture(SVCPicture());
+            return;
+        }
+        
+        if (status < 0) {
+            av_log(NULL, AV_LOG_ERROR, "H264Decoder: frame is not available\n");
+            return;
+        }
+        
+        if ((config_.rangeBeginMs > 0 || config_.rangeEndMs > 0) && !inTimeRange(frameTimestampMs(frame))) {
+            return; // decoded up from the keyframe before the range / flushed after it, not part of the job
+        }
+        
+        markStartup(startupTimings_.firstFrameDecoded, "first frame decoded");
+        if (changeDetector_ && !changeDetector_->changed(frame->data[0], frame->linesize[0], frame->width, frame->height)) {
+            return; // nothing new on screen, no copy, no encode, no fan-out
+        }
+        
+        // send I420 picture to SVC Spatial encoder
+        auto decodedAt = std::chrono::steady_clock::now();
+        SVCPicture spatialPic = createSSourcePicture(frame);
+        if (!spatialPic.buffer) {
+            av_log(NULL, AV_LOG_ERROR, "H264Decoder: no memory for I420 picture, drop it\n");
+            return;
+        }
+        
+        auto consumers = simulcastEncoder_ ? static_cast<int>(spatialSettings_.size()) : 1;    // every level reports the frame
+        stageTimings_->handedOff(spatialPic.picture.uiTimeStamp, decodedAt,
+                                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodedAt).count(), consumers);
+        sourcePictures_++;
+        putPicture(std::move(spatialPic));
+    });
+}
+
+void SVCProj::createSVCH264Encoder() {
+    stageTimings_ = std::make_shared<StageTimings>();
+    if (config_.encodeMode == SVC_ENCODE_SIMULCAST) {
+        if (config_.pipelineMode == SVC_PIPELINE_FUSED) {
+            av_log(NULL, AV_LOG_WARNING, "warning: simulcast encodes on its own threads, the pipeline stays queued\n");
+            config_.pipelineMode = SVC_PIPELINE_QUEUED;
+        }
+        simulcastEncoder_ = std::make_shared<SimulcastEncoder>(queueLimits(), bufferPool_);
+        simulcastEncoder_->setTuning(config_.tuning);
+        simulcastEncoder_->setIntraPeriod(config_.preview ? 1 : SVC_ENCODER_INTRA_PERIOD);
+        simulcastEncoder_->setSourceFrameRate(sourceFrameRate());
+        return;
+    }
+    
+    svcH264Encoder_ = std::make_shared<SVCEncoder>(queueLimits());
+    svcH264Encoder_->setTuning(config_.tuning);
+    svcH264Encoder_->setIntraPeriod(config_.preview ? 1 : SVC_ENCODER_INTRA_PERIOD);
+    svcH264Encoder_->setSourceFrameRate(sourceFrameRate());
+}
+
+// of the video track, 0 if the container does not tell
+double SVCProj::sourceFrameRate() {
+    auto rate = h264Stream_->avg_frame_rate.num > 0 ? h264Stream_->avg_frame_rate : h264Stream_->r_frame_rate;
+    return rate.num > 0 && rate.den > 0 ? av_q2d(rate) : 0;
+}
+
+void SVCProj::createDispatcher() {
+    std::fill(overflowDrops_.begin(), overflowDrops_.end(), 0);
+    lastOverflowIdr_ = std::chrono::steady_clock::time_point();
+    std::fill(codedPictures_.begin(), codedPictures_.end(), 0);
+    sourcePictures_ = 0;
+    dispatcher_ = nullptr;
+    if (config_.pipelineMode == SVC_PIPELINE_FUSED) {  // dispatched inline like it is encoded
+        return;
+    }
+    
+    dispatcher_ = std::make_shared<SVCDispatcher>(queueLimits());
+    dispatcher_->start([this](EncodedAccessUnit &au) {
+        dispatchAccessUnit(au);
+    });
+    
+    if (placement_ && dispatcher_->thread()) {
+        placement_->bindThread(*dispatcher_->thread(), "dispatcher");
+    }
+}
+
+void SVCProj::putPicture(SVCPicture &&picture) {
+    if (config_.pipelineMode == SVC_PIPELINE_FUSED) {
+        encodeInline(std::forward<SVCPicture>(picture));
+    } else if (simulcastEncoder_) {
+        simulcastEncoder_->put(std::forward<SVCPicture>(picture));
+    } else if (svcH264Encoder_) {
+        svcH264Encoder_->put(std::forward<SVCPicture>(picture));
+    }
+}
+
+// fused pipeline: the h264 decoder thread encodes and dispatches, no queue, no wakeup in between
+void SVCProj::encodeInline(SVCPicture &&picture) {
+    if (!picture.buffer || picture.picture.iPicWidth <= 0 || picture.picture.iPicHeight <= 0) {   // EOF
+        dispatchEncoded(true, 0, NULL, 0);
+        return;
+    }
+    
+    SFrameBSInfo encodedInfo;
+    auto status = svcH264Encoder_->encode(picture, &encodedInfo);
+    dispatchEncoded(false, status, &encodedInfo, 0);
+}
+
+void SVCProj::initSVCH264Encoder(int width, int height) {
+    if (config_.encodeMode == SVC_ENCODE_SIMULCAST) {
+        auto status = simulcastEncoder_->initSimulcastEncoder(width, height, svcTemporalNum_, spatialSettings_);
+        av_log(NULL, AV_LOG_DEBUG, "initSVCH264Encoder: simulcast status = %d\n", status);
+        simulcastEncoder_->start([this](bool eof, int status, int spatialId, SFrameBSInfo *pEncodedInfo) {
+            dispatchEncoded(eof, status, pEncodedInfo, spatialId);
+        });
+        
+        if (placement_ && simulcastEncoder_->thread()) {
+            placement_->bindThread(*simulcastEncoder_->thread(), "simulcast scaler");
+            auto &encoders = simulcastEncoder_->encoders();
+            for (size_t i = 0; i < encoders.size(); i++) {
+                if (encoders.at(i)->thread()) {
+                    placement_->bindThread(*encoders.at(i)->thread(), "simulcast encoder " + std::to_string(i));
+                }
+            }
+        }
+    } else {
+        auto status = svcH264Encoder_->initSVCEncoder(width, height, svcTemporalNum_, svcSpatialNum_, spatialSettings_);
+        av_log(NULL, AV_LOG_DEBUG, "initSVCH264Encoder: status = %d\n", status);
+        if (config_.pipelineMode == SVC_PIPELINE_FUSED) {  // no thread, encodeInline() drives it
+            markStartup(startupTimings_.encoderInit, "svc encoder initialized");
+            if (--pendingInits_ == 0) {
+                onStartupFinished();
+            }
+            return;
+        }
+        
+        svcH264Encoder_->start([this](bool eof, int status, SFrameBSInfo *pEncodedInfo) {
+            dispatchEncoded(eof, status, pEncodedInfo, 0);
+        });
+        
+        if (placement_ && svcH264Encoder_->thread()) {
+            placement_->bindThread(*svcH264Encoder_->thread(), "svc encoder");
+        }
+    }
+    
+    markStartup(startupTimings_.encoderInit, "svc encoder initialized");
+    if (--pendingInits_ == 0) {
+        onStartupFinished();
+    }
+}
+
+/* runs on the encoder thread: the access unit is copied out of the encoder (its buffers are reused by the next
+ * EncodeFrame) and handed to the dispatch stage, or dispatched right here in a fused pipeline
+ * spatialBase: spatial id of the first layer in pEncodedInfo, 0 for the svc encoder, the level for a simulcast
+ * encoder (its output only has spatial id 0 and is complete on its own, nothing from other levels is prepended)
+ */
+void SVCProj::dispatchEncoded(bool eof, int status, SFrameBSInfo *pEncodedInfo, int spatialBase) {
+    EncodedAccessUnit au = EncodedAccessUnit();    // no bitstream: EOF
+    if (!eof) {
+        if (status != cmResultSuccess) {    // pEncodedInfo holds nothing usable, the next picture goes on
+            SVC_LOG(AV_LOG_ERROR, "SVCH264Encoder: encoding failed, status = %d, spatial base = %d\n", status, spatialBase);
+            return;
+        }
+        
+        if (pEncodedInfo->eFrameType == videoFrameTypeInvalid || pEncodedInfo->eFrameType == videoFrameTypeSkip) {
+            av_log(NULL, AV_LOG_ERROR, "SVCH264Encoder: frame type is invalid, frameType = %d\n", pEncodedInfo->eFrameType);
+            return;
+        }
+        
+        markStartup(startupTimings_.firstFrameEncoded, "first frame encoded");
+        
+        // the encoder that produced this access unit ran it on this very thread
+        auto encoder = simulcastEncoder_ ? simulcastEncoder_->encoders().at(spatialBase) : svcH264Encoder_;
+        au.followed = stageTimings_->encoded(pEncodedInfo->uiTimeStamp, spatialBase, encoder->lastEncodeMs(), au.decodedAt);
+        if (packAccessUnit(pEncodedInfo, spatialBase, au)) {
+            return;
+        }
+    }
+    
+    if (dispatcher_) {
+        dispatcher_->put(std::move(au));
+    } else {
+        dispatchAccessUnit(au);
+    }
+}
+
+// RETURN: 0 if au holds every layer of pEncodedInfo back to back
+int SVCProj::packAccessUnit(SFrameBSInfo *pEncodedInfo, int spatialBase, EncodedAccessUnit &au) {
+    auto totalSize = 0;
+    for (auto i = 0; i < pEncodedInfo->iLayerNum; i++) {
+        auto &layerInfo = pEncodedInfo->sLayerInfo[i];
+        for (auto nalIdx = 0; nalIdx < layerInfo.iNalCount; nalIdx++) {
+            totalSize += layerInfo.pNalLengthInByte[nalIdx];
+        }
+    }
+    
+    if (totalSize <= 0) {
+        return -1;
+    }
+    
+    au.bitstream = bufferPool_->acquire(totalSize);
+    if (!au.bitstream) {
+        av_log(NULL, AV_LOG_ERROR, "SVCH264Encoder: no memory for NAL, drop it\n");
+        return -2;
+    }
+    
+    /* spatial NAL是按照低分辨率到高分辨率出场的, 整个access unit只拷贝一次:
+     * 第i层的完整NAL(基本层 + 它之前的所有增强层 + 它自己)就是bitstream[0, end_i)
+     */
+    auto end = 0;
+    au.layers.reserve(pEncodedInfo->iLayerNum);
+    for (auto i = 0; i < pEncodedInfo->iLayerNum; i++) {
+        auto &layerInfo = pEncodedInfo->sLayerInfo[i];
+        auto layerSize = 0;
+        for (auto nalIdx = 0; nalIdx < layerInfo.iNalCount; nalIdx++) {
+            layerSize += layerInfo.pNalLengthInByte[nalIdx];
+        }
+        
+        memcpy(au.bitstream->data() + end, layerInfo.pBsBuf, layerSize);
+        end += layerSize;
+        au.layers.push_back({layerInfo.uiTemporalId, spatialBase + layerInfo.uiSpatialId, end, layerInfo.uiLayerType});
+    }
+    
+    au.timestamp = pEncodedInfo->uiTimeStamp;
+    au.idr = pEncodedInfo->eFrameType == videoFrameTypeIDR;
+    au.spatialBase = spatialBase;
+    return 0;
+}
+
+/* the dispatch stage (the encoder thread in a fused pipeline): dumps, muxers, manifests, shared memory
+ * and the decoders of every operating point an access unit belongs to
+ */
+void SVCProj::dispatchAccessUnit(EncodedAccessUnit &au) {
+    if (!au.bitstream) {  // EOF
+        av_log(NULL, AV_LOG_DEBUG, "SVCH264Encoder: send a terminaate signal to all SVC Temporal decoders\n");
+        auto decoders = liveDecoders();
+        for (auto it = decoders.begin(); it != decoders.end(); it++) {
+            if(*it == NULL) {
+                continue;
+            }
+            
+            (*it)->put(SVCH264Data());
+        }
+        return ;
+    }
+    
+    auto dispatchBegin = std::chrono::steady_clock::now();
+    auto idr = au.idr;
+    auto lastSpatialId = au.spatialBase;
+    for (auto it = au.layers.begin(); it != au.layers.end(); it++) {
+        lastSpatialId = std::max(lastSpatialId, it->spatialId);
+    }
+    auto routes = decoderRoutes(idr, au.spatialBase, lastSpatialId);  // decoders to feed this access unit
+    if (!adaptiveReceivers_.empty()) {  // switches first: a spatial one decides which layer of this access unit is fed
+        std::lock_guard<std::mutex> locker(adaptiveMutex_);
+        for (auto layer = au.layers.begin(); layer != au.layers.end(); layer++) {
+            if (layer->layerType != VIDEO_CODING_LAYER) {  // SPS / PPS, no picture of spatial layer 0
+                continue;
+            }
+            
+            for (auto it = adaptiveReceivers_.begin(); it != adaptiveReceivers_.end(); it++) {
+                if (*it) {
+                    (*it)->onLayer(layer->temporalId, layer->spatialId, idr);
+                }
+            }
+        }
+    }
+    
+    //  dispatch SVC H264 compressed data to corresponding SVC decoder correctly
+    /* 1. spatial rules
+     * 低分辨率是基本层，增强层是建立在基本层之上的差值。故:高分辨率需要将基本层与对应的增强层组合
+     * 例如：完整的1080p的NAL = NAL_360p(基本层) + NAL_480p(增强层) + NAL_720p(增强层) + NAL_1080p(增强层)
+     * 2. temporal rules
+     * iTemporalLayerNum 的值为 1 时，使用 uiGopSize = 1 的配置，即每一帧为一组，每一组的uiTemporalId 值为 0
+     * iTemporalLayerNum 的值为 2 时，使用 uiGopSize = 2 的配置，即每两帧为一组，每一组中对应的uiTemporalId 为 [0, 1]
+     * iTemporalLayerNum 的值为 3 时，使用 uiGopSize = 4 的配置，即每四帧为一组，每一组中对应的uiTemporalId 为 [0, 2, 1, 2]
+     * iTemporalLayerNum 的值为 4 时，使用 uiGopSize = 8 的配置，即每八帧为一组，每一组中对应的uiTemporalId 为 [0, 3, 2, 3, 1, 3, 2, 3]
+     */
+    
+    // 每一次只有一个temporalId但是可能有多个spatialId, temporal层面的NAL不需要拼接， Spatial层面的NAL需要拼接(packAccessUnit已拼好)。
+    auto pBuf = au.bitstream->data();
+    for (auto layer = au.layers.begin(); layer != au.layers.end(); layer++) {
+        auto curSpatialId = layer->spatialId;
+        auto curTemporalId = layer->temporalId;
+        auto totalSize = layer->end;
+        if (layer->layerType == VIDEO_CODING_LAYER) {   // parameter sets ride with the IDRs, they are no picture
+            codedPictures_.at(curSpatialId)++;  // a capped layer is missing from the access units of the temporal layers it dropped
+        }
+        SVC_LOG(AV_LOG_DEBUG, "svcH264Encoder: temporal_id = %d, spatial_id = %d\n", curTemporalId, curSpatialId);
+        
+        /* T0 需要 temporalId = {0}的NAL,
+         * T1 需要 temporalId = {0, 1}的NAL,
+         * T2 需要 temporalId = {0, 1, 2}的NAL,
+         * T3 需要 temporalId = {0, 1, 2, 3}的NAL
+         * 即 NAL的temporal = 0时，需要向 T0，T1，T2，T3 发送。
+         * NAL的temporal = 1时，需要向T1，T2，T3 发送。
+         * 以此类推....
+         * 组合后的NAL只拷贝一次, 所有目标decoder共享同一块buffer(解码器只读)
+         */
+        auto auHashed = false;
+        uint64_t auHash = 0;
+        for (auto row = curTemporalId; row < svcTemporalNum_; row++) {
+            auto layerAt = row * MAX_SPATIAL_LAYER_NUM + curSpatialId;
+            auto &view = layerViews_.at(layerAt);
+            if (view.dumpSvc) { // dump svc compressed data into file
+                view.dumpSvc->write(pBuf, totalSize);
+            }
+            
+            if (view.muxer) {
+                view.muxer->writeVideo(pBuf, totalSize, au.timestamp, idr);
+            }
+            
+            if (view.auHash) {  // same bytes for every operating point, hash them once
+                if (!auHashed) {
+                    auHash = FrameHash::hash(pBuf, totalSize);
+                    auHashed = true;
+                }
+                view.auHash->add(au.timestamp, auHash);
+            }
+            
+            if (view.auRing) {
+                view.auRing->publish(pBuf, totalSize, au.timestamp, curTemporalId, idr ? SHM_RING_FLAG_IDR : 0);
+            }
+            
+            // 共享模式下只有最高temporal的decoder, 低temporal由它的输出过滤得到
+            if (config_.temporalMode == SVC_TEMPORAL_SHARED && row != svcTemporalNum_ - 1) {
+                continue;
+            }
+            
+            if (!adaptiveReceivers_.empty()) {  // fed below by their current operating point
+                continue;
+            }
+            
+            // 根据上面的提示， 给需要temporalId=x的decoder发送完整的NAL，必须得到目标decoder。
+            auto svcDecoder = routes.at(layerAt);
+            if (svcDecoder == NULL) {
+                if (!config_.lazyDecoders) {   // lazy ones come and go with their subscribers
+                    av_log(NULL, AV_LOG_ERROR, "SVCH264Encoder: Fatal Something Wrong\n");
+                }
+                continue;
+            }
+            
+            // dispatch NAL
+            SVCH264Data data;
+            data.timestamp = au.timestamp;
+            data.temporalId = curTemporalId;
+            data.compressedDataLen = totalSize;
+            data.compressedData = au.bitstream;
+            feedDecoder(layerAt, svcDecoder, std::move(data));
+        }
+        
+        if (!adaptiveReceivers_.empty()) {
+            dispatchAdaptive(routes, au.timestamp, curTemporalId, curSpatialId, au.bitstream, totalSize);
+        }
+    }
+    
+    if (!adaptiveReceivers_.empty()) {
+        std::lock_guard<std::mutex> locker(adaptiveMutex_);
+        for (size_t i = 0; i < adaptiveReceivers_.size(); i++) {
+            if (adaptiveReceivers_.at(i) && routes.at(i)) {
+                adaptiveReceivers_.at(i)->evaluate(routes.at(i)->decodeTimeMs(), routes.at(i)->queueSize());
+            }
+        }
+    }
+    
+    auto dispatchEnd = std::chrono::steady_clock::now();
+    stageTimings_->add(SVC_STAGE_DISPATCH, std::chrono::duration<double, std::milli>(dispatchEnd - dispatchBegin).count());
+    if (au.followed) {
+        stageTimings_->add(SVC_STAGE_TOTAL, std::chrono::duration<double, std::milli>(dispatchEnd - au.decodedAt).count());
+    }
+}
+
+// dispatch stage only: the overflow policy of the decoder decides what a full queue means
+void SVCProj::feedDecoder(int layerAt, SVCDecoderShr &svcDecoder, SVCH264Data &&data) {
+    auto policy = config_.overflowPolicies.at(layerAt);
+    if (policy == SVC_OVERFLOW_BLOCK) {
+        svcDecoder->put(std::forward<SVCH264Data>(data));
+        return;
+    }
+    
+    if (svcDecoder->tryPut(std::forward<SVCH264Data>(data))) {
+        return;
+    }
+    
+    overflowDrops_.at(layerAt)++;
+    auto forceIdr = false;
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        if (policy == SVC_OVERFLOW_DROP_TO_IDR) {   // decoderRoutes() skips it until an IDR of its spatial layer
+            if (decoderSynced_.at(layerAt)) {
+                SVC_LOG(AV_LOG_WARNING, "SVCProj: decoder %s overflowed, skipped until the next IDR\n", svcDecoder->tag());
+                
+                // a slow decoder overflows again right after it resynced, an IDR each time would cost every layer
+                // more bits than the periodic ones, so at most one forced per intra period, else wait for the periodic one
+                auto now = std::chrono::steady_clock::now();
+                if (!config_.preview && now - lastOverflowIdr_ >= intraInterval()) {
+                    lastOverflowIdr_ = now;
+                    forceIdr = true;
+                }
+            }
+            decoderSynced_.at(layerAt) = false;
+        } else if (!decoderDisconnected_.at(layerAt)) {
+            av_log(NULL, AV_LOG_WARNING, "SVCProj: decoder %s overflowed, disconnected\n", svcDecoder->tag().c_str());
+            decoderDisconnected_.at(layerAt) = true;
+            svcDecoder->interrupt();    // what it holds goes, its thread finishes
+        }
+    }
+    
+    if (forceIdr) {
+        requestIntraFrame(layerAt % MAX_SPATIAL_LAYER_NUM);
+    }
+}
+
+// from one periodic IDR to the next
+std::chrono::steady_clock::duration SVCProj::intraInterval() {
+    auto sourceFps = sourceFrameRate() > 0 ? sourceFrameRate() : SVC_ENCODER_FRAME_RATE;
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(SVC_ENCODER_INTRA_PERIOD / sourceFps));
+}
+
+// what the frame rate caps of the spatial layers saved, by pictures and by pixels not encoded / decoded
+void SVCProj::reportFrameRates() {
+    if (sourcePictures_ == 0) {
+        return;
+    }
+    
+    auto sourceFps = sourceFrameRate() > 0 ? sourceFrameRate() : SVC_ENCODER_FRAME_RATE;
+    double sourcePixels = 0, codedPixels = 0;
+    for (auto i = 0; i < svcSpatialNum_; i++) {
+        auto &spatial = spatialSettings_.at(i);
+        auto area = (double)spatial.width * spatial.height;
+        sourcePixels += area * sourcePictures_;
+        codedPixels += area * codedPictures_.at(i);
+        av_log(NULL, AV_LOG_INFO, "SVCProj: S%d %dx%d at %.2f fps, %llu of %llu pictures coded\n", i, spatial.width, spatial.height,
+               SVCEncoder::layerFrameRate(spatial.frameRate, sourceFps, svcTemporalNum_), (unsigned long long)codedPictures_.at(i), (unsigned long long)sourcePictures_);
+    }
+    
+    av_log(NULL, AV_LOG_INFO, "SVCProj: frame rate caps saved %.1f%% of the pixels to encode and decode\n", 100.0 * (1.0 - codedPixels / sourcePixels));
+}
+
+void SVCProj::reportOverflows() {
+    for (size_t i = 0; i < overflowDrops_.size(); i++) {
+        if (overflowDrops_.at(i)) {
+            av_log(NULL, AV_LOG_INFO, "SVCProj: %s lost %llu access units to %s\n", layerViews_.at(i).tag.c_str(), (unsigned long long)overflowDrops_.at(i),
+                   config_.overflowPolicies.at(i) == SVC_OVERFLOW_DROP_TO_IDR ? "drop-to-IDR" : "disconnect");
+        }
+    }
+}
+
+void SVCProj::createSVCH264Decoders() {
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    std::fill(decoderRefs_.begin(), decoderRefs_.end(), 0);
+    for (auto it = subscriptions_.begin(); it != subscriptions_.end(); it++) {
+        if (it->spatialId >= svcSpatialNum_) {  // spatial layers may have been corrected to the input
+            av_log(NULL, AV_LOG_ERROR, "createSVCH264Decoders: T%d S%d is not an operating point of this session\n", it->temporalId, it->spatialId);
+            continue;
+        }
+        decoderRefs_.at(decoderSlot(it->temporalId, it->spatialId))++;
+    }
+    
+    for (auto i = 0; i < svcTemporalNum_; i++) {
+        for (auto j = 0; j < svcSpatialNum_; j++) {
+            auto item = spatialSettings_.at(j);
+            std::string uniqueTag = "SVC_" + trackTag_ + "T";
+            uniqueTag.append(std::to_string(i)).append("_").append(std::to_string(item.width)).append("x").append(std::to_string(item.height));
+            
+            auto layerAt = i * MAX_SPATIAL_LAYER_NUM + j;
+            auto &view = layerViews_.at(layerAt);
+            view.tag = uniqueTag;
+            publishOutputs(layerAt);
+            if (config_.verifyMode != HASH_MANIFEST_NONE) {
+                view.auHash = std::make_shared<HashManifest>(config_.manifestDir, uniqueTag + ".au", config_.verifyMode);
+                view.frameHash = std::make_shared<HashManifest>(config_.manifestDir, uniqueTag + ".yuv", config_.verifyMode);
+                if (view.auHash->open() || view.frameHash->open()) {
+                    av_log(NULL, AV_LOG_ERROR, "createSVCH264Decoders: manifests of %s are unavailable\n", uniqueTag.c_str());
+                }
+            }
+            
+            if (!config_.shmPrefix.empty()) {
+                createShmRings(layerAt, item.width, item.height);
+            }
+            
+            auto ownDecoder = config_.temporalMode != SVC_TEMPORAL_SHARED || i == svcTemporalNum_ - 1;
+            if (!ownDecoder || config_.lazyDecoders) {
+                // the dumps outlive the decoders: fed from the top temporal decoder of the same spatial layer / by whichever lazy decoder is alive
+                if (!config_.dumpDataDir.empty()) {
+                    auto svcTempName = uniqueTag;
+                    view.dumpSvc = std::make_shared<Localize>(config_.dumpDataDir, svcTempName.append(".data"));
+                    view.dumpSvc->open();
+                    
+                    auto yuvTempName = uniqueTag;
+                    view.dumpYuv = std::make_shared<Localize>(config_.dumpDataDir, yuvTempName.append(".yuv"));
+                    view.dumpYuv->open();
+                }
+            }
+            
+            if (!ownDecoder || (config_.lazyDecoders && decoderRefs_.at(layerAt) == 0)) {
+                continue;
+            }
+            
+            auto svcDecoder = createSVCH264Decoder(layerAt);
+            if (!config_.lazyDecoders) {
+                view.dumpSvc = svcDecoder->dumpSvcHandler();
+                view.dumpYuv = svcDecoder->dumpYuvHandler();
+            }
+            decoderSynced_.at(layerAt) = true;  // there from the first access unit on
+            decoderDisconnected_.at(layerAt) = false;
+            svcH264Decoders_.at(layerAt) = svcDecoder;
+        }
+    }
+    
+    routesReady_ = true;
+}
+
+SVCDecoderShr SVCProj::createSVCH264Decoder(int layerAt) {
+    std::string noDump;     // a lazy decoder would truncate the dumps of its predecessor, the view owns them
+    return std::make_shared<SVCDecoder>(queueLimits(), config_.lazyDecoders ? noDump : config_.dumpDataDir, std::string(layerViews_.at(layerAt).tag));
+}
+
+int SVCProj::decoderSlot(int temporalId, int spatialId) {
+    // a shared decoder at the top T serves every lower T of its spatial layer
+    auto row = config_.temporalMode == SVC_TEMPORAL_SHARED ? svcTemporalNum_ - 1 : temporalId;
+    return row * MAX_SPATIAL_LAYER_NUM + spatialId;
+}
+
+SVCProj *SVCProj::setLazyDecoders(bool lazy) {
+    if (started_) {
+        av_log(NULL, AV_LOG_WARNING, "warning: lazy decoders must be set before start\n");
+        return this;
+    }
+    
+    config_.lazyDecoders = lazy;
+    return this;
+}
+
+int SVCProj::subscribe(int temporalId, int spatialId, SVCFrameOutputCB output) {
+    if (temporalId < 0 || temporalId >= svcTemporalNum_ || spatialId < 0 || spatialId >= MAX_SPATIAL_LAYER_NUM) {
+        return -1;
+    }
+    
+    std::vector<std::shared_ptr<SVCProj>> tracks;
+    SVCSubscription subscription = {-1, temporalId, spatialId, output};
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        subscription.id = nextSubscriptionId_++;
+        tracks = tracks_;
+    }
+    
+    if (addSubscription(subscription)) {
+        return -1;
+    }
+    
+    for (auto it = tracks.begin(); it != tracks.end(); it++) {  // the same operating point of every track
+        (*it)->addSubscription(subscription);
+    }
+    
+    return subscription.id;
+}
+
+// RETURN: 0 if subscription was added
+int SVCProj::addSubscription(const SVCSubscription &subscription) {
+    auto lazy = false;
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        if (routesReady_ && subscription.spatialId >= svcSpatialNum_) {
+            return -1;
+        }
+        
+        subscriptions_.push_back(subscription);
+        if (routesReady_) {
+            publishOutputs(subscription.temporalId * MAX_SPATIAL_LAYER_NUM + subscription.spatialId);
+            lazy = config_.lazyDecoders;
+        }
+    }
+    
+    if (lazy) {     // not under routeMutex_, the dispatcher keeps routing while the decoder comes up
+        acquireDecoder(decoderSlot(subscription.temporalId, subscription.spatialId));
+    }
+    
+    return 0;
+}
+
+void SVCProj::unsubscribe(int subscriptionId) {
+    std::vector<std::shared_ptr<SVCProj>> tracks;
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        tracks = tracks_;
+    }
+    
+    removeSubscription(subscriptionId);
+    for (auto it = tracks.begin(); it != tracks.end(); it++) {
+        (*it)->removeSubscription(subscriptionId);
+    }
+}
+
+void SVCProj::removeSubscription(int subscriptionId) {
+    SVCDecoderShr retired;
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        auto found = std::find_if(subscriptions_.begin(), subscriptions_.end(), [subscriptionId](const SVCSubscription &sub) {
+            return sub.id == subscriptionId;
+        });
+        if (found == subscriptions_.end()) {
+            return;
+        }
+        
+        auto subscription = *found;
+        subscriptions_.erase(found);
+        if (!routesReady_) {
+            return;
+        }
+        
+        publishOutputs(subscription.temporalId * MAX_SPATIAL_LAYER_NUM + subscription.spatialId);
+        if (config_.lazyDecoders) {
+            retired = releaseDecoder(decoderSlot(subscription.temporalId, subscription.spatialId));
+        }
+    }
+    
+    if (retired) {  // the dispatcher may still hold it for one access unit, interrupt keeps its put from blocking
+        retired->interrupt();
+        retired->stop();
+        av_log(NULL, AV_LOG_INFO, "SVCProj: decoder %s torn down, no subscriber left\n", retired->tag().c_str());
+    }
+}
+
+// routeMutex_ not held: the decoder is created and started outside of it, then installed unless someone else was first
+void SVCProj::acquireDecoder(int layerAt) {
+    {
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        if (++decoderRefs_.at(layerAt) > 1 || svcH264Decoders_.at(layerAt)) {
+            return;
+        }
+    }
+    
+    auto svcDecoder = createSVCH264Decoder(layerAt);
+    if (startSVCH264Decoder(svcDecoder, layerAt)) {
+        av_log(NULL, AV_LOG_ERROR, "SVCProj: decoder %s can not be started\n", svcDecoder->tag().c_str());
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        decoderRefs_.at(layerAt)--;     // the next subscriber tries again
+        return;
+    }
+    
+    auto installed = false;
+    {
+        // the last subscriber may have left meanwhile, or left and a new one raced us to a decoder of its own
+        std::lock_guard<std::mutex> locker(routeMutex_);
+        if (decoderRefs_.at(layerAt) > 0 && !svcH264Decoders_.at(layerAt)) {
+            if (!adaptiveReceivers_.empty()) {
+                std::lock_guard<std::mutex> adaptiveLocker(adaptiveMutex_);
+                adaptiveReceivers_.at(layerAt) = createAdaptiveReceiver(layerAt);
+            }
+            
+            decoderSynced_.at(layerAt) = false;
+            decoderDisconnected_.at(layerAt) = false;
+            svcH264Decoders_.at(layerAt) = svcDecoder;
+            installed = true;
+        }
+    }
+    
+    if (!installed) {
+        svcDecoder->interrupt();
+        svcDecoder->stop();
+        return;
+    }
+    
+    requestIntraFrame(layerAt % MAX_SPATIAL_LAYER_NUM);
+    av_log(NULL, AV_LOG_INFO, "SVCProj: decoder %s created, fed from the next IDR\n", svcDecoder->tag().c_str());
+}
+
+// routeMutex_ held, RETURN: the decoder to stop once the lock is released, NULL if it still has subscribers
+SVCDecoderShr SVCProj::releaseDecoder(int layerAt) {
+    if (decoderRefs_.at(layerAt) <= 0 || --decoderRefs_.at(layerAt) > 0) {
+        return nullptr;
+    }
+    
+    if (!adaptiveReceivers_.empty()) {
+        std::lock_guard<std::mutex> adaptiveLocker(adaptiveMutex_);
+        if (adaptiveReceivers_.at(layerAt)) {
+            adaptiveReceivers_.at(layerAt)->report();
+            adaptiveReceivers_.at(layerAt) = nullptr;
+        }
+    }
+    
+    auto svcDecoder = svcH264Decoders_.at(layerAt);
+    svcH264Decoders_.at(layerAt) = nullptr;
+    return svcDecoder;
+}
+
+// routeMutex_ held
+void SVCProj::publishOutputs(int layerAt) {
+    auto outputs = std::make_shared<std::vector<SVCFrameOutputCB>>();
+    for (auto it = subscriptions_.begin(); it != subscriptions_.end(); it++) {
+        if (it->temporalId * MAX_SPATIAL_LAYER_NUM + it->spatialId == layerAt && it->output) {
+            outputs->push_back(it->output);
+        }
+    }
+    
+    std::atomic_store(&layerViews_.at(layerAt).outputs, outputs->empty() ? SVCFrameOutputs() : SVCFrameOutputs(outputs));
+}
+
+void SVCProj::requestIntraFrame(int spatialId) {
+    if (simulcastEncoder_) {
+        simulcastEncoder_->forceIntraFrame(spatialId);
+    } else if (svcH264Encoder_) {   // one IDR for every spatial layer, the other decoders simply go on with it
+        svcH264Encoder_->forceIntraFrame();
+    }
+}
+
+/* snapshot of the decoders an access unit goes to, a new decoder joins with the first IDR
+ * that carries its spatial layer
+ */
+SVCDecoderShrVec SVCProj::decoderRoutes(bool idr, int firstSpatialId, int lastSpatialId) {
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    auto routes = svcH264Decoders_;
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (decoderDisconnected_.at(i)) {
+            routes.at(i) = nullptr;
+            continue;
+        }
+        
+        if (!routes.at(i) || decoderSynced_.at(i)) {
+            continue;
+        }
+        
+        auto spatialId = static_cast<int>(i % MAX_SPATIAL_LAYER_NUM);
+        if (idr && spatialId >= firstSpatialId && spatialId <= lastSpatialId) {
+            decoderSynced_.at(i) = true;
+        } else {
+            routes.at(i) = nullptr;
+        }
+    }
+    
+    return routes;
+}
+
+SVCDecoderShrVec SVCProj::liveDecoders() {
+    std::lock_guard<std::mutex> locker(routeMutex_);
+    return svcH264Decoders_;
+}
+
+void SVCProj::initSVCH264Decoder(int layerAt) {
+    startSVCH264Decoder(svcH264Decoders_.at(layerAt), layerAt);
+    
+    if (--pendingDecoderInits_ == 0) {
+        markStartup(startupTimings_.decodersInit, "svc decoders initialized");
+    }
+    
+    if (--pendingInits_ == 0) {
+        onStartupFinished();
+    }
+}
+
+int SVCProj::startSVCH264Decoder(SVCDecoderShr svcDecoder, int layerAt) {
+    auto status = svcDecoder->initSVCDecoder();
+    av_log(NULL, AV_LOG_DEBUG, "initSVCH264Decoders: status = %d\n", status);
+    svcDecoder->start([this, layerAt](bool eof, int status, SBufferInfo *pDecodedInfo, uchar **ppDst, int temporalId, SVCDecoder *thiz){
+        if (eof) {
+            av_log(NULL, NULL, "SVCH264Decoder[%s]: time to Game Over, Bye...\n", thiz->tag().c_str());
+            return;
+        }
+        
+        if (status || pDecodedInfo->iBufferStatus != 1) {
+            SVC_LOG(AV_LOG_DEBUG, "SVCH264Decoder[%s]: Decoded Data is Unavailable, status: %d, bufferStatus: %d\n",
+                   thiz->tag(), status, pDecodedInfo->iBufferStatus);
+            return;
+        }
+        
+        markStartup(startupTimings_.firstFrameSVCDecoded, "first svc frame decoded");
+        // can print some info about decoded yuv
+        auto inTimestamp = pDecodedInfo->uiInBsTimeStamp;
+        auto outTimestamp = pDecodedInfo->uiOutYuvTimeStamp;
+        auto width = pDecodedInfo->UsrData.sSystemBuffer.iWidth;
+        auto height = pDecodedInfo->UsrData.sSystemBuffer.iHeight;
+        auto strideY = pDecodedInfo->UsrData.sSystemBuffer.iStride[0];
+        auto strideUV = pDecodedInfo->UsrData.sSystemBuffer.iStride[1];
+
+        SVC_LOG(AV_LOG_DEBUG, "SVCH264Decoder[%s]: outTimestamp: %lld, inTimestamp: %lld, width: %d, height: %d, stideY: %d, strideUV: %d, temporalId: %d\n",
+               thiz->tag(), outTimestamp, inTimestamp, width, height, strideY, strideUV, temporalId);
+        
+        // a per layer decoder serves its own operating point, a shared one every T >= temporalId of the frame
+        auto spatialId = layerAt % MAX_SPATIAL_LAYER_NUM;
+        auto firstRow = config_.temporalMode == SVC_TEMPORAL_SHARED ? std::max(temporalId, 0) : layerAt / MAX_SPATIAL_LAYER_NUM;
+        auto lastRow = layerAt / MAX_SPATIAL_LAYER_NUM;
+        auto frameHashed = false;
+        uint64_t frameHash = 0;
+        for (auto row = firstRow; row <= lastRow; row++) {
+            auto &view = layerViews_.at(row * MAX_SPATIAL_LAYER_NUM + spatialId);
+            if (view.dumpYuv) {   // dump yuv which is decoded from svc into file
+                view.dumpYuv->write(ppDst, strideY, width, height);
+            }
+            
+            if (view.frameHash) {
+                if (!frameHashed) {
+                    int strides[2] = {strideY, strideUV};
+                    frameHash = FrameHash::hashI420(ppDst, strides, width, height);
+                    frameHashed = true;
+                }
+                view.frameHash->add(outTimestamp, frameHash);
+            }
+            
+            if (view.frameRing) {
+                view.frameRing->publishFrame(ppDst, strideY, strideUV, width, height, outTimestamp, temporalId);
+            }
+            
+            auto outputs = std::atomic_load(&view.outputs);
+            if (config_.frameOutput || outputs) {
+                SVCFrame frame;
+                frame.temporalId = row;
+                frame.spatialId = spatialId;
+                frame.tag = view.tag.c_str();
+                frame.timestamp = outTimestamp;
+                frame.width = width;
+                frame.height = height;
+                frame.stride[0] = strideY;
+                frame.stride[1] = strideUV;
+                frame.planes[0] = ppDst[0];
+                frame.planes[1] = ppDst[1];
+                frame.planes[2] = ppDst[2];
+                if (config_.frameOutput) {
+                    config_.frameOutput(frame);
+                }
+                
+                if (outputs) {
+                    for (auto it = outputs->begin(); it != outputs->end(); it++) {
+                        (*it)(frame);
+                    }
+                }
+            }
+        }
+    });
+    
+    if (placement_ && svcDecoder->thread()) {
+        placement_->bindThread(*svcDecoder->thread(), svcDecoder->tag());
+    }
+    
+    return status;
 }
@@ -11,9 +11,23 @@
 #include <stdio.h>
 #include <iostream>
 #include <vector>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include "SVCDecoder.hpp"
 #include "SVCEncoder.hpp"
+#include "SimulcastEncoder.hpp"
 #include "H264Decoder.hpp"
+#include "SVCMuxer.hpp"
+#include "HashManifest.hpp"
+#include "FrameChangeDetector.hpp"
+#include "AdaptiveReceiver.hpp"
+#include "StageTimings.hpp"
+#include "SVCTuning.hpp"
+#include "ShmRing.hpp"
+#include "Logger.hpp"
+#include "SVCDispatcher.hpp"
+#include "ThreadPlacement.hpp"
 
 // ffmpeg headers
 extern "C"
@@ -26,9 +40,139 @@ extern "C"
     #include "libavformat/avformat.h"
 }
 
+enum SVCShutdownMode {
+    SVC_SHUTDOWN_DRAIN = 0,     // let queued data run through every stage, discard whatever is left after the drain timeout
+    SVC_SHUTDOWN_DISCARD,       // drop everything still queued right away
+};
+
+enum SVCEncodeMode {
+    SVC_ENCODE_LAYERED = 0,     // one svc encoder, higher spatial layers predicted from lower ones
+    SVC_ENCODE_SIMULCAST,       // an independent AVC encoder per SpatialData, each on its own thread
+};
+
+enum SVCPipelineMode {
+    SVC_PIPELINE_QUEUED = 0,    // h264 decoder, svc encoder and dispatch on threads of their own, best throughput
+    SVC_PIPELINE_FUSED,         // encode and dispatch inline on the h264 decoder thread, lowest latency
+};
+
+// what the dispatch stage does with an access unit for a decoder whose queue is full
+enum SVCOverflowPolicy {
+    SVC_OVERFLOW_BLOCK = 0,         // wait for room, the slow decoder holds up dispatch and in the end the encoder
+    SVC_OVERFLOW_DROP_TO_IDR,       // drop it and everything after it up to the next IDR of that spatial layer
+    SVC_OVERFLOW_DISCONNECT,        // stop feeding that decoder for the rest of the session, it finishes
+};
+
+enum SVCTemporalMode {
+    SVC_TEMPORAL_PER_DECODER = 0,   // one SVCDecoder for every (T, S) operating point
+    SVC_TEMPORAL_SHARED,            // one SVCDecoder per spatial layer at the top T, lower T are filtered views of its output
+};
+
+// one decoded picture of an operating point, the planes are only valid during the callback
+struct SVCFrame {
+    int temporalId;             // operating point T<temporalId>
+    int spatialId;
+    const char *tag;            // "SVC_T<t>_<w>x<h>", "SVC_V<stream index>_T<t>_<w>x<h>" with several video tracks
+    long long timestamp;        // ms
+    int width;
+    int height;
+    int stride[2];              // Y, UV
+    unsigned char *planes[3];   // Y, U, V of an I420 picture
+};
+
+using SVCFrame = struct SVCFrame;
 using SpatialDataVec = std::vector<SpatialData>;
+using SVCFrameOutputCB = std::function<void (const SVCFrame &frame)>;
+using SVCFrameOutputs = std::shared_ptr<const std::vector<SVCFrameOutputCB>>;
+
+// a consumer of one operating point, see SVCProj::subscribe
+struct SVCSubscription {
+    int id;
+    int temporalId;
+    int spatialId;
+    SVCFrameOutputCB output;    // may be NULL
+};
+
+// views of the same decoded picture for several operating points share its planes
+struct SVCLayerView {
+    std::string tag;
+    LocalizeShr dumpSvc;        // compressed data of this operating point, NULL if not dumping
+    LocalizeShr dumpYuv;        // decoded pictures of this operating point, NULL if not dumping
+    HashManifestShr auHash;     // hashes of the compressed access units, NULL if not verifying
+    HashManifestShr frameHash;  // hashes of the decoded pictures, NULL if not verifying
+    SVCMuxerShr muxer;          // container output of this operating point, NULL if not muxed
+    SVCFrameOutputs outputs;    // of its subscribers, replaced as a whole (atomic_load / atomic_store), NULL if none
+    ShmRingWriterShr auRing;    // access units to other processes, NULL if not exported
+    ShmRingWriterShr frameRing; // decoded pictures to other processes, NULL if not exported
+};
+
+// an operating point to write into a container next to the audio of the input
+struct SVCMuxOutput {
+    int temporalId;
+    int spatialId;
+    std::string path;
+    std::string format;         // "mp4", "matroska"..., empty to guess it from path
+    int fragmentMs;
+};
+
+
+// how start() opens the input and brings the stages up, all zero keeps the old behaviour
+struct StartupOptions {
+    bool fastStart;             // init svc encoder and decoders concurrently, frames flow once the h264 decoder is ready
+    int64_t probeSize;          // bytes avformat_find_stream_info may read, 0 for ffmpeg's default
+    int64_t analyzeDurationUs;  // stream duration avformat_find_stream_info may analyze, 0 for ffmpeg's default
+    bool lowDelay;              // live inputs: no demuxer buffering, no frame threading delay in the h264 decoder
+};
+
+// milliseconds since start() was called, -1 until the phase happened
+struct StartupTimings {
+    std::atomic<long long> open;
+    std::atomic<long long> probe;
+    std::atomic<long long> h264DecoderInit;
+    std::atomic<long long> encoderInit;
+    std::atomic<long long> decodersInit;
+    std::atomic<long long> firstFrameDecoded;
+    std::atomic<long long> firstFrameEncoded;
+    std::atomic<long long> firstFrameSVCDecoded;
+};
+
+// everything a session is configured with before start, a track of the same input gets a copy
+struct SVCSessionConfig {
+    SVCSessionConfig();
+
+    int syncQueueMaxSize;               // sync queue max size
+    size_t syncQueueMaxBytes;           // sync queue max payload bytes, 0 for no limit
+    int syncQueueMaxLatencyMs;          // sync queue max head of line latency, 0 for no limit
+    std::string dumpDataDir;            // where dump date to store
+    StartupOptions startupOptions;      // probing and initialization strategy
+    SVCEncodeMode encodeMode;           // layered svc or simulcast
+    SVCPipelineMode pipelineMode;       // queued or fused
+    std::vector<SVCOverflowPolicy> overflowPolicies;  // same index as the decoders of the session
+    SVCTemporalMode temporalMode;       // a decoder per operating point or per spatial layer
+    SVCTuning tuning;                   // knobs loaded or set, -1 keeps the built-in ones
+    int frameLimit;                     // video packets to read per track, 0 for all
+    long long rangeBeginMs;             // of the input, 0 from its start
+    long long rangeEndMs;               // of the input, <= 0 to its end
+    long long rangeOriginMs;            // start time of the input, the range is relative to it
+    bool preview;                       // key frames only, IDR only, T0 only
+    std::vector<int> previewSpatials;   // spatial layers a preview encodes, empty for all
+    bool multiTrack;                    // every selected video track gets a chain
+    std::vector<int> videoTracks;       // stream indexes of the selected tracks, empty for all
+    SVCFrameOutputCB frameOutput;       // decoded pictures to the user, may be NULL
+    std::vector<SVCMuxOutput> muxOutputs;  // requested container outputs
+    HashManifestMode verifyMode;        // record or verify frame hashes
+    std::string manifestDir;            // where the manifests live
+    std::string shmPrefix;              // shared memory export, empty if off
+    bool shmFrames;                     // export decoded pictures too
+    size_t shmRingBytes;                // payload bytes of an access unit ring
+    bool adaptive;                      // decoders follow their own headroom
+    AdaptiveSettings adaptiveSettings;  // thresholds of the adaptive receivers
+    bool lazyDecoders;                  // decoders follow the subscriptions
+};
+
+using StartupOptions = struct StartupOptions;
+using SVCSessionConfig = struct SVCSessionConfig;
+using SVCSubscription = struct SVCSubscription;
 using SVCDecoderShr = std::shared_ptr<SVCDecoder>;
-using SVCEncoderShr = std::shared_ptr<SVCEncoder>;
 using ReadThreadShr = std::shared_ptr<std::thread>;
 using H264DecoderShr = std::shared_ptr<H264Decoder>;
 using SVCDecoderShrVec = std::vector<SVCDecoderShr>;
@@ -37,49 +181,312 @@ class SVCProj {
 public:
     SVCProj(int temporalNum, int spatialNum, std::initializer_list<SpatialData> spatialList);
     
+    SVCProj(int temporalNum, int spatialNum, const SpatialDataVec &spatials);
+    
     ~SVCProj();
     
     /* url: input media like local mp4 and so on
      * dumpDir: where to store dump data
-     * maxSize: the max size of aync queue
-     * logLevel: reference to ffmpeg
+     * maxSize: the max size of aync queue, <= 0 keeps the default or, with a memory budget set, means no item limit
+     * logLevel: reference to ffmpeg, it is process wide (every session and ffmpeg itself), SVC_LOG_LEVEL_KEEP leaves it alone
      * RETURN: successful if 0, otherwise failed.
      */
-    void start(std::string &url, std::string &dumpDir, int maxSize, int logLevel);
+    void start(std::string &url, std::string &dumpDir, int maxSize, int logLevel = SVC_LOG_LEVEL_KEEP);
     
     SVCProj *interrupt();
     
-    void stop();
+    /* mode: drain or discard the data still in flight
+     * drainTimeoutMs: upper bound of a drain, the rest is discarded once it expires
+     */
+    void stop(SVCShutdownMode mode = SVC_SHUTDOWN_DRAIN, int drainTimeoutMs = 3000);
+    
+    /* pin the stage threads of this session to a cpu set / numa node and keep its
+     * frame and NAL buffers there, must be called before start
+     */
+    SVCProj *setPlacement(const PlacementPolicy &policy);
+    
+    /* size queues by memory instead of item count, must be called before start
+     * queueMaxBytes: payload bytes per queue, 0 for no limit
+     * sessionMaxBytes: payload bytes of all queues of this session together, 0 for no limit
+     * queueMaxLatencyMs: a queue refuses new items while its oldest one waited longer, 0 for no limit
+     */
+    SVCProj *setMemoryBudget(size_t queueMaxBytes, size_t sessionMaxBytes, int queueMaxLatencyMs = 0);
+    
+    /* SVC_ENCODE_SIMULCAST encodes every resolution independently (plain AVC per spatial layer,
+     * same dispatch and dumps), must be called before start
+     */
+    SVCProj *setEncodeMode(SVCEncodeMode mode);
+    
+    /* SVC_PIPELINE_FUSED saves a queue hop and a thread wakeup per frame, layered encode mode only
+     * (simulcast keeps its per level threads). Must be called before start
+     */
+    SVCProj *setPipelineMode(SVCPipelineMode mode);
+    
+    /* how every decoder / the decoder of (temporalId, spatialId) is fed once its queue is full, see SVCOverflowPolicy.
+     * Adaptive receivers keep their own stepping. Must be called before start
+     */
+    SVCProj *setOverflowPolicy(SVCOverflowPolicy policy);
+    
+    SVCProj *setOverflowPolicy(int temporalId, int spatialId, SVCOverflowPolicy policy);
+    
+    /* SVC_TEMPORAL_SHARED decodes each spatial layer once and derives the lower temporal
+     * operating points from its output, must be called before start
+     */
+    SVCProj *setTemporalMode(SVCTemporalMode mode);
+    
+    // receives every decoded picture of every operating point on the decoder threads, must be called before start
+    SVCProj *setFrameOutput(SVCFrameOutputCB frameOutput);
+    
+    /* write operating point (temporalId, spatialId) as fragmented mp4 / matroska with the audio of the input
+     * remuxed untouched, may be called once per operating point before start
+     */
+    SVCProj *addMuxOutput(int temporalId, int spatialId, const std::string &path, const std::string &format = "", int fragmentMs = 500);
+    
+    /* skip frames that did not change since the last encoded one before they are copied and encoded
+     * (screen share, surveillance), see ChangeDetectionSettings. Must be called before start
+     */
+    SVCProj *setChangeDetection(const ChangeDetectionSettings &settings);
+    
+    /* hash every access unit and decoded picture of every operating point into a per layer manifest
+     * (<dir>/SVC_T<t>_<w>x<h>.au.hash and .yuv.hash) or compare them against the golden ones in dir,
+     * start with an empty dumpDir to skip the yuv dumps. Must be called before start
+     */
+    SVCProj *setVerification(HashManifestMode mode, const std::string &manifestDir);
+    
+    // RETURN: manifests that did not match their golden one after stop, 0 if all matched or nothing was verified
+    int verifyFailures();
+    
+    // bounded probing, low delay demuxing and concurrent codec initialization, must be called before start
+    SVCProj *setStartupOptions(const StartupOptions &options);
+    
+    /* let every decoder fall back below its (T, S) while it can not keep up (decode time, queue depth)
+     * and come back once it can, a full decoder queue drops instead of blocking the encoder.
+     * Needs SVC_TEMPORAL_PER_DECODER, must be called before start
+     */
+    SVCProj *setAdaptiveReceivers(const AdaptiveSettings &settings);
+    
+    /* create a decoder only while its operating point has subscribers instead of all T x S of them up front,
+     * the yuv dumps then only hold what was decoded. Must be called before start
+     */
+    SVCProj *setLazyDecoders(bool lazy);
+    
+    /* queue capacity, codec threads, encoder complexity / slices and pipeline mode as found by
+     * `svcProj autotune`, its queue size wins over the one given to start. Must be called before start
+     */
+    SVCProj *setTuning(const SVCTuning &tuning);
+    
+    // RETURN: 0 if the tuning file could be read and applied, see SVCTuningFile
+    int loadTuning(const std::string &path);
+    
+    // stop reading the input after frames video packets of every track, 0 reads all of it. Must be called before start
+    SVCProj *setFrameLimit(int frames);
+    
+    /* process [beginMs, endMs) of the input, ms from its start: the demuxer seeks to the keyframe before beginMs,
+     * pictures before it are decoded but not encoded, reading stops once every track passed endMs and the
+     * h264 decoders are flushed. Timestamps stay those of the input, so chunks of one file line up.
+     * endMs <= 0 reads to the end. Must be called before start
+     */
+    SVCProj *setTimeRange(long long beginMs, long long endMs);
+    
+    /* thumbnails / preview ladders: only key frames are read and decoded, every one of them is encoded as an IDR
+     * of a single temporal layer at spatialIds (empty for all spatial layers; sizes are kept as configured unless the
+     * top layer is among them) and decoded by one decoder per spatial layer, pictures go out through the frame
+     * output / subscriptions. Must be called before start
+     */
+    SVCProj *setPreviewMode(const std::vector<int> &spatialIds);
+    
+    /* process several video tracks of the input in one demux pass, every track on a chain of its own
+     * (h264 decoder -> svc encoder -> svc decoders) with the settings of this session. Tags, dumps, manifests
+     * and shared memory rings of a track carry its stream index (SVC_V<i>_T<t>_<w>x<h>, <prefix>_V<i>_T<t>_S<s>),
+     * mux outputs get _v<i> in front of their extension. Subscriptions cover the operating point of every track.
+     * streamIndexes: the video streams to process, empty for all of them. Must be called before start
+     */
+    SVCProj *setVideoTracks(const std::vector<int> &streamIndexes);
+    
+    // RETURN: the chain of video stream streamIndex while running / after stop (this for the first track), NULL if not processed
+    SVCProj *track(int streamIndex);
+    
+    /* publish the access units of every operating point into POSIX shared memory rings named
+     * <prefix>_T<t>_S<s>.au (and the decoded pictures into <prefix>_T<t>_S<s>.yuv if frames),
+     * readers in other processes map them with ShmRingReader. Slow readers are overrun, never waited for.
+     * prefix: "/svc", keep it short, macOS allows 31 characters per name
+     * ringBytes: payload bytes of an access unit ring, 0 for 8 MB; a picture ring holds 8 pictures
+     * Must be called before start
+     */
+    SVCProj *setShmExport(const std::string &prefix, bool frames, size_t ringBytes = 0);
+    
+    // per frame latency of the running / last session, NULL before the first start
+    StageTimingsShr stageTimings();
+    
+    /* consume operating point (temporalId, spatialId), any time before or while running. A lazy decoder
+     * is created by the first subscriber and fed from the next IDR on, which is requested right away.
+     * output: called on the decoder thread with every picture of that operating point, may be NULL
+     * RETURN: subscription id >= 0, < 0 if there is no such operating point
+     */
+    int subscribe(int temporalId, int spatialId, SVCFrameOutputCB output = nullptr);
+    
+    // the last subscriber of a lazy decoder tears it down, queued data is dropped
+    void unsubscribe(int subscriptionId);
 
 private:
+    void startChain();
+    
+    bool selectedTrack(int streamIndex);
+    
+    void createTracks();
+    
+    std::shared_ptr<SVCProj> createTrack(AVStream *stream);
+    
+    std::string trackPath(const std::string &path);
+    
+    void seekToRange();
+    
+    long long frameTimestampMs(AVFrame *frame);
+    
+    long long packetTimestampMs(AVPacket *pkt, AVStream *stream);
+    
+    bool inTimeRange(long long timestampMs);
+    
+    int addSubscription(const SVCSubscription &subscription);
+    
+    void removeSubscription(int subscriptionId);
+    
     void correctSpatialData();
         
     int openInputSourceMedia(std::string &url, int logLevel);
         
-    SSourcePicture && createSSourcePicture(AVFrame *frame);
+    SVCPicture createSSourcePicture(AVFrame *frame);
     
     void initH264Decoder();
     
+    void createSVCH264Encoder();
+    
+    void createDispatcher();
+    
     void initSVCH264Encoder(int width, int height);
     
-    void initSVCH264Decoders();
+    void dispatchEncoded(bool eof, int status, SFrameBSInfo *pEncodedInfo, int spatialBase);
+    
+    int packAccessUnit(SFrameBSInfo *pEncodedInfo, int spatialBase, EncodedAccessUnit &au);
+    
+    void dispatchAccessUnit(EncodedAccessUnit &au);
+    
+    void feedDecoder(int layerAt, SVCDecoderShr &svcDecoder, SVCH264Data &&data);
+    
+    void reportOverflows();
+    
+    double sourceFrameRate();
+    
+    void reportFrameRates();
+    
+    void putPicture(SVCPicture &&picture);
+    
+    void encodeInline(SVCPicture &&picture);
+    
+    void createSVCH264Decoders();
+    
+    void initSVCH264Decoder(int layerAt);
+    
+    int startSVCH264Decoder(SVCDecoderShr svcDecoder, int layerAt);
+    
+    SVCDecoderShr createSVCH264Decoder(int layerAt);
+    
+    int decoderSlot(int temporalId, int spatialId);
+    
+    void acquireDecoder(int layerAt);
+    
+    SVCDecoderShr releaseDecoder(int layerAt);
+    
+    void publishOutputs(int layerAt);
+    
+    void requestIntraFrame(int spatialId);
+    
+    std::chrono::steady_clock::duration intraInterval();
+    
+    SVCDecoderShrVec decoderRoutes(bool idr, int firstSpatialId, int lastSpatialId);
+    
+    SVCDecoderShrVec liveDecoders();
+    
+    void startReadThread();
         
     std::string createExtraInfo(int temporalId, int spatialId, SpatialData &data);
+    
+    void interruptStages();
+    
+    void bindStageThreads();
+    
+    SyncQueueLimits queueLimits();
+    
+    bool waitStagesFinished(int timeoutMs);
+    
+    void resetStartupTimings();
+    
+    void markStartup(std::atomic<long long> &phase, const char *name);
+    
+    void waitStartup();
+    
+    void onStartupFinished();
+    
+    void closeManifests();
+    
+    void createMuxers();
+    
+    void closeMuxers();
+    
+    void createShmRings(int layerAt, int width, int height);
+    
+    void closeShmRings();
+    
+    void createAdaptiveReceivers();
+    
+    AdaptiveReceiverShr createAdaptiveReceiver(int layerAt);
+    
+    void dispatchAdaptive(SVCDecoderShrVec &routes, long long timestamp, int temporalId, int spatialId, MediaBufferShr &buffer, int size);
 
 private:
     int svcSpatialNum_;                     // svc Spatial number
     int svcTemporalNum_;                    // svc Temporal number
-    int syncQueueMaxSize_;                  // sync queue max size
-    std::string dumpDataDir_;               // where dump date to store
+    SVCSessionConfig config_;               // set before start, copied as a whole into every track
+    MemoryBudgetShr memoryBudget_;          // cap of all queues of this session, NULL for no limit
     AVStream *h264Stream_;                  // h264 stream
     AVFormatContext *fmtCtx_;               // input media for read
     std::atomic_bool stop_;                 // to control read thread
     std::atomic_bool started_;              // redundant protection
+    BufferPoolShr bufferPool_;              // pictures and NAL buffers of this session
+    ThreadPlacementShr placement_;          // where stage threads and buffers live, NULL if unpinned
+    StartupTimings startupTimings_;         // phases of the last start()
+    std::chrono::steady_clock::time_point startupBegin_;    // when the last start() was called
+    std::atomic_int pendingInits_;          // svc encoder and decoders still initializing
+    std::atomic_int pendingDecoderInits_;   // svc decoders still initializing
+    std::vector<std::future<void>> startupTasks_;           // concurrent initializations of a fast start
     ReadThreadShr readThread_;              // read thread instance
     H264DecoderShr h264Decoder_;            // h264 decoder context
     SpatialDataVec spatialSettings_;        // to store all svc spatial data setting
     SVCEncoderShr svcH264Encoder_;          // svc encoder  context
+    SimulcastEncoderShr simulcastEncoder_;  // simulcast encoders, NULL in layered mode
+    SVCDispatcherShr dispatcher_;           // the dispatch stage of a queued pipeline, NULL if fused
+    std::vector<uint64_t> overflowDrops_;   // access units each decoder lost to its policy, dispatch stage only
+    std::chrono::steady_clock::time_point lastOverflowIdr_;   // IDR last forced for an overflowed decoder, routeMutex_ held
+    uint64_t sourcePictures_;               // handed to the encoder, h264 decoder thread only
+    std::vector<uint64_t> codedPictures_;   // per spatial layer, below sourcePictures_ if its frame rate is capped. Dispatch stage only
+    StageTimingsShr stageTimings_;          // per frame latency decoded -> dispatched
+    std::string trackTag_;                  // "V<stream index>_" with several tracks, "" otherwise
+    SVCProj *parent_;                       // the session that reads the input for this track, NULL if it is that session
+    std::vector<std::shared_ptr<SVCProj>> tracks_;  // chains of the other tracks, fed by the read thread of this session
     SVCDecoderShrVec svcH264Decoders_;      // all decoder about svc decoding
+    std::vector<SVCLayerView> layerViews_;  // every (T, S) operating point, same index as svcH264Decoders_
+    std::vector<SVCMuxerShr> muxers_;       // their muxers while running, audio goes to all of them
+    std::shared_ptr<FrameChangeDetector> changeDetector_;  // static frame filter, NULL if every frame is encoded
+    int verifyFailures_;                    // manifests that failed at the last stop
+    std::vector<AdaptiveReceiverShr> adaptiveReceivers_;   // same index as svcH264Decoders_, empty if not adaptive
+    std::mutex adaptiveMutex_;              // simulcast levels dispatch from several threads
+    std::vector<SVCSubscription> subscriptions_;    // every consumer of an operating point
+    int nextSubscriptionId_;
+    std::vector<int> decoderRefs_;          // subscriptions per decoder, same index as svcH264Decoders_
+    std::vector<bool> decoderSynced_;       // false until a new decoder got its first IDR
+    std::vector<bool> decoderDisconnected_; // overflowed with SVC_OVERFLOW_DISCONNECT, never fed again
+    bool routesReady_;                      // decoders exist, subscriptions act on them right away
+    std::mutex routeMutex_;                 // svcH264Decoders_, decoderRefs_, decoderSynced_, subscriptions_, view outputs and tracks_
 };
 
 #endif /* SVCProj_hpp */
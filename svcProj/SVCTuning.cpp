@@ -0,0 +1,114 @@
+//
+//  SVCTuning.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "SVCTuning.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+static const SVCTuning kBuiltinTuning = {-1, -1, -1, -1, -1, -1};
+
+static std::string trim(const std::string &text) {
+    auto begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+
+    return text.substr(begin, text.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+const SVCTuning &SVCTuningFile::builtin() {
+    return kBuiltinTuning;
+}
+
+int SVCTuningFile::load(const std::string &path, SVCTuning &tuning) {
+    auto file = fopen(path.c_str(), "r");
+    if (!file) {
+        return -1;
+    }
+
+    char line[256];
+    auto lineNo = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNo++;
+        std::string text(line);
+        text = trim(text.substr(0, text.find('#')));
+        if (text.empty()) {
+            continue;
+        }
+
+        auto eq = text.find('=');
+        if (eq == std::string::npos) {
+            av_log(NULL, AV_LOG_WARNING, "SVCTuning: %s:%d is not key=value, skipped\n", path.c_str(), lineNo);
+            continue;
+        }
+
+        auto key = trim(text.substr(0, eq));
+        auto value = trim(text.substr(eq + 1));
+        if (key == "pipeline") {
+            tuning.fused = value == "fused" ? 1 : 0;
+            continue;
+        }
+
+        auto number = atoi(value.c_str());
+        if (key == "queue_max_size") {
+            tuning.queueMaxSize = number;
+        } else if (key == "h264_decoder_threads") {
+            tuning.decoderThreads = number;
+        } else if (key == "encoder_threads") {
+            tuning.encoderThreads = number;
+        } else if (key == "encoder_complexity") {
+            tuning.encoderComplexity = number;
+        } else if (key == "encoder_slices") {
+            tuning.encoderSlices = number;
+        } else {
+            av_log(NULL, AV_LOG_WARNING, "SVCTuning: %s:%d unknown key %s, skipped\n", path.c_str(), lineNo, key.c_str());
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+void SVCTuningFile::print(FILE *out, const SVCTuning &tuning) {
+    // built-in knobs stay out, a loader keeps its own for them
+    if (tuning.queueMaxSize >= 0) {
+        fprintf(out, "queue_max_size=%d\n", tuning.queueMaxSize);
+    }
+    if (tuning.decoderThreads >= 0) {
+        fprintf(out, "h264_decoder_threads=%d\n", tuning.decoderThreads);
+    }
+    if (tuning.encoderThreads >= 0) {
+        fprintf(out, "encoder_threads=%d\n", tuning.encoderThreads);
+    }
+    if (tuning.encoderComplexity >= 0) {
+        fprintf(out, "encoder_complexity=%d\n", tuning.encoderComplexity);
+    }
+    if (tuning.encoderSlices >= 0) {
+        fprintf(out, "encoder_slices=%d\n", tuning.encoderSlices);
+    }
+    if (tuning.fused >= 0) {
+        fprintf(out, "pipeline=%s\n", tuning.fused ? "fused" : "queued");
+    }
+}
+
+int SVCTuningFile::save(const std::string &path, const SVCTuning &tuning, const std::string &comment) {
+    auto file = fopen(path.c_str(), "w");
+    if (!file) {
+        return -1;
+    }
+
+    if (!comment.empty()) {
+        fprintf(file, "# %s\n", comment.c_str());
+    }
+    print(file, tuning);
+    return fclose(file) == 0 ? 0 : -2;
+}
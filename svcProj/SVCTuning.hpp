@@ -0,0 +1,49 @@
+//
+//  SVCTuning.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef SVCTuning_hpp
+#define SVCTuning_hpp
+
+#include <stdio.h>
+#include <string>
+
+// performance knobs of a session, -1 keeps the built-in value of a knob
+struct SVCTuning {
+    int queueMaxSize;       // items per stage queue
+    int decoderThreads;     // ffmpeg h264 decoder threads, 0 lets ffmpeg pick
+    int encoderThreads;     // OpenH264 iMultipleThreadIdc: 0 auto, 1 single threaded, n threads
+    int encoderComplexity;  // OpenH264 ECOMPLEXITY_MODE: 0 low, 1 medium, 2 high
+    int encoderSlices;      // slices per layer picture, 1 is a single slice
+    int fused;              // 1 for SVC_PIPELINE_FUSED, 0 for SVC_PIPELINE_QUEUED
+};
+
+using SVCTuning = struct SVCTuning;
+
+/* A tuning as a key=value text file, one knob per line, '#' starts a comment:
+ *     queue_max_size=16
+ *     h264_decoder_threads=4
+ *     encoder_threads=2
+ *     encoder_complexity=0
+ *     encoder_slices=2
+ *     pipeline=fused
+ * Missing keys keep their value, unknown ones are warned about and skipped.
+ */
+class SVCTuningFile {
+public:
+    // RETURN: 0 if the file was read, tuning only changes for the keys found in it
+    static int load(const std::string &path, SVCTuning &tuning);
+
+    // RETURN: 0 if the file was written, comment goes on top of it
+    static int save(const std::string &path, const SVCTuning &tuning, const std::string &comment);
+
+    static void print(FILE *out, const SVCTuning &tuning);
+
+    // every knob at -1
+    static const SVCTuning &builtin();
+};
+
+#endif /* SVCTuning_hpp */
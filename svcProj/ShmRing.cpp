@@ -0,0 +1,316 @@
+//
+//  ShmRing.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "ShmRing.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+#define SHM_RING_ALIGN          64
+#define SHM_RING_PAYLOAD_ALIGN  8
+
+static uint64_t roundUpPow2(uint64_t value) {
+    uint64_t pow2 = 1;
+    while (pow2 < value) {
+        pow2 <<= 1;
+    }
+
+    return pow2;
+}
+
+static size_t alignUp(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static size_t headerBytes() {
+    return alignUp(sizeof(ShmRingHeader), SHM_RING_ALIGN);
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &name, size_t dataBytes, uint32_t slotCount): name_(name), mappedBytes_(0), mapping_(NULL),
+header_(NULL), slots_(NULL), data_(NULL), writePos_(0) {
+    dataBytes_ = roundUpPow2(std::max(dataBytes, (size_t)4096));
+    slotCount_ = static_cast<uint32_t>(roundUpPow2(std::max(slotCount, 16u)));
+}
+
+ShmRingWriter::~ShmRingWriter() {
+    close();
+}
+
+const std::string &ShmRingWriter::name() {
+    return name_;
+}
+
+int ShmRingWriter::create(ShmRingKind kind, const std::string &tag, int temporalId, int spatialId, int width, int height) {
+    if (mapping_) {
+        return 0;
+    }
+
+    // a ring left behind by a crashed session goes, readers still mapping it keep their copy
+    shm_unlink(name_.c_str());
+    auto fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "ShmRing: shm_open %s failed: %s\n", name_.c_str(), strerror(errno));
+        return -1;
+    }
+
+    mappedBytes_ = headerBytes() + slotCount_ * sizeof(ShmRingSlot) + dataBytes_;
+    if (ftruncate(fd, static_cast<off_t>(mappedBytes_)) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "ShmRing: ftruncate %s to %zu failed: %s\n", name_.c_str(), mappedBytes_, strerror(errno));
+        ::close(fd);
+        shm_unlink(name_.c_str());
+        return -2;
+    }
+
+    auto mapping = mmap(NULL, mappedBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        av_log(NULL, AV_LOG_ERROR, "ShmRing: mmap %s failed: %s\n", name_.c_str(), strerror(errno));
+        shm_unlink(name_.c_str());
+        return -3;
+    }
+
+    // fresh pages are zero: every cursor at 0, every slot unpublished
+    mapping_ = mapping;
+    header_ = static_cast<ShmRingHeader *>(mapping);
+    slots_ = reinterpret_cast<ShmRingSlot *>(static_cast<unsigned char *>(mapping) + headerBytes());
+    data_ = reinterpret_cast<unsigned char *>(slots_ + slotCount_);
+    writePos_ = 0;
+
+    header_->version = SHM_RING_VERSION;
+    header_->headerBytes = static_cast<uint32_t>(headerBytes());
+    header_->slotCount = slotCount_;
+    header_->dataBytes = dataBytes_;
+    header_->kind = kind;
+    header_->width = width;
+    header_->height = height;
+    header_->temporalId = temporalId;
+    header_->spatialId = spatialId;
+    strncpy(header_->tag, tag.c_str(), SHM_RING_TAG_BYTES - 1);
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SHM_RING_MAGIC;    // readers accept the ring from here on
+    return 0;
+}
+
+unsigned char *ShmRingWriter::begin(size_t size, uint64_t &seq, ShmRingSlot *&slot) {
+    // payloads never wrap, a tail too short for this one is skipped
+    auto pos = writePos_;
+    if (pos % dataBytes_ + size > dataBytes_) {
+        pos += dataBytes_ - pos % dataBytes_;
+    }
+    writePos_ = pos + alignUp(size, SHM_RING_PAYLOAD_ALIGN);
+
+    seq = header_->writeSeq.load(std::memory_order_relaxed);
+    slot = &slots_[seq & (slotCount_ - 1)];
+    slot->lock.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);   // a reader that sees any field below also sees the slot odd
+    slot->offset = pos;
+    // readers seeing a payload of theirs below reservePos - dataBytes know it is being overwritten
+    header_->reservePos.store(pos + size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return data_ + pos % dataBytes_;
+}
+
+void ShmRingWriter::commit(uint64_t seq, ShmRingSlot *slot, size_t size, long long timestamp, int temporalId, uint32_t flags, int width, int height) {
+    slot->size = static_cast<uint32_t>(size);
+    slot->flags = flags;
+    slot->timestamp = timestamp;
+    slot->temporalId = temporalId;
+    slot->width = width;
+    slot->height = height;
+    slot->lock.store(2 * seq + 2, std::memory_order_release);
+    header_->writeSeq.store(seq + 1, std::memory_order_release);
+}
+
+int ShmRingWriter::publish(const unsigned char *payload, size_t size, long long timestamp, int temporalId, uint32_t flags) {
+    if (!header_) {
+        return -1;
+    }
+
+    if (size > dataBytes_ / 2) {
+        av_log(NULL, AV_LOG_WARNING, "ShmRing: %s drops a record of %zu bytes, the ring holds %zu\n", name_.c_str(), size, dataBytes_);
+        return -2;
+    }
+
+    uint64_t seq;
+    ShmRingSlot *slot;
+    auto dst = begin(size, seq, slot);
+    memcpy(dst, payload, size);
+    commit(seq, slot, size, timestamp, temporalId, flags, header_->width, header_->height);
+    return 0;
+}
+
+int ShmRingWriter::publishFrame(unsigned char *planes[3], int strideY, int strideUV, int width, int height, long long timestamp, int temporalId) {
+    if (!header_) {
+        return -1;
+    }
+
+    auto chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    size_t size = (size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight;
+    if (size > dataBytes_ / 2) {
+        av_log(NULL, AV_LOG_WARNING, "ShmRing: %s drops a %dx%d picture, the ring holds %zu bytes\n", name_.c_str(), width, height, dataBytes_);
+        return -2;
+    }
+
+    uint64_t seq;
+    ShmRingSlot *slot;
+    auto dst = begin(size, seq, slot);
+    for (auto row = 0; row < height; row++, dst += width) {
+        memcpy(dst, planes[0] + (size_t)row * strideY, width);
+    }
+    for (auto plane = 1; plane < 3; plane++) {
+        for (auto row = 0; row < chromaHeight; row++, dst += chromaWidth) {
+            memcpy(dst, planes[plane] + (size_t)row * strideUV, chromaWidth);
+        }
+    }
+    commit(seq, slot, size, timestamp, temporalId, 0, width, height);
+    return 0;
+}
+
+void ShmRingWriter::close() {
+    if (!mapping_) {
+        return;
+    }
+
+    header_->closed.store(1, std::memory_order_release);
+    munmap(mapping_, mappedBytes_);
+    shm_unlink(name_.c_str());
+    mapping_ = NULL;
+    header_ = NULL;
+    slots_ = NULL;
+    data_ = NULL;
+}
+
+ShmRingReader::ShmRingReader(): mappedBytes_(0), mapping_(NULL), header_(NULL), slots_(NULL), data_(NULL), cursor_(0), lagged_(0) {}
+
+ShmRingReader::~ShmRingReader() {
+    close();
+}
+
+int ShmRingReader::open(const std::string &name, bool fromOldest) {
+    close();
+    auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < headerBytes()) {
+        ::close(fd);
+        return -2;
+    }
+
+    auto mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return -3;
+    }
+
+    auto header = static_cast<const ShmRingHeader *>(mapping);
+    auto magic = header->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION ||
+        header->headerBytes + (size_t)header->slotCount * sizeof(ShmRingSlot) + header->dataBytes != (size_t)st.st_size) {
+        munmap(mapping, st.st_size);
+        return -4;
+    }
+
+    mappedBytes_ = st.st_size;
+    mapping_ = mapping;
+    header_ = header;
+    slots_ = reinterpret_cast<const ShmRingSlot *>(static_cast<const unsigned char *>(mapping) + header->headerBytes);
+    data_ = reinterpret_cast<const unsigned char *>(slots_ + header->slotCount);
+    auto writeSeq = header_->writeSeq.load(std::memory_order_acquire);
+    cursor_ = fromOldest ? oldest(writeSeq) : writeSeq;
+    lagged_ = 0;
+    return 0;
+}
+
+uint64_t ShmRingReader::oldest(uint64_t writeSeq) {
+    // the slot of writeSeq - slotCount may already be rewritten for writeSeq
+    return writeSeq >= header_->slotCount ? writeSeq - header_->slotCount + 1 : 0;
+}
+
+ShmRingStatus ShmRingReader::next(ShmRingRecord &record) {
+    if (!header_) {
+        return SHM_RING_CLOSED;
+    }
+
+    auto closed = header_->closed.load(std::memory_order_acquire);
+    auto writeSeq = header_->writeSeq.load(std::memory_order_acquire);
+    if (cursor_ >= writeSeq) {
+        return closed ? SHM_RING_CLOSED : SHM_RING_EMPTY;
+    }
+
+    auto first = oldest(writeSeq);
+    if (cursor_ < first) {
+        lagged_ += first - cursor_;
+        cursor_ = first;
+        return SHM_RING_LAGGED;
+    }
+
+    auto &slot = slots_[cursor_ & (header_->slotCount - 1)];
+    auto lock = slot.lock.load(std::memory_order_acquire);
+    record.seq = cursor_;
+    record.offset = slot.offset;
+    record.size = slot.size;
+    record.flags = slot.flags;
+    record.timestamp = slot.timestamp;
+    record.temporalId = slot.temporalId;
+    record.width = slot.width;
+    record.height = slot.height;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (lock != 2 * cursor_ + 2 || slot.lock.load(std::memory_order_relaxed) != lock) {
+        // rewritten under us, the writer lapped this cursor
+        lagged_++;
+        cursor_++;
+        return SHM_RING_LAGGED;
+    }
+
+    cursor_++;
+    record.payload = data_ + record.offset % header_->dataBytes;
+    if (!valid(record)) {
+        lagged_++;
+        return SHM_RING_LAGGED;
+    }
+
+    return SHM_RING_OK;
+}
+
+bool ShmRingReader::valid(const ShmRingRecord &record) {
+    if (!header_) {
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->reservePos.load(std::memory_order_relaxed) <= record.offset + header_->dataBytes;
+}
+
+const ShmRingHeader *ShmRingReader::header() {
+    return header_;
+}
+
+uint64_t ShmRingReader::lagged() {
+    return lagged_;
+}
+
+void ShmRingReader::close() {
+    if (mapping_) {
+        munmap(mapping_, mappedBytes_);
+    }
+    mapping_ = NULL;
+    header_ = NULL;
+    slots_ = NULL;
+    data_ = NULL;
+}
@@ -0,0 +1,169 @@
+//
+//  ShmRing.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef ShmRing_hpp
+#define ShmRing_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#define SHM_RING_MAGIC      0x52435653      // "SVCR"
+#define SHM_RING_VERSION    1
+#define SHM_RING_TAG_BYTES  64
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring cursors live in memory shared between processes, they have to be lock free");
+
+enum ShmRingKind {
+    SHM_RING_ACCESS_UNITS = 1,  // Annex-B access units of one operating point
+    SHM_RING_I420_FRAMES,       // decoded pictures, Y then U then V, stride == width
+};
+
+enum ShmRingStatus {
+    SHM_RING_OK = 0,
+    SHM_RING_EMPTY,             // nothing new, try again later
+    SHM_RING_LAGGED,            // the writer overwrote records not read yet, the cursor moved to the oldest one left
+    SHM_RING_CLOSED,            // the writer closed the ring and everything was read
+};
+
+enum ShmRingFlags {
+    SHM_RING_FLAG_IDR = 1,
+};
+
+/* Header schema, at offset 0 of the shared memory object, followed by slotCount ShmRingSlots
+ * and dataBytes of payload. All offsets are positions in the endless byte stream the writer
+ * produces, the payload of a record is at dataBase + offset % dataBytes and never wraps.
+ */
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerBytes;                   // sizeof(ShmRingHeader) rounded up to a cache line, the slots start there
+    uint32_t slotCount;                     // power of 2
+    uint64_t dataBytes;                     // power of 2
+    uint32_t kind;                          // ShmRingKind
+    int32_t width;                          // of the operating point
+    int32_t height;
+    int32_t temporalId;
+    int32_t spatialId;
+    std::atomic<uint32_t> closed;           // the writer is gone, read what is left
+    char tag[SHM_RING_TAG_BYTES];           // "SVC_T<t>_<w>x<h>"
+    std::atomic<uint64_t> writeSeq;         // records published so far
+    std::atomic<uint64_t> reservePos;       // end of the payload being written, bytes before reservePos - dataBytes are gone
+};
+
+// descriptor of record seq, lives in slot seq % slotCount
+struct ShmRingSlot {
+    std::atomic<uint64_t> lock;             // seqlock: 2 * seq + 1 while written, 2 * seq + 2 once published
+    uint64_t offset;                        // stream position of the payload
+    uint32_t size;
+    uint32_t flags;                         // ShmRingFlags
+    int64_t timestamp;                      // ms
+    int32_t temporalId;                     // of the access unit / picture
+    int32_t width;                          // I420 frames only
+    int32_t height;
+    int32_t reserved;
+};
+
+struct ShmRingRecord {
+    uint64_t seq;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    int64_t timestamp;
+    int temporalId;
+    int width;
+    int height;
+    const unsigned char *payload;           // inside the mapping, valid until ShmRingReader::valid() says otherwise
+};
+
+using ShmRingRecord = struct ShmRingRecord;
+
+/* Single producer: publish() copies the payload into the ring and never waits for readers,
+ * the oldest records are simply overwritten. The object is unlinked on close(), readers
+ * that mapped it keep reading what is left.
+ */
+class ShmRingWriter {
+public:
+    /* name: POSIX shared memory name, "/svc_T3_S2_au" (macOS allows 31 characters)
+     * dataBytes / slotCount: rounded up to powers of 2
+     */
+    ShmRingWriter(const std::string &name, size_t dataBytes, uint32_t slotCount);
+
+    ~ShmRingWriter();
+
+    // RETURN: 0 if the shared memory object was created and mapped
+    int create(ShmRingKind kind, const std::string &tag, int temporalId, int spatialId, int width, int height);
+
+    // RETURN: 0 if published, < 0 if the payload does not fit into half the ring
+    int publish(const unsigned char *payload, size_t size, long long timestamp, int temporalId, uint32_t flags);
+
+    // an I420 picture, packed on the way in
+    int publishFrame(unsigned char *planes[3], int strideY, int strideUV, int width, int height, long long timestamp, int temporalId);
+
+    void close();
+
+    const std::string &name();
+
+private:
+    // RETURN: where a payload of size bytes goes, it is reserved and its slot locked
+    unsigned char *begin(size_t size, uint64_t &seq, ShmRingSlot *&slot);
+
+    void commit(uint64_t seq, ShmRingSlot *slot, size_t size, long long timestamp, int temporalId, uint32_t flags, int width, int height);
+
+private:
+    std::string name_;
+    size_t dataBytes_;
+    uint32_t slotCount_;
+    size_t mappedBytes_;
+    void *mapping_;
+    ShmRingHeader *header_;
+    ShmRingSlot *slots_;
+    unsigned char *data_;
+    uint64_t writePos_;                     // next free stream position
+};
+
+/* Any number of readers, each with a cursor of its own, nothing is written to the ring.
+ * next() hands out pointers into the mapping: read the payload in place, then ask valid()
+ * whether the writer overwrote it meanwhile.
+ */
+class ShmRingReader {
+public:
+    ShmRingReader();
+
+    ~ShmRingReader();
+
+    // RETURN: 0 if mapped, the cursor starts at the oldest record still in the ring if fromOldest, else at the next one
+    int open(const std::string &name, bool fromOldest = false);
+
+    ShmRingStatus next(ShmRingRecord &record);
+
+    bool valid(const ShmRingRecord &record);
+
+    const ShmRingHeader *header();
+
+    uint64_t lagged();                      // records lost to the writer so far
+
+    void close();
+
+private:
+    uint64_t oldest(uint64_t writeSeq);
+
+private:
+    size_t mappedBytes_;
+    void *mapping_;
+    const ShmRingHeader *header_;
+    const ShmRingSlot *slots_;
+    const unsigned char *data_;
+    uint64_t cursor_;
+    uint64_t lagged_;
+};
+
+using ShmRingWriterShr = std::shared_ptr<ShmRingWriter>;
+
+#endif /* ShmRing_hpp */
@@ -0,0 +1,241 @@
+//
+//  SimulcastEncoder.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include "SimulcastEncoder.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+    #include "libavutil/pixfmt.h"
+    #include "libswscale/swscale.h"
+}
+
+SimulcastEncoder::SimulcastEncoder(const SyncQueueLimits &limits, BufferPoolShr bufferPool): encoderInitialized_(false), limits_(limits), bufferPool_(bufferPool),
+    pictureQueue_(std::make_shared<SyncQueue<SVCPicture>>(limits)), scalerThread_(NULL), tuning_(SVCTuningFile::builtin()), intraPeriod_(SVC_ENCODER_INTRA_PERIOD),
+    sourceFrameRate_(SVC_ENCODER_FRAME_RATE), runningLevels_(0) {}
+
+SimulcastEncoder::~SimulcastEncoder() {
+    for (auto it = scalers_.begin(); it != scalers_.end(); it++) {
+        if (*it) {
+            sws_freeContext(*it);
+        }
+    }
+}
+
+int SimulcastEncoder::initSimulcastEncoder(int width, int height, int temporalNum, std::vector<SpatialData> &spatials) {
+    if (spatials.empty() || width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < spatials.size(); i++) {  // levels are scaled down from the source, never up
+        auto &spatial = spatials.at(i);
+        if (spatial.width <= 0 || spatial.height <= 0 || spatial.width > width || spatial.height > height) {
+            av_log(NULL, AV_LOG_ERROR, "SimulcastEncoder: level %zu (%dx%d) does not fit the %dx%d source\n", i, spatial.width, spatial.height, width, height);
+            return -2;
+        }
+    }
+
+    levels_ = spatials;
+    scalers_.assign(levels_.size(), NULL);
+    scalerSources_.assign(levels_.size(), std::make_pair(0, 0));
+    for (size_t i = 0; i < levels_.size(); i++) {
+        // every level is an encoder of its own: one spatial layer, the same temporal structure
+        std::vector<SpatialData> level(1, levels_.at(i));
+        auto encoder = std::make_shared<SVCEncoder>(limits_);
+        encoder->setTuning(tuning_);
+        encoder->setIntraPeriod(intraPeriod_);
+        encoder->setSourceFrameRate(sourceFrameRate_);
+        auto ret = encoder->initSVCEncoder(level[0].width, level[0].height, temporalNum, 1, level);
+        if (ret) {
+            av_log(NULL, AV_LOG_ERROR, "SimulcastEncoder: level %zu (%dx%d) init failed, ret = %d\n", i, level[0].width, level[0].height, ret);
+            return ret;
+        }
+        encoders_.push_back(encoder);
+    }
+
+    encoderInitialized_ = true;
+    return 0;
+}
+
+void SimulcastEncoder::setTuning(const SVCTuning &tuning) {
+    tuning_ = tuning;
+}
+
+void SimulcastEncoder::setIntraPeriod(unsigned int frames) {
+    intraPeriod_ = frames;
+}
+
+void SimulcastEncoder::setSourceFrameRate(float fps) {
+    sourceFrameRate_ = fps;
+}
+
+int SimulcastEncoder::start(NotifySimulcastCB notify) {
+    if (!encoderInitialized_) {
+        return -1;
+    }
+
+    runningLevels_ = static_cast<int>(encoders_.size());
+    for (size_t i = 0; i < encoders_.size(); i++) {
+        encoders_.at(i)->start([this, i, notify](bool eof, int status, SFrameBSInfo *pEncodedInfo) {
+            if (!notify) {
+                return;
+            }
+
+            if (eof) {  // EOF goes out once, after the slowest level
+                if (--runningLevels_ == 0) {
+                    notify(true, 0, -1, NULL);
+                }
+                return;
+            }
+
+            notify(false, status, static_cast<int>(i), pEncodedInfo);
+        });
+    }
+
+    finished_ = finishedPromise_.get_future().share();
+    scalerThread_ = std::make_shared<std::thread>([this] {
+        SVCPicture sourcePic;
+        std::vector<SVCPicture> pyramid(levels_.size());
+        while (true) {
+            sourcePic = SVCPicture();
+            pictureQueue_->front(sourcePic);
+            if (!sourcePic.buffer || sourcePic.picture.iPicWidth <= 0 || sourcePic.picture.iPicHeight <= 0) {
+                break;
+            }
+
+            // every level straight from the source, scaling a scaled picture again would compound the filter loss
+            for (size_t level = 0; level < levels_.size(); level++) {
+                pyramid[level] = scale(sourcePic, static_cast<int>(level));
+            }
+
+            for (size_t level = 0; level < levels_.size(); level++) {
+                if (pyramid[level].buffer) {
+                    encoders_.at(level)->put(std::move(pyramid[level]));
+                }
+                pyramid[level] = SVCPicture();
+            }
+        }
+
+        sourcePic = SVCPicture();
+        for (auto it = encoders_.begin(); it != encoders_.end(); it++) {
+            (*it)->put(SVCPicture());   // EOF to every level
+        }
+
+        finishedPromise_.set_value();
+    });
+
+    return 0;
+}
+
+SVCPicture SimulcastEncoder::scale(SVCPicture &source, int level) {
+    auto &src = source.picture;
+    auto &spatial = levels_.at(level);
+    if (src.iPicWidth == spatial.width && src.iPicHeight == spatial.height) {
+        return source;  // the encoder only reads the planes, the buffer is shared
+    }
+
+    auto sourceSize = std::make_pair(src.iPicWidth, src.iPicHeight);
+    if (!scalers_[level] || scalerSources_[level] != sourceSize) {
+        if (scalers_[level]) {
+            sws_freeContext(scalers_[level]);
+        }
+        scalers_[level] = sws_getContext(src.iPicWidth, src.iPicHeight, AV_PIX_FMT_YUV420P, spatial.width, spatial.height, AV_PIX_FMT_YUV420P,
+                                         SWS_BILINEAR, NULL, NULL, NULL);
+        scalerSources_[level] = sourceSize;
+    }
+
+    SVCPicture scaled;
+    memset(&scaled.picture, 0, sizeof(SSourcePicture));
+    if (!scalers_[level]) {
+        return scaled;
+    }
+
+    auto chromaWidth = (spatial.width + 1) >> 1;   // odd sizes round the chroma up, like ffmpeg does
+    auto chromaHeight = (spatial.height + 1) >> 1;
+    auto ySize = spatial.width * spatial.height;
+    auto uvSize = chromaWidth * chromaHeight;
+    scaled.buffer = bufferPool_->acquire(ySize + uvSize * 2);
+    if (!scaled.buffer) {
+        av_log(NULL, AV_LOG_ERROR, "SimulcastEncoder: no memory for a %dx%d picture, drop it\n", spatial.width, spatial.height);
+        return scaled;
+    }
+
+    auto &dst = scaled.picture;
+    dst.iPicWidth = spatial.width;
+    dst.iPicHeight = spatial.height;
+    dst.iColorFormat = videoFormatI420;
+    dst.iStride[0] = spatial.width;
+    dst.iStride[1] = chromaWidth;
+    dst.iStride[2] = chromaWidth;
+    dst.pData[0] = scaled.buffer->data();
+    dst.pData[1] = dst.pData[0] + ySize;
+    dst.pData[2] = dst.pData[1] + uvSize;
+    dst.uiTimeStamp = src.uiTimeStamp;
+
+    sws_scale(scalers_[level], src.pData, src.iStride, 0, src.iPicHeight, dst.pData, dst.iStride);
+    return scaled;
+}
+
+void SimulcastEncoder::put(SVCPicture &&sourcePic) {
+    if (!pictureQueue_) {
+        return;
+    }
+
+    pictureQueue_->put(std::forward<SVCPicture>(sourcePic));
+}
+
+void SimulcastEncoder::forceIntraFrame(int level) {
+    for (size_t i = 0; i < encoders_.size(); i++) {
+        if (level < 0 || level == static_cast<int>(i)) {
+            encoders_.at(i)->forceIntraFrame();
+        }
+    }
+}
+
+void SimulcastEncoder::interrupt() {
+    if (pictureQueue_) {
+        pictureQueue_->interrupt();
+    }
+
+    for (auto it = encoders_.begin(); it != encoders_.end(); it++) {
+        (*it)->interrupt();
+    }
+}
+
+bool SimulcastEncoder::waitFinished(int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+    if (finished_.valid() && finished_.wait_until(deadline) != std::future_status::ready) {
+        return false;
+    }
+
+    for (auto it = encoders_.begin(); it != encoders_.end(); it++) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (!(*it)->waitFinished(static_cast<int>(std::max<long long>(left, 0)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SimulcastEncoder::stop() {
+    if (scalerThread_ && scalerThread_->joinable()) {
+        scalerThread_->join();
+    }
+
+    for (auto it = encoders_.begin(); it != encoders_.end(); it++) {
+        (*it)->stop();
+    }
+}
+
+EncoderThread &SimulcastEncoder::thread() {
+    return scalerThread_;
+}
+
+std::vector<SVCEncoderShr> &SimulcastEncoder::encoders() {
+    return encoders_;
+}
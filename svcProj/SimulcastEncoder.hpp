@@ -0,0 +1,105 @@
+//
+//  SimulcastEncoder.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef SimulcastEncoder_hpp
+#define SimulcastEncoder_hpp
+
+#include <stdio.h>
+#include <thread>
+#include <future>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include "SVCEncoder.hpp"
+
+struct SwsContext;
+
+using SVCEncoderShr = std::shared_ptr<SVCEncoder>;
+using NotifySimulcastCB = std::function<void (bool eof, int status, int spatialId, SFrameBSInfo *pEncodedInfo)>;
+
+/* Simulcast instead of spatial scalability: the scaler thread scales every source picture
+ * to each level (libswscale, always from the source), then every SpatialData gets its own
+ * single spatial layer SVCEncoder (plain AVC plus temporal layers) running on its own thread.
+ * The callback is called from all of these threads, spatialId tells which level it is,
+ * eof comes once, after the last level finished.
+ */
+class SimulcastEncoder {
+public:
+    SimulcastEncoder(const SyncQueueLimits &limits, BufferPoolShr bufferPool);
+
+    ~SimulcastEncoder();
+
+    /* width, height: of the source pictures, every level has to fit in it
+     * RETURN: 0 if successful
+     */
+    int initSimulcastEncoder(int width, int height, int temporalNum, std::vector<SpatialData> &spatials);
+
+    // of every level encoder, call before initSimulcastEncoder
+    void setTuning(const SVCTuning &tuning);
+
+    // of every level encoder, call before initSimulcastEncoder
+    void setIntraPeriod(unsigned int frames);
+
+    // of every level encoder, call before initSimulcastEncoder
+    void setSourceFrameRate(float fps);
+
+    int start(NotifySimulcastCB notify);
+
+    void put(SVCPicture &&sourcePic);
+
+    // the next picture of that level is encoded as an IDR, -1 for every level
+    void forceIntraFrame(int level);
+
+    void interrupt();
+
+    // RETURN: true if the scaler and every level encoder exited (or never started) within timeoutMs
+    bool waitFinished(int timeoutMs);
+
+    void stop();
+
+    EncoderThread &thread();        // the scaler thread
+
+    std::vector<SVCEncoderShr> &encoders();
+
+private:
+    SVCPicture scale(SVCPicture &source, int level);
+
+private:
+    bool encoderInitialized_;
+
+    SyncQueueLimits limits_;                    // of the level encoders too
+
+    BufferPoolShr bufferPool_;
+
+    PictureQueue pictureQueue_;
+
+    EncoderThread scalerThread_;
+
+    std::vector<SpatialData> levels_;
+
+    SVCTuning tuning_;
+
+    unsigned int intraPeriod_;
+
+    float sourceFrameRate_;
+
+    std::vector<SVCEncoderShr> encoders_;
+
+    std::vector<SwsContext *> scalers_;         // one per level, NULL if the level has the source size
+
+    std::vector<std::pair<int, int>> scalerSources_;   // source size each scaler was made for
+
+    std::atomic_int runningLevels_;
+
+    std::promise<void> finishedPromise_;
+
+    std::shared_future<void> finished_;
+};
+
+using SimulcastEncoderShr = std::shared_ptr<SimulcastEncoder>;
+
+#endif /* SimulcastEncoder_hpp */
@@ -0,0 +1,139 @@
+//
+//  StageTimings.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <algorithm>
+#include "StageTimings.hpp"
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+#define STAGE_TIMINGS_MAX_IN_FLIGHT 256     // bound for frames a consumer never reports (stopped, interrupted)
+
+static const char *kStageNames[SVC_STAGE_NUM] = {"copy", "queue", "encode", "dispatch", "total"};
+
+StageTimings::StageTimings(): handedAny_(false), encodedAny_(false) {
+    for (auto i = 0; i < SVC_STAGE_NUM; i++) {
+        samples_[i].next = 0;
+        samples_[i].count = 0;
+        samples_[i].sum = 0;
+        samples_[i].max = 0;
+    }
+}
+
+StageTimings::~StageTimings() {}
+
+void StageTimings::handedOff(long long timestamp, std::chrono::steady_clock::time_point decodedAt, double copyMs, int consumers) {
+    auto now = std::chrono::steady_clock::now();
+    consumers = std::max(std::min(consumers, STAGE_TIMINGS_MAX_CONSUMERS), 1);
+    auto pending = consumers == STAGE_TIMINGS_MAX_CONSUMERS ? ~0U : (1U << consumers) - 1;
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (!handedAny_) {
+        handedAny_ = true;
+        firstDecodedAt_ = decodedAt;
+    }
+    inFlight_[timestamp] = Handoff{decodedAt, now, pending};
+    while (inFlight_.size() > STAGE_TIMINGS_MAX_IN_FLIGHT) {
+        inFlight_.erase(inFlight_.begin());
+    }
+    record(SVC_STAGE_COPY, copyMs);
+}
+
+bool StageTimings::encoded(long long timestamp, int consumer, double encodeMs, std::chrono::steady_clock::time_point &decodedAt) {
+    auto now = std::chrono::steady_clock::now();
+    auto bit = 1U << std::max(std::min(consumer, STAGE_TIMINGS_MAX_CONSUMERS - 1), 0);
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto found = inFlight_.find(timestamp);
+    if (found == inFlight_.end() || !(found->second.pending & bit)) {
+        return false;
+    }
+
+    decodedAt = found->second.decodedAt;
+    auto sinceHandoff = std::chrono::duration<double, std::milli>(now - found->second.handedAt).count();
+    // this consumer is done with the frame and skipped the older ones, the others may still report them
+    for (auto it = inFlight_.begin(); it != inFlight_.end() && it->first <= timestamp;) {
+        it->second.pending &= ~bit;
+        if (it->second.pending == 0) {
+            it = inFlight_.erase(it);
+        } else {
+            it++;
+        }
+    }
+    encodedAny_ = true;
+    lastEncodedAt_ = now;
+    record(SVC_STAGE_ENCODE, encodeMs);
+    record(SVC_STAGE_QUEUE, std::max(sinceHandoff - encodeMs, 0.0));
+    return true;
+}
+
+void StageTimings::add(SVCStage stage, double ms) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    record(stage, ms);
+}
+
+// mutex_ held
+void StageTimings::record(SVCStage stage, double ms) {
+    auto &samples = samples_[stage];
+    if (samples.ms.size() < STAGE_TIMINGS_MAX_SAMPLES) {
+        samples.ms.push_back(ms);
+    } else {
+        samples.ms[samples.next] = ms;
+    }
+    samples.next = (samples.next + 1) % STAGE_TIMINGS_MAX_SAMPLES;
+    samples.count++;
+    samples.sum += ms;
+    samples.max = std::max(samples.max, ms);
+}
+
+void StageTimings::report(const char *mode) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    av_log(NULL, AV_LOG_INFO, "StageTimings[%s]: %-8s %8s %9s %9s %9s %9s\n", mode, "stage", "frames", "mean ms", "p50 ms", "p99 ms", "max ms");
+    for (auto i = 0; i < SVC_STAGE_NUM; i++) {
+        auto &samples = samples_[i];
+        if (!samples.count) {
+            continue;
+        }
+
+        auto sorted = samples.ms;
+        std::sort(sorted.begin(), sorted.end());
+        av_log(NULL, AV_LOG_INFO, "StageTimings[%s]: %-8s %8llu %9.3f %9.3f %9.3f %9.3f\n", mode, kStageNames[i], (unsigned long long)samples.count,
+               samples.sum / samples.count, percentileOf(sorted, 0.5), percentileOf(sorted, 0.99), samples.max);
+    }
+}
+
+uint64_t StageTimings::count(SVCStage stage) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return samples_[stage].count;
+}
+
+double StageTimings::percentile(SVCStage stage, double p) {
+    std::vector<double> sorted;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        sorted = samples_[stage].ms;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    return percentileOf(sorted, p);
+}
+
+double StageTimings::busySeconds() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (!handedAny_ || !encodedAny_) {
+        return 0;
+    }
+
+    return std::max(std::chrono::duration<double>(lastEncodedAt_ - firstDecodedAt_).count(), 0.0);
+}
+
+double StageTimings::percentileOf(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))];
+}
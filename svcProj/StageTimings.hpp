@@ -0,0 +1,92 @@
+//
+//  StageTimings.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef StageTimings_hpp
+#define StageTimings_hpp
+
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+#define STAGE_TIMINGS_MAX_SAMPLES   (1 << 16)   // per stage, the latest ones are kept for the percentiles
+#define STAGE_TIMINGS_MAX_CONSUMERS 32          // bits of Handoff::pending
+
+enum SVCStage {
+    SVC_STAGE_COPY = 0,     // decoded frame -> I420 picture
+    SVC_STAGE_QUEUE,        // picture handed to the encoder -> encoding begins (wakeup, queueing)
+    SVC_STAGE_ENCODE,       // EncodeFrame
+    SVC_STAGE_DISPATCH,     // NAL fan-out to dumps, muxers and decoder queues
+    SVC_STAGE_TOTAL,        // decoded frame -> dispatched
+    SVC_STAGE_NUM,
+};
+
+/* Per frame latency of the stages between the h264 decoder and the svc decoder queues,
+ * frames are followed by their timestamp. Thread safe.
+ */
+class StageTimings {
+public:
+    StageTimings();
+
+    ~StageTimings();
+
+    /* the h264 decoder output a frame, it took copyMs to turn it into the picture handed to the encoder
+     * consumers: encoders that each report the frame, one per simulcast level (at most STAGE_TIMINGS_MAX_CONSUMERS)
+     */
+    void handedOff(long long timestamp, std::chrono::steady_clock::time_point decodedAt, double copyMs, int consumers = 1);
+
+    /* encoder consumer (0 .. consumers - 1) output the frame (it took encodeMs), dispatch begins
+     * RETURN: false if the frame was not handed off (or is too old to be followed)
+     */
+    bool encoded(long long timestamp, int consumer, double encodeMs, std::chrono::steady_clock::time_point &decodedAt);
+
+    void add(SVCStage stage, double ms);
+
+    void report(const char *mode);
+
+    uint64_t count(SVCStage stage);
+
+    // p in [0, 1] over the latest samples, 0 if there are none
+    double percentile(SVCStage stage, double p);
+
+    // RETURN: seconds from the first frame handed off (its decode time) to the last one encoded, 0 if none yet
+    double busySeconds();
+
+private:
+    void record(SVCStage stage, double ms);
+
+    static double percentileOf(const std::vector<double> &sorted, double p);
+
+private:
+    struct Handoff {
+        std::chrono::steady_clock::time_point decodedAt;
+        std::chrono::steady_clock::time_point handedAt;
+        uint32_t pending;       // consumers that have not reported the frame yet
+    };
+
+    struct Samples {
+        std::vector<double> ms;     // ring of the latest samples
+        size_t next;
+        uint64_t count;
+        double sum;
+        double max;
+    };
+
+    std::mutex mutex_;
+    std::map<long long, Handoff> inFlight_;     // timestamp -> handoff of frames not dispatched yet
+    bool handedAny_;
+    bool encodedAny_;
+    std::chrono::steady_clock::time_point firstDecodedAt_;
+    std::chrono::steady_clock::time_point lastEncodedAt_;
+    Samples samples_[SVC_STAGE_NUM];
+};
+
+using StageTimingsShr = std::shared_ptr<StageTimings>;
+
+#endif /* StageTimings_hpp */
@@ -10,94 +10,375 @@
 #include <stdio.h>
 #include <list>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <iostream>
+#include <unordered_map>
 #include <condition_variable>
 using namespace std;
 
+// 队列中一个元素占用的字节数, 持有内存的payload需要特化
 template <typename T>
-class SyncQueue {
+struct SyncQueueItemBytes {
+    static size_t bytes(const T &t) {
+        return sizeof(T);
+    }
+};
+
+// 计入session上限的字节数: 多个队列同时持有的同一payload(key相同)只计一次, 共享payload需要特化
+template <typename T>
+struct SyncQueueItemBudget {
+    static size_t bytes(const T &t) {
+        return SyncQueueItemBytes<T>::bytes(t);
+    }
+
+    // NULL if t shares nothing with items of other queues
+    static const void *key(const T &) {
+        return NULL;
+    }
+};
+
+// 一个session内所有队列共享的内存上限
+class MemoryBudget {
 public:
-    SyncQueue(int maxSize):maxSize_(maxSize), stop_(false) {}
-    
-    ~SyncQueue() {}
-    
-    void put(T&& t) {
+    MemoryBudget(size_t maxBytes):maxBytes_(maxBytes), usedBytes_(0), peakBytes_(0) {}
+
+    /* 阻塞直到bytes放得下, overcommit()为true时(目标队列为空)直接放行, 保证消费者总有数据可取, 不会互相等死
+     * shared: 多个队列共同持有的payload, 已被计入时只增加引用, 不再等待也不重复计数
+     * RETURN: false if cancelled() became true while waiting
+     */
+    template <typename Overcommit, typename Cancelled>
+    bool acquire(size_t bytes, Overcommit overcommit, Cancelled cancelled, const void *shared = NULL) {
         std::unique_lock<std::mutex> locker(mutex_);
-        notFull_.wait(locker, [this]{
-            auto full = dataQueue_.size() >= maxSize_;
-            return stop_ || !full;
+        if (holdShared(shared)) {
+            return true;
+        }
+
+        cond_.wait(locker, [&]{
+            return cancelled() || overcommit() || usedBytes_ + bytes <= maxBytes_;
         });
-        
-        if (stop_) {
-            return;
+
+        if (cancelled()) {
+            return false;
         }
-        
-        dataQueue_.push_back(std::forward<T>(t));
-        notEmpty_.notify_one();
+
+        charge(bytes, shared);
+        return true;
+    }
+
+    // 不等待的acquire, RETURN: true if granted
+    bool tryAcquire(size_t bytes, bool overcommit, const void *shared = NULL) {
+        std::unique_lock<std::mutex> locker(mutex_);
+        if (holdShared(shared)) {
+            return true;
+        }
+
+        if (!overcommit && usedBytes_ + bytes > maxBytes_) {
+            return false;
+        }
+
+        charge(bytes, shared);
+        return true;
+    }
+
+    // shared: the one it was acquired with, the bytes go back with its last holder
+    void release(size_t bytes, const void *shared = NULL) {
+        std::unique_lock<std::mutex> locker(mutex_);
+        if (shared) {
+            auto it = sharedHolders_.find(shared);
+            if (it == sharedHolders_.end() || --it->second > 0) {
+                return;
+            }
+            sharedHolders_.erase(it);
+        }
+
+        usedBytes_ -= std::min(bytes, usedBytes_);
+        cond_.notify_all();
+    }
+
+    void wakeup() {
+        std::unique_lock<std::mutex> locker(mutex_);
+        cond_.notify_all();
+    }
+
+    size_t maxBytes() {
+        return maxBytes_;
+    }
+
+    size_t usedBytes() {
+        std::unique_lock<std::mutex> locker(mutex_);
+        return usedBytes_;
+    }
+
+    size_t peakBytes() {
+        std::unique_lock<std::mutex> locker(mutex_);
+        return peakBytes_;
+    }
+
+private:
+    // mutex_ held, RETURN: true if shared is charged already, it has one more holder now
+    bool holdShared(const void *shared) {
+        if (!shared) {
+            return false;
+        }
+
+        auto it = sharedHolders_.find(shared);
+        if (it == sharedHolders_.end()) {
+            return false;
+        }
+
+        it->second++;
+        return true;
+    }
+
+    // mutex_ held
+    void charge(size_t bytes, const void *shared) {
+        usedBytes_ += bytes;
+        peakBytes_ = std::max(peakBytes_, usedBytes_);
+        if (shared) {
+            sharedHolders_[shared] = 1;
+        }
+    }
+
+private:
+    size_t maxBytes_;
+    size_t usedBytes_;
+    size_t peakBytes_;
+    std::unordered_map<const void *, int> sharedHolders_;   // payload -> queued items holding it
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+using MemoryBudgetShr = std::shared_ptr<MemoryBudget>;
+
+// 队列容量: 个数/字节/队首等待时长, 任意一项为0表示不限制
+struct SyncQueueLimits {
+    SyncQueueLimits(int maxSize = 0, size_t maxBytes = 0, int maxLatencyMs = 0, MemoryBudgetShr budget = nullptr):
+        maxSize(maxSize), maxBytes(maxBytes), maxLatencyMs(maxLatencyMs), budget(budget) {}
+
+    int maxSize;                // max items
+    size_t maxBytes;            // max payload bytes of this queue
+    int maxLatencyMs;           // refuse new items while the oldest one has waited longer than this
+    MemoryBudgetShr budget;     // shared by all queues of a session
+};
+
+template <typename T>
+class SyncQueue {
+public:
+    SyncQueue(const SyncQueueLimits &limits):stop_(false), limits_(limits), bytes_(0), count_(0) {}
+
+    ~SyncQueue() {
+        discard();
+    }
+
+    void put(T&& t) {
+        putItem(std::forward<T>(t));
     }
-    
+
     void put(const T& t) {
+        putItem(t);
+    }
+
+    // 放不下时不阻塞, 直接返回false(t保持不变), 慢消费者不会拖住生产者
+    bool tryPut(T&& t) {
+        auto bytes = SyncQueueItemBytes<T>::bytes(t);
         std::unique_lock<std::mutex> locker(mutex_);
-        notFull_.wait(locker, [this]{
-            auto full = dataQueue_.size() >= maxSize_;
-            return stop_ || !full;
+        if (stop_ || !admissible(bytes) || !tryCharge(t)) {
+            return false;
+        }
+
+        push(std::move(t), bytes);
+        return true;
+    }
+
+    // 最多等待timeoutMs, 超时或被中止时返回false(t保持不变), 调用方可以改用interrupt()
+    bool putFor(T&& t, int timeoutMs) {
+        auto bytes = SyncQueueItemBytes<T>::bytes(t);
+        std::unique_lock<std::mutex> locker(mutex_);
+        auto fits = notFull_.wait_for(locker, std::chrono::milliseconds(timeoutMs), [this, bytes]{
+            return stop_ || admissible(bytes);
         });
 
-        if (stop_) {
-            return;
+        if (!fits || stop_ || !tryCharge(t)) {
+            return false;
         }
-        
-        dataQueue_.push_back(std::move<T>(t));
-        notEmpty_.notify_one();
+
+        push(std::move(t), bytes);
+        return true;
     }
-    
+
     void front(T &t) {
-        std::unique_lock<std::mutex> locker(mutex_);
-        notEmpty_.wait(locker, [this]{
-            return stop_ || !dataQueue_.empty();
-        });
-        
-        if (stop_) {
-            return;
+        T taken;
+        {
+            std::unique_lock<std::mutex> locker(mutex_);
+            notEmpty_.wait(locker, [this]{
+                return stop_ || !dataQueue_.empty();
+            });
+
+            if (stop_) {
+                return;
+            }
+
+            taken = std::move(dataQueue_.front().data);
+            bytes_ -= dataQueue_.front().bytes;
+            dataQueue_.pop_front();
+            count_ = dataQueue_.size();
+            notFull_.notify_all();  // 字节/时延限制下可能一次腾出多个位置
         }
-        
-        t = dataQueue_.front();
-        dataQueue_.pop_front();
-        notFull_.notify_one();
+
+        refund(taken);
+        t = std::move(taken);
     }
-    
-    void interrupt () { // 调用此函数可能会导致队列中的数据没被取走就被中止--->内存泄漏
+
+    void interrupt () { // 中止队列, 未被取走的数据会被丢弃(由T自身的析构函数释放)
         {
             std::unique_lock<std::mutex> locker(mutex_);
             stop_ = true;
         }
-        
+
+        discard();
         notFull_.notify_all();
         notEmpty_.notify_all();
+        if (limits_.budget) {
+            limits_.budget->wakeup();
+        }
     }
-    
+
     bool empty() {
         std::unique_lock<std::mutex> locker(mutex_);
         return dataQueue_.empty();
     }
-    
+
     bool full() {
         std::unique_lock<std::mutex> locker(mutex_);
-        return dataQueue_.size() == maxSize_;
+        return !admissible(0);
     }
-    
+
     size_t size() {
         std::unique_lock<std::mutex> locker(mutex_);
         return dataQueue_.size();
     }
-    
+
+    size_t bytes() {
+        std::unique_lock<std::mutex> locker(mutex_);
+        return bytes_;
+    }
+
+private:
+    struct Item {
+        T data;
+        size_t bytes;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    template <typename U>
+    void putItem(U&& t) {
+        auto bytes = SyncQueueItemBytes<T>::bytes(t);
+        auto budgetBytes = SyncQueueItemBudget<T>::bytes(t);
+        auto budgetKey = SyncQueueItemBudget<T>::key(t);
+        std::unique_lock<std::mutex> locker(mutex_);
+        while (true) {
+            notFull_.wait(locker, [this, bytes]{
+                return stop_ || admissible(bytes);
+            });
+
+            if (stop_) {
+                return;
+            }
+
+            if (!limits_.budget) {
+                break;
+            }
+
+            // session上限, 等待时不持有队列锁, 消费者可以继续取数据
+            locker.unlock();
+            auto granted = limits_.budget->acquire(budgetBytes, [this]{ return count_ == 0; }, [this]{ return stop_.load(); }, budgetKey);
+            locker.lock();
+            if (granted && !stop_ && admissible(bytes)) {
+                break;
+            }
+
+            if (granted) {  // another producer took the room meanwhile, wait for it again
+                limits_.budget->release(budgetBytes, budgetKey);
+            }
+
+            if (!granted || stop_) {
+                return;
+            }
+        }
+
+        push(std::forward<U>(t), bytes);
+    }
+
+    // mutex_ held, the item fits
+    template <typename U>
+    void push(U&& t, size_t bytes) {
+        dataQueue_.push_back(Item{std::forward<U>(t), bytes, std::chrono::steady_clock::now()});
+        bytes_ += bytes;
+        count_ = dataQueue_.size();
+        notEmpty_.notify_one();
+    }
+
+    // RETURN: true if the budget (if any) took t
+    bool tryCharge(const T &t) {
+        return !limits_.budget || limits_.budget->tryAcquire(SyncQueueItemBudget<T>::bytes(t), count_ == 0, SyncQueueItemBudget<T>::key(t));
+    }
+
+    // t left the queue
+    void refund(const T &t) {
+        if (limits_.budget) {
+            limits_.budget->release(SyncQueueItemBudget<T>::bytes(t), SyncQueueItemBudget<T>::key(t));
+        }
+    }
+
+    // 空队列总是可以放入, 否则会出现消费者无数据可取而生产者一直等待的情况
+    bool admissible(size_t bytes) {
+        if (dataQueue_.empty()) {
+            return true;
+        }
+
+        if (limits_.maxSize > 0 && dataQueue_.size() >= static_cast<size_t>(limits_.maxSize)) {
+            return false;
+        }
+
+        if (limits_.maxBytes > 0 && bytes_ + bytes > limits_.maxBytes) {
+            return false;
+        }
+
+        if (limits_.maxLatencyMs > 0) {
+            auto waited = std::chrono::steady_clock::now() - dataQueue_.front().enqueued;
+            if (waited >= std::chrono::milliseconds(limits_.maxLatencyMs)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void discard() {
+        std::list<Item> discarded;
+        {
+            std::unique_lock<std::mutex> locker(mutex_);
+            discarded.swap(dataQueue_);
+            bytes_ = 0;
+            count_ = 0;
+        }
+
+        for (auto it = discarded.begin(); it != discarded.end(); it++) {
+            refund(it->data);
+        }
+    }
+
 private:
-    bool stop_;
-    int maxSize_;
+    std::atomic_bool stop_;
+    SyncQueueLimits limits_;
+    size_t bytes_;
+    std::atomic<size_t> count_;     // dataQueue_.size() readable without mutex_
     std::mutex mutex_;
-    std::list<T> dataQueue_;
+    std::list<Item> dataQueue_;
     std::condition_variable notEmpty_;
     std::condition_variable notFull_;
-    
+
 };
 #endif /* SyncQueue_hpp */
@@ -0,0 +1,245 @@
+//
+//  ThreadPlacement.cpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#include <set>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include "ThreadPlacement.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+extern "C"
+{
+    #include "libavutil/log.h"
+}
+
+#define NUMA_SYSFS_DIR  "/sys/devices/system/node"
+
+ThreadPlacement::ThreadPlacement(const PlacementPolicy &policy): policy_(policy), callerBound_(false) {
+    cpus_ = policy_.cpus;
+    if (cpus_.empty() && policy_.numaNode >= 0) {
+        cpus_ = cpusOfNode(policy_.numaNode);
+    }
+}
+
+ThreadPlacement::~ThreadPlacement() {}
+
+bool ThreadPlacement::enabled() {
+    return !cpus_.empty() || policy_.numaNode >= 0;
+}
+
+const PlacementPolicy &ThreadPlacement::policy() {
+    return policy_;
+}
+
+int ThreadPlacement::bindHandle(std::thread::native_handle_type handle) {
+#if defined(__linux__)
+    if (cpus_.empty()) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus_) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return pthread_setaffinity_np(handle, sizeof(cpu_set_t), &set);
+#elif defined(__APPLE__)
+    // threads sharing a tag are kept on the same L2 where possible, that is all macOS offers
+    thread_affinity_policy_data_t tag = { policy_.numaNode + 1 };
+    auto ret = thread_policy_set(pthread_mach_thread_np(handle), THREAD_AFFINITY_POLICY, (thread_policy_t)&tag, THREAD_AFFINITY_POLICY_COUNT);
+    return ret == KERN_SUCCESS ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+int ThreadPlacement::bindThread(std::thread &thread, const std::string &name) {
+    if (!enabled() || !thread.joinable()) {
+        return -1;
+    }
+
+    auto ret = bindHandle(thread.native_handle());
+    if (ret) {
+        av_log(NULL, AV_LOG_WARNING, "ThreadPlacement: failed to bind %s, ret = %d\n", name.c_str(), ret);
+    }
+
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set) == 0) {
+        for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#else
+    cpus = cpus_;
+#endif
+
+    std::unique_lock<std::mutex> locker(mutex_);
+    threads_.push_back(std::make_pair(name, cpus));
+    return ret;
+}
+
+int ThreadPlacement::bindCurrentThread() {
+    if (!enabled() || callerBound_) {
+        return -1;
+    }
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    callerCpus_.clear();
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0) {
+        for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                callerCpus_.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    callerBound_ = bindHandle(pthread_self()) == 0;
+    return callerBound_ ? 0 : -1;
+}
+
+void ThreadPlacement::restoreCurrentThread() {
+    if (!callerBound_) {
+        return;
+    }
+
+    callerBound_ = false;
+#if defined(__linux__)
+    if (callerCpus_.empty()) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : callerCpus_) {
+        CPU_SET(cpu, &set);
+    }
+
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+#endif
+}
+
+void ThreadPlacement::report() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    av_log(NULL, AV_LOG_INFO, "ThreadPlacement: numa node = %d, cpus = %s, numa nodes on host = %d\n",
+           policy_.numaNode, formatCpus(cpus_).c_str(), numaNodeCount());
+    for (auto it = threads_.begin(); it != threads_.end(); it++) {
+        std::set<int> nodeSet;
+        for (auto cpu : it->second) {
+            nodeSet.insert(nodeOfCpu(cpu));
+        }
+
+        std::string nodes;
+        for (auto node : nodeSet) {
+            nodes.append(nodes.empty() ? "" : ",").append(std::to_string(node));
+        }
+
+        av_log(NULL, AV_LOG_INFO, "ThreadPlacement: %-24s cpus = %s, nodes = %s\n", it->first.c_str(),
+               formatCpus(it->second).c_str(), nodes.empty() ? "?" : nodes.c_str());
+    }
+}
+
+int ThreadPlacement::numaNodeCount() {
+    auto count = 0;
+    while (true) {
+        std::string path = NUMA_SYSFS_DIR "/node";
+        path.append(std::to_string(count));
+        if (access(path.c_str(), F_OK) != 0) {
+            break;
+        }
+
+        count++;
+    }
+
+    return std::max(count, 1);
+}
+
+std::vector<int> ThreadPlacement::cpusOfNode(int node) {
+    std::vector<int> cpus;
+    std::string path = NUMA_SYSFS_DIR "/node";
+    path.append(std::to_string(node)).append("/cpulist");
+    auto file = fopen(path.c_str(), "r");
+    if (!file) {
+        if (node == 0) {    // no numa information, node 0 is the whole machine
+            auto count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            for (auto cpu = 0; cpu < count; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // cpulist looks like "0-15,32-47"
+    int first = 0, last = 0;
+    while (fscanf(file, "%d", &first) == 1) {
+        last = first;
+        auto sep = fgetc(file);
+        if (sep == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+            sep = fgetc(file);
+        }
+
+        for (auto cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+
+        if (sep != ',') {
+            break;
+        }
+    }
+
+    fclose(file);
+    return cpus;
+}
+
+int ThreadPlacement::nodeOfCpu(int cpu) {
+    auto nodes = numaNodeCount();
+    for (auto node = 0; node < nodes; node++) {
+        auto cpus = cpusOfNode(node);
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+            return node;
+        }
+    }
+
+    return -1;
+}
+
+std::string ThreadPlacement::formatCpus(const std::vector<int> &cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        auto first = cpus[i];
+        while (i + 1 < cpus.size() && cpus[i + 1] == cpus[i] + 1) {
+            i++;
+        }
+
+        text.append(text.empty() ? "" : ",").append(std::to_string(first));
+        if (cpus[i] != first) {
+            text.append("-").append(std::to_string(cpus[i]));
+        }
+    }
+
+    return text.empty() ? "any" : text;
+}
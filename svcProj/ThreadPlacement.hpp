@@ -0,0 +1,80 @@
+//
+//  ThreadPlacement.hpp
+//  svc
+//
+//  Created by Asterisk on 10/19/26.
+//
+
+#ifndef ThreadPlacement_hpp
+#define ThreadPlacement_hpp
+
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+
+enum HugePageMode {
+    HUGE_PAGE_NONE = 0,
+    HUGE_PAGE_TRANSPARENT,      // madvise(MADV_HUGEPAGE), the kernel promotes when it can
+    HUGE_PAGE_EXPLICIT,         // MAP_HUGETLB from the reserved pool, falls back to normal pages
+};
+
+struct PlacementPolicy {
+    int numaNode;               // -1: do not bind to a node
+    std::vector<int> cpus;      // empty: every cpu of numaNode, or no pinning at all if numaNode < 0
+    HugePageMode hugePages;     // for frame and NAL buffers
+};
+
+using PlacementPolicy = struct PlacementPolicy;
+
+class ThreadPlacement;
+using ThreadPlacementShr = std::shared_ptr<ThreadPlacement>;
+
+/* Pins the stage threads of one session to a cpu set and remembers where each of them went.
+ * Linux pins for real, macOS only gets an affinity tag per node (a scheduling hint).
+ */
+class ThreadPlacement {
+public:
+    ThreadPlacement(const PlacementPolicy &policy);
+
+    ~ThreadPlacement();
+
+    bool enabled();
+
+    const PlacementPolicy &policy();
+
+    // RETURN: 0 if successful
+    int bindThread(std::thread &thread, const std::string &name);
+
+    /* threads created by the current thread (ffmpeg/openh264 workers) inherit its placement,
+     * so bind it for the duration of the setup and restore it afterwards.
+     */
+    int bindCurrentThread();
+
+    void restoreCurrentThread();
+
+    void report();
+
+    static int numaNodeCount();
+
+    static std::vector<int> cpusOfNode(int node);
+
+    static int nodeOfCpu(int cpu);
+
+private:
+    int bindHandle(std::thread::native_handle_type handle);
+
+    static std::string formatCpus(const std::vector<int> &cpus);
+
+private:
+    std::mutex mutex_;
+    PlacementPolicy policy_;
+    std::vector<int> cpus_;                                         // resolved cpu set
+    bool callerBound_;
+    std::vector<int> callerCpus_;                                   // to restore the caller
+    std::vector<std::pair<std::string, std::vector<int>>> threads_; // name -> cpus it may run on
+};
+
+#endif /* ThreadPlacement_hpp */
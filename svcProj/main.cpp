@@ -7,22 +7,193 @@
 
 #include <iostream>
 #include "SVCProj.hpp"
+#include "ReplayBench.hpp"
+#include "LayerAnalyzer.hpp"
+#include "Autotuner.hpp"
+
+// svcProj analyze <dump.data>... : per (T,S) statistics of Annex-B dumps
+static int analyze(int argc, const char * argv[])
+{
+    auto ret = 0;
+    for (auto i = 0; i < argc; i++) {
+        if (LayerAnalyzer::analyzeFile(argv[i], stdout)) {
+            ret = -1;
+        }
+    }
+    
+    return ret;
+}
+
+// svcProj replay [--fps N] [--loops N] [--serial] [--queue N] <dump.data>... : decode-only benchmark of dumps
+static int replay(int argc, const char * argv[])
+{
+    ReplayOptions options = {0, 1, false, 8};
+    std::vector<std::string> files;
+    for (auto i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fps" && i + 1 < argc) {
+            options.fps = atof(argv[++i]);
+        } else if (arg == "--loops" && i + 1 < argc) {
+            options.loops = atoi(argv[++i]);
+        } else if (arg == "--queue" && i + 1 < argc) {
+            options.queueSize = atoi(argv[++i]);
+        } else if (arg == "--serial") {
+            options.serial = true;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    
+    ReplayBench bench(options);
+    for (auto it = files.begin(); it != files.end(); it++) {
+        if (bench.load(*it)) {
+            return -1;
+        }
+    }
+    
+    return bench.run(stdout);
+}
+
+// svcProj shmtail [--oldest] <name> : follow a ring exported by SVCProj::setShmExport, "/svc_T3_S2.au"
+static int shmtail(int argc, const char * argv[])
+{
+    std::string name;
+    auto oldest = false;
+    for (auto i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--oldest") {
+            oldest = true;
+        } else {
+            name = arg;
+        }
+    }
+    
+    ShmRingReader reader;
+    if (reader.open(name, oldest)) {
+        fprintf(stderr, "can not map %s\n", name.c_str());
+        return -1;
+    }
+    
+    auto header = reader.header();
+    printf("%s: %s T%d S%d %dx%d, %u slots, %llu bytes\n", name.c_str(), header->tag, header->temporalId, header->spatialId,
+           header->width, header->height, header->slotCount, (unsigned long long)header->dataBytes);
+    ShmRingRecord record;
+    for (;;) {
+        auto status = reader.next(record);
+        if (status == SHM_RING_CLOSED) {
+            break;
+        } else if (status == SHM_RING_EMPTY) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } else if (status == SHM_RING_LAGGED) {
+            printf("lagged, %llu records lost so far\n", (unsigned long long)reader.lagged());
+        } else {
+            // a consumer works on record.payload in place here, then checks it was not overwritten meanwhile
+            auto intact = reader.valid(record);
+            printf("#%llu ts %lld T%d %u bytes%s%s\n", (unsigned long long)record.seq, (long long)record.timestamp, record.temporalId,
+                   record.size, record.flags & SHM_RING_FLAG_IDR ? " IDR" : "", intact ? "" : " (overwritten)");
+        }
+    }
+    
+    printf("%s closed, %llu records lost\n", name.c_str(), (unsigned long long)reader.lagged());
+    return 0;
+}
+
+static SpatialDataVec defaultSpatials()
+{
+    return {
+        {640,   360,    600 * 1024,     0},     // 360p 600Kb, source frame rate
+        {854,   480,    1000 * 1024,    0},     // 480p 1000Kb
+        {1280,  720,    2000 * 1024,    0},     // 720p 2000Kb
+        {1920,  1080,   4500 * 1204,    0}      // 1080p 4500Kb
+    };
+}
+
+// svcProj autotune [--frames N] [--p99 MS] [--rounds N] [--out FILE] <input> : calibrate and write a tuning SVCProj loads
+static int autotune(int argc, const char * argv[])
+{
+    AutotuneOptions options = {"", 250, 0, 2, std::min(4, MAX_TEMPORAL_LAYER_NUM), defaultSpatials()};
+    std::string out = "svc.tuning";
+    for (auto i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            options.frames = atoi(argv[++i]);
+        } else if (arg == "--p99" && i + 1 < argc) {
+            options.p99BoundMs = atof(argv[++i]);
+        } else if (arg == "--rounds" && i + 1 < argc) {
+            options.rounds = atoi(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            options.url = arg;
+        }
+    }
+    
+    SVCTuning best;
+    Autotuner tuner(options);
+    if (options.url.empty() || tuner.run(best, stdout)) {
+        fprintf(stderr, "autotune failed\n");
+        return -1;
+    }
+    
+    if (SVCTuningFile::save(out, best, "written by svcProj autotune for " + options.url)) {
+        fprintf(stderr, "can not write %s\n", out.c_str());
+        return -1;
+    }
+    
+    printf("tuning written to %s\n", out.c_str());
+    return 0;
+}
 
 int main(int argc, const char * argv[])
 {
+    if (argc >= 2 && std::string(argv[1]) == "analyze") {
+        if (argc < 3) {
+            fprintf(stderr, "usage: svcProj analyze <dump.data>...\n");
+            return -1;
+        }
+        
+        return analyze(argc - 2, argv + 2);
+    }
+    
+    if (argc >= 3 && std::string(argv[1]) == "replay") {
+        return replay(argc - 2, argv + 2);
+    }
+    
+    if (argc >= 3 && std::string(argv[1]) == "autotune") {
+        return autotune(argc - 2, argv + 2);
+    }
+    
+    if (argc >= 3 && std::string(argv[1]) == "shmtail") {
+        return shmtail(argc - 2, argv + 2);
+    }
+    
+    // svcProj [--fast-start] [--tuning FILE] : the demo session, fast start probes less of the input and inits the codecs in parallel,
+    // FILE is one written by `svcProj autotune`, the built-in knobs without it
+    auto fastStart = false;
+    std::string tuningPath;
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fast-start") {
+            fastStart = true;
+        } else if (arg == "--tuning" && i + 1 < argc) {
+            tuningPath = argv[++i];
+        }
+    }
+    
     auto queueMaxSize = 50;
     auto spatialNum = std::min(4, MAX_SPATIAL_LAYER_NUM);
     auto temporalNum = std::min(4, MAX_TEMPORAL_LAYER_NUM);
-    std::initializer_list<SpatialData> spatialData = {
-        {640,   360,    600 * 1024},    // 360p 600Kb
-        {854,   480,    1000 * 1024},   // 480p 1000Kb
-        {1280,  720,    2000 * 1024},   // 720p 2000Kb
-        {1920,  1080,   4500 * 1204}    // 1080p 4500Kb
-    };
+    auto spatialData = defaultSpatials();
     
     std::string url = "/Users/shengchao/Projects/svcProj/football.mp4";
     std::string dumpDir = "/Users/shengchao/Projects/svcProj/dumpOutput";
     std::shared_ptr<SVCProj> svcProj = std::make_shared<SVCProj>(temporalNum, spatialNum, spatialData);
+    if (fastStart) {    // inputs that need the default analyzeduration may be mis-probed, hence opt-in
+        svcProj->setStartupOptions({true, 1 << 20, 500 * 1000, false});  // 1MB / 500ms probe, codecs init in parallel
+    }
+    if (!tuningPath.empty()) {
+        svcProj->loadTuning(tuningPath);
+    }
     svcProj->start(url, dumpDir, queueMaxSize, AV_LOG_DEBUG);
     
     std::this_thread::sleep_for(std::chrono::seconds(2));